@@ -1,18 +1,42 @@
 #include "../view/mainwindow.h"
-#include "../model/file_operations.h"
 #include "../model/path.h"
 #include "../view/ui_mainwindow.h"
 #include <stdexcept>        // std::exception
+#include <exception>        // std::exception_ptr, std::rethrow_exception
 #include <utility>          // std::move
 #include <QFileDialog>
 #include <QString>
 #include <QApplication>
 #include <QMessageBox>
 #include <QSignalBlocker>
+#include <QTableWidgetItem>
+
+namespace
+{
+    QString getErrorMessage(std::exception_ptr error)
+    {
+        try
+        {
+            std::rethrow_exception(error);
+        }
+        catch (const std::exception &err)
+        {
+            return QString::fromLocal8Bit(err.what());
+        }
+        catch (...)
+        {
+            return QObject::tr("Unknown error");
+        }
+    }
+}
+
 
 MainWindowController::MainWindowController(MainWindow &parent)
     : QObject(&parent), parent(&parent)
 {
+    // renames are finished by a thread of the executor; the table is updated in the GUI thread
+    connect(this, &MainWindowController::renameFinished,
+            this, &MainWindowController::onRenameFinished, Qt::QueuedConnection);
 }
 
 
@@ -47,7 +71,8 @@ void MainWindowController::renameFile(int row, int column)
         return;
     }
 
-    auto * const item = parent->ui->filesTable->item(row, column);
+    auto * const table = parent->ui->filesTable;
+    auto * const item = table->item(row, column);
     const QString from = item->data(Qt::UserRole).toString();
     const QString to = item->text();
 
@@ -56,15 +81,33 @@ void MainWindowController::renameFile(int row, int column)
         return;
     }
 
+    QSignalBlocker blocker(table);
+
+    // the file name isn't known until the pending rename is finished, so the edit is ignored
+    if (item->data(renamePendingRole).toBool())
+    {
+        item->setText(from);
+        return;
+    }
+
     try
     {
         const auto dir = parent->worker->getPath();
-        const auto oldPath = dir / filesystem::Path(from.toStdWString().c_str());
-        const auto newPath = dir / filesystem::Path(to.toStdWString().c_str());
+        auto oldPath = dir / filesystem::Path(from.toStdWString().c_str());
+        auto newPath = dir / filesystem::Path(to.toStdWString().c_str());
+        const QString dirName = QString::fromWCharArray(dir.getPathString().c_str());
 
-        QSignalBlocker blocker(parent->ui->filesTable);
-        filesystem::rename(oldPath, newPath);
+        parent->fileOperations.submit(
+            {{FileOperationsExecutor::OperationType::rename, std::move(oldPath), std::move(newPath)}},
+            [this, dirName, from, to](const FileOperationsExecutor::Result &result)
+            {
+                emit renameFinished(dirName, from, to,
+                                    result.failures.empty() ? QString() : getErrorMessage(result.failures.front().error));
+            });
+
+        // the table shows the new name meanwhile; onRenameFinished restores the old one on failure
         item->setData(Qt::UserRole, to);
+        item->setData(renamePendingRole, true);
 
         return;
     }
@@ -77,11 +120,49 @@ void MainWindowController::renameFile(int row, int column)
         QMessageBox::critical(parent, tr("Error!"), tr("Unknown error"));
     }
 
-    QSignalBlocker blocker(parent->ui->filesTable);
     item->setText(from);
 }
 
 
+void MainWindowController::onRenameFinished(QString dir, QString from, QString to, QString error)
+{
+    if (dir != QString::fromWCharArray(parent->worker->getPath().getPathString().c_str()))
+    {
+        return;     // another directory is tracked now
+    }
+
+    // rows may have been moved by changes meanwhile
+    auto * const table = parent->ui->filesTable;
+    QTableWidgetItem *item = nullptr;
+    for (int row = 0; (row < table->rowCount()) && (item == nullptr); ++row)
+    {
+        auto * const candidate = table->item(row, MainWindow::fileNameColumn);
+        if ((candidate != nullptr) && candidate->data(renamePendingRole).toBool() &&
+            (candidate->data(Qt::UserRole).toString() == to))
+        {
+            item = candidate;
+        }
+    }
+
+    if (item != nullptr)
+    {
+        QSignalBlocker blocker(table);
+
+        item->setData(renamePendingRole, false);
+        if (!error.isEmpty())
+        {
+            item->setData(Qt::UserRole, from);
+            item->setText(from);
+        }
+    }
+
+    if (!error.isEmpty())
+    {
+        QMessageBox::critical(parent, tr("Error!"), error);
+    }
+}
+
+
 void MainWindowController::exit()
 {
     QApplication::exit();
@@ -0,0 +1,308 @@
+#include "directory_watcher.h"
+#include <limits>       // std::numeric_limits
+#include <stdexcept>    // std::length_error
+
+
+constexpr std::uint8_t DirectoryWatcher::ChangeContainer::typeMask;
+constexpr std::uint8_t DirectoryWatcher::ChangeContainer::rootFlag;
+constexpr std::uint8_t DirectoryWatcher::ChangeContainer::fingerprintedFlag;
+constexpr std::uint8_t DirectoryWatcher::ChangeContainer::selfOriginatedFlag;
+
+constexpr std::size_t DirectoryWatcher::ChangeBatch::Pool::maxFreeCount;
+constexpr std::size_t DirectoryWatcher::ChangeBatch::Pool::maxRecycledCapacity;
+
+
+DirectoryWatcher::ChangeBatch::ChangeBatch(ChangeContainer &&changes, std::shared_ptr<Pool> pool)
+    : changes(std::move(changes)), pool(std::move(pool))
+{
+}
+
+DirectoryWatcher::ChangeBatch::ChangeBatch(ChangeBatch &&src) noexcept
+    : changes(std::move(src.changes)), pool(std::move(src.pool))
+{
+    src.changes.clear();
+}
+
+DirectoryWatcher::ChangeBatch& DirectoryWatcher::ChangeBatch::operator=(ChangeBatch &&right) noexcept
+{
+    if (this != &right)
+    {
+        recycle();
+
+        changes = std::move(right.changes);
+        pool = std::move(right.pool);
+        right.changes.clear();
+    }
+
+    return *this;
+}
+
+DirectoryWatcher::ChangeBatch::~ChangeBatch()
+{
+    recycle();
+}
+
+
+DirectoryWatcher::ChangeIterator DirectoryWatcher::ChangeBatch::begin() const
+{
+    return changes.begin();
+}
+
+DirectoryWatcher::ChangeIterator DirectoryWatcher::ChangeBatch::end() const
+{
+    return changes.end();
+}
+
+
+std::size_t DirectoryWatcher::ChangeBatch::size() const
+{
+    return changes.size();
+}
+
+bool DirectoryWatcher::ChangeBatch::empty() const
+{
+    return changes.empty();
+}
+
+
+DirectoryWatcher::ChangeEntry DirectoryWatcher::ChangeBatch::operator[](std::size_t index) const
+{
+    return changes[index];
+}
+
+
+void DirectoryWatcher::ChangeBatch::recycle() noexcept
+{
+    if (pool)
+    {
+        pool->release(std::move(changes));
+        pool.reset();
+    }
+
+    changes.clear();
+}
+
+
+DirectoryWatcher::ChangeContainer DirectoryWatcher::ChangeBatch::Pool::acquire()
+{
+    std::lock_guard<decltype(mutex)> lock(mutex);
+
+    if (free.empty())
+    {
+        return {};
+    }
+
+    ChangeContainer result(std::move(free.back()));
+    free.pop_back();
+
+    return result;
+}
+
+void DirectoryWatcher::ChangeBatch::Pool::release(ChangeContainer &&changes) noexcept
+{
+    if ((changes.capacity() == 0) || (changes.capacity() > maxRecycledCapacity))
+    {
+        return;
+    }
+
+    // destruction of the changes is done out of the lock
+    ChangeContainer storage(std::move(changes));
+    storage.clear();
+
+    std::lock_guard<decltype(mutex)> lock(mutex);
+    if (free.size() < maxFreeCount)
+    {
+        try
+        {
+            free.push_back(std::move(storage));
+        }
+        catch (...)     // the storage is just freed
+        {
+        }
+    }
+}
+
+
+DirectoryWatcher::ChangeIterator DirectoryWatcher::ChangeContainer::begin() const
+{
+    return ChangeIterator(this, 0);
+}
+
+DirectoryWatcher::ChangeIterator DirectoryWatcher::ChangeContainer::end() const
+{
+    return ChangeIterator(this, records.size());
+}
+
+
+std::size_t DirectoryWatcher::ChangeContainer::size() const
+{
+    return records.size();
+}
+
+bool DirectoryWatcher::ChangeContainer::empty() const
+{
+    return records.empty();
+}
+
+std::size_t DirectoryWatcher::ChangeContainer::capacity() const
+{
+    return records.capacity();
+}
+
+std::size_t DirectoryWatcher::ChangeContainer::getMemoryUsage() const
+{
+    return records.capacity() * sizeof(Record) + paths.capacity() * sizeof(filesystem::Path::char_type) +
+           fingerprints.capacity() * sizeof(Fingerprints);
+}
+
+
+DirectoryWatcher::ChangeEntry DirectoryWatcher::ChangeContainer::operator[](std::size_t index) const
+{
+    return ChangeEntry(this, index);
+}
+
+const DirectoryWatcher::ChangeContainer::Record& DirectoryWatcher::ChangeContainer::getRecord(std::size_t index) const
+{
+    return records[index];
+}
+
+filesystem::PathView DirectoryWatcher::ChangeContainer::getOldPath(std::size_t index) const
+{
+    const auto &record = records[index];
+    return filesystem::PathView(paths.data() + record.pathOffset, record.oldPathLength);
+}
+
+filesystem::PathView DirectoryWatcher::ChangeContainer::getCurrentPath(std::size_t index) const
+{
+    const auto &record = records[index];
+    return filesystem::PathView(paths.data() + record.pathOffset + record.oldPathLength, record.currentPathLength);
+}
+
+const DirectoryWatcher::ChangeContainer::Fingerprints&
+DirectoryWatcher::ChangeContainer::getFingerprints(std::size_t index) const
+{
+    return fingerprints[index];
+}
+
+
+void DirectoryWatcher::ChangeContainer::push(ChangeEntry::ChangeType type,
+                                             filesystem::PathView oldPath, filesystem::PathView currentPath,
+                                             bool isRoot)
+{
+    constexpr std::size_t maxLength = std::numeric_limits<std::uint16_t>::max();
+    if ((oldPath.size() > maxLength) || (currentPath.size() > maxLength))
+    {
+        throw std::length_error("Too long path of a change");
+    }
+    if (paths.size() + oldPath.size() + currentPath.size() > std::numeric_limits<std::uint32_t>::max())
+    {
+        throw std::length_error("Too long paths of a batch");
+    }
+
+    Record record;
+    record.fileIndex = 0;
+    record.pathOffset = static_cast<std::uint32_t>(paths.size());
+    record.oldPathLength = static_cast<std::uint16_t>(oldPath.size());
+    record.currentPathLength = static_cast<std::uint16_t>(currentPath.size());
+    record.flags = static_cast<std::uint8_t>(type) | (isRoot ? rootFlag : 0);
+
+    records.push_back(record);
+    try
+    {
+        paths.insert(paths.end(), oldPath.data(), oldPath.data() + oldPath.size());
+        paths.insert(paths.end(), currentPath.data(), currentPath.data() + currentPath.size());
+    }
+    catch (...)
+    {
+        records.pop_back();
+        paths.resize(record.pathOffset);
+        throw;
+    }
+}
+
+
+void DirectoryWatcher::ChangeContainer::setFileIndex(std::size_t index, ChangeEntry::IndexType fileIndex)
+{
+    if (fileIndex > std::numeric_limits<std::uint32_t>::max())
+    {
+        throw std::length_error("Too large file index of a change");
+    }
+
+    records[index].fileIndex = static_cast<std::uint32_t>(fileIndex);
+}
+
+void DirectoryWatcher::ChangeContainer::setFingerprints(std::size_t index,
+                                                        ChangeEntry::Fingerprint oldFingerprint,
+                                                        ChangeEntry::Fingerprint newFingerprint)
+{
+    if (fingerprints.size() < records.size())
+    {
+        fingerprints.resize(records.size());
+    }
+
+    fingerprints[index] = {oldFingerprint, newFingerprint};
+    records[index].flags |= fingerprintedFlag;
+}
+
+void DirectoryWatcher::ChangeContainer::setSelfOriginated(std::size_t index)
+{
+    records[index].flags |= selfOriginatedFlag;
+}
+
+void DirectoryWatcher::ChangeContainer::retype(std::size_t index, ChangeEntry::ChangeType type)
+{
+    auto &record = records[index];
+    if (type == ChangeEntry::ChangeType::add)
+    {
+        record.pathOffset += record.oldPathLength;
+        record.oldPathLength = 0;
+    }
+    else if (type == ChangeEntry::ChangeType::remove)
+    {
+        record.currentPathLength = 0;
+    }
+
+    record.flags = static_cast<std::uint8_t>((record.flags & ~typeMask) | static_cast<std::uint8_t>(type));
+}
+
+
+void DirectoryWatcher::ChangeContainer::moveChange(std::size_t from, std::size_t to)
+{
+    records[to] = records[from];
+    if (!fingerprints.empty())
+    {
+        fingerprints[to] = fingerprints[from];
+    }
+}
+
+void DirectoryWatcher::ChangeContainer::truncate(std::size_t count)
+{
+    if (count >= records.size())
+    {
+        return;
+    }
+
+    // paths of the kept changes are in the same order as the changes, so the rest of the buffer isn't used
+    if (count == 0)
+    {
+        paths.clear();
+    }
+    else
+    {
+        const auto &last = records[count - 1];
+        paths.resize(last.pathOffset + last.oldPathLength + last.currentPathLength);
+    }
+
+    records.resize(count);
+    if (fingerprints.size() > count)
+    {
+        fingerprints.resize(count);
+    }
+}
+
+void DirectoryWatcher::ChangeContainer::clear()
+{
+    records.clear();
+    paths.clear();
+    fingerprints.clear();
+}
@@ -1,30 +1,57 @@
 #include "directory_watcher.h"
 
 
+DirectoryWatcher::ChangeEntry::ChangeEntry(const ChangeContainer *container, std::size_t index)
+    : container(container), index(index)
+{
+}
+
+
 DirectoryWatcher::ChangeEntry::ChangeType DirectoryWatcher::ChangeEntry::getType() const
 {
-    return changeType;
+    return static_cast<ChangeType>(container->getRecord(index).flags & ChangeContainer::typeMask);
 }
 
 
 DirectoryWatcher::ChangeEntry::IndexType DirectoryWatcher::ChangeEntry::getFileIndex() const
 {
-    return fileIndex;
+    return container->getRecord(index).fileIndex;
 }
 
 
 bool DirectoryWatcher::ChangeEntry::isRoot() const
 {
-    return root;
+    return (container->getRecord(index).flags & ChangeContainer::rootFlag) != 0;
 }
 
+bool DirectoryWatcher::ChangeEntry::isSelfOriginated() const
+{
+    return (container->getRecord(index).flags & ChangeContainer::selfOriginatedFlag) != 0;
+}
+
+
+filesystem::PathView DirectoryWatcher::ChangeEntry::getOldPath() const
+{
+    return container->getOldPath(index);
+}
+
+filesystem::PathView DirectoryWatcher::ChangeEntry::getCurrentPath() const
+{
+    return container->getCurrentPath(index);
+}
+
+
+bool DirectoryWatcher::ChangeEntry::hasFingerprints() const
+{
+    return (container->getRecord(index).flags & ChangeContainer::fingerprintedFlag) != 0;
+}
 
-const filesystem::Path& DirectoryWatcher::ChangeEntry::getOldPath() const
+DirectoryWatcher::ChangeEntry::Fingerprint DirectoryWatcher::ChangeEntry::getOldFingerprint() const
 {
-    return oldPath;
+    return hasFingerprints() ? container->getFingerprints(index).oldFingerprint : 0;
 }
 
-const filesystem::Path& DirectoryWatcher::ChangeEntry::getCurrentPath() const
+DirectoryWatcher::ChangeEntry::Fingerprint DirectoryWatcher::ChangeEntry::getNewFingerprint() const
 {
-    return currentPath;
+    return hasFingerprints() ? container->getFingerprints(index).newFingerprint : 0;
 }
@@ -0,0 +1,355 @@
+#include "directory_aggregates.h"
+#include <stdexcept>    // std::out_of_range
+#include <utility>      // std::move
+
+
+DirectoryAggregates::DirectoryAggregates() = default;
+DirectoryAggregates::~DirectoryAggregates() = default;
+
+
+void DirectoryAggregates::set(const filesystem::Path &path, std::uint64_t size, TimePoint modifyDate, bool isDirectory)
+{
+    const auto components = split(path);
+    if (components.empty())     // the tracked directory itself
+    {
+        return;
+    }
+
+    std::lock_guard<decltype(mutex)> lock(mutex);
+
+    Node *const directory = getDirectory(components, components.size() - 1);
+    const auto &name = components.back();
+
+    if (isDirectory)
+    {
+        eraseFile(directory, name);
+        if (directory->subdirectories.find(name) == directory->subdirectories.end())
+        {
+            auto node = std::make_unique<Node>();
+            node->parent = directory;
+            directory->subdirectories.emplace(name, std::move(node));
+        }
+    }
+    else
+    {
+        detachDirectory(directory, name);
+        setFile(directory, name, size, modifyDate);
+    }
+}
+
+void DirectoryAggregates::erase(const filesystem::Path &path)
+{
+    const auto components = split(path);
+    if (components.empty())
+    {
+        return;
+    }
+
+    std::lock_guard<decltype(mutex)> lock(mutex);
+
+    Node *const directory = findDirectory(components, components.size() - 1);
+    if (directory != nullptr)
+    {
+        eraseFile(directory, components.back());
+        detachDirectory(directory, components.back());
+    }
+}
+
+bool DirectoryAggregates::rename(const filesystem::Path &oldPath, const filesystem::Path &newPath)
+{
+    const auto oldComponents = split(oldPath);
+    const auto newComponents = split(newPath);
+    if (oldComponents.empty() || newComponents.empty())
+    {
+        return false;
+    }
+
+    std::lock_guard<decltype(mutex)> lock(mutex);
+
+    Node *const oldDirectory = findDirectory(oldComponents, oldComponents.size() - 1);
+    if (oldDirectory == nullptr)
+    {
+        return false;
+    }
+
+    const auto &oldName = oldComponents.back();
+    const auto &newName = newComponents.back();
+
+    const auto file = oldDirectory->files.find(oldName);
+    if (file != oldDirectory->files.end())
+    {
+        const FileEntry entry = file->second;
+        eraseFile(oldDirectory, oldName);
+
+        Node *const newDirectory = getDirectory(newComponents, newComponents.size() - 1);
+        detachDirectory(newDirectory, newName);     // the rename replaces an existing file
+        setFile(newDirectory, newName, entry.size, entry.modifyDate);
+
+        return true;
+    }
+
+    auto node = detachDirectory(oldDirectory, oldName);
+    if (!node)
+    {
+        return false;
+    }
+
+    Node *const newDirectory = getDirectory(newComponents, newComponents.size() - 1);
+    eraseFile(newDirectory, newName);
+    detachDirectory(newDirectory, newName);
+
+    const Delta delta = makeSubtreeDelta(*node, false);
+    node->parent = newDirectory;
+    newDirectory->subdirectories.emplace(newName, std::move(node));
+    apply(newDirectory, delta);
+    return true;
+}
+
+void DirectoryAggregates::clear()
+{
+    std::lock_guard<decltype(mutex)> lock(mutex);
+
+    root.subdirectories.clear();
+    root.files.clear();
+    root.totalSize = 0;
+    root.filesCount = 0;
+    root.modifyDates.clear();
+}
+
+
+DirectoryAggregates::Aggregate DirectoryAggregates::getAggregate(const filesystem::Path &directory) const
+{
+    const auto components = split(directory);
+
+    std::lock_guard<decltype(mutex)> lock(mutex);
+
+    const Node *const node = findDirectory(components, components.size());
+    if (node == nullptr)
+    {
+        throw std::out_of_range("Unknown directory");
+    }
+
+    return makeAggregate(*node);
+}
+
+std::vector<std::pair<filesystem::Path, DirectoryAggregates::Aggregate>>
+DirectoryAggregates::getSubdirectories(const filesystem::Path &directory) const
+{
+    const auto components = split(directory);
+
+    std::lock_guard<decltype(mutex)> lock(mutex);
+
+    const Node *const node = findDirectory(components, components.size());
+    if (node == nullptr)
+    {
+        throw std::out_of_range("Unknown directory");
+    }
+
+    std::vector<std::pair<filesystem::Path, Aggregate>> result;
+    result.reserve(node->subdirectories.size());
+    for (const auto &subdirectory : node->subdirectories)
+    {
+        result.emplace_back(filesystem::Path(subdirectory.first), makeAggregate(*subdirectory.second));
+    }
+
+    return result;
+}
+
+
+std::vector<DirectoryAggregates::string_type> DirectoryAggregates::split(const filesystem::Path &path)
+{
+    using CharType = filesystem::Path::char_type;
+
+    std::vector<string_type> result;
+
+    const auto &string = path.getPathString();
+    std::size_t begin = 0;
+    for (std::size_t i = 0; i <= string.length(); ++i)
+    {
+        if ((i == string.length()) || (string[i] == CharType('\\')) || (string[i] == CharType('/')))
+        {
+            if (i != begin)
+            {
+                result.emplace_back(string, begin, i - begin);
+            }
+            begin = i + 1;
+        }
+    }
+
+    return result;
+}
+
+DirectoryAggregates::Aggregate DirectoryAggregates::makeAggregate(const Node &node)
+{
+    return {node.totalSize, node.filesCount,
+            node.modifyDates.empty() ? TimePoint() : *node.modifyDates.crbegin()};
+}
+
+
+DirectoryAggregates::Node* DirectoryAggregates::findDirectory(const std::vector<string_type> &components,
+                                                              std::size_t count)
+{
+    Node *result = &root;
+    for (std::size_t i = 0; (i < count) && (result != nullptr); ++i)
+    {
+        const auto subdirectory = result->subdirectories.find(components[i]);
+        result = (subdirectory == result->subdirectories.end()) ? nullptr : subdirectory->second.get();
+    }
+
+    return result;
+}
+
+const DirectoryAggregates::Node* DirectoryAggregates::findDirectory(const std::vector<string_type> &components,
+                                                                    std::size_t count) const
+{
+    return const_cast<DirectoryAggregates*>(this)->findDirectory(components, count);
+}
+
+DirectoryAggregates::Node* DirectoryAggregates::getDirectory(const std::vector<string_type> &components,
+                                                             std::size_t count)
+{
+    Node *result = &root;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const auto subdirectory = result->subdirectories.find(components[i]);
+        if (subdirectory != result->subdirectories.end())
+        {
+            result = subdirectory->second.get();
+            continue;
+        }
+
+        eraseFile(result, components[i]);   // a file can't contain files, so it has been replaced
+
+        auto node = std::make_unique<Node>();
+        node->parent = result;
+        result = result->subdirectories.emplace(components[i], std::move(node)).first->second.get();
+    }
+
+    return result;
+}
+
+
+void DirectoryAggregates::apply(Node *node, Delta delta)
+{
+    for (Node *current = node; current != nullptr; current = current->parent)
+    {
+        const bool wasEmpty = current->modifyDates.empty();
+        const TimePoint before = wasEmpty ? TimePoint() : *current->modifyDates.crbegin();
+
+        if (delta.hasRemovedDate)
+        {
+            const auto date = current->modifyDates.find(delta.removedDate);
+            if (date != current->modifyDates.end())
+            {
+                current->modifyDates.erase(date);
+            }
+        }
+        if (delta.hasAddedDate)
+        {
+            current->modifyDates.insert(delta.addedDate);
+        }
+
+        // unsigned overflows of intermediate values are compensated
+        current->totalSize = current->totalSize - delta.removedSize + delta.addedSize;
+        current->filesCount = current->filesCount - delta.removedCount + delta.addedCount;
+
+        const bool isEmpty = current->modifyDates.empty();
+        const TimePoint after = isEmpty ? TimePoint() : *current->modifyDates.crbegin();
+
+        // the parent keeps the latest date of every nonempty subdirectory
+        delta.hasRemovedDate = !wasEmpty;
+        delta.removedDate = before;
+        delta.hasAddedDate = !isEmpty;
+        delta.addedDate = after;
+        if (delta.hasRemovedDate && delta.hasAddedDate && (before == after))
+        {
+            delta.hasRemovedDate = delta.hasAddedDate = false;
+        }
+    }
+}
+
+DirectoryAggregates::Delta DirectoryAggregates::makeSubtreeDelta(const Node &node, bool isRemoving)
+{
+    Delta result;
+    const bool hasDate = !node.modifyDates.empty();
+    const TimePoint date = hasDate ? *node.modifyDates.crbegin() : TimePoint();
+
+    if (isRemoving)
+    {
+        result.removedSize = node.totalSize;
+        result.removedCount = node.filesCount;
+        result.hasRemovedDate = hasDate;
+        result.removedDate = date;
+    }
+    else
+    {
+        result.addedSize = node.totalSize;
+        result.addedCount = node.filesCount;
+        result.hasAddedDate = hasDate;
+        result.addedDate = date;
+    }
+
+    return result;
+}
+
+
+void DirectoryAggregates::setFile(Node *directory, const string_type &name, std::uint64_t size, TimePoint modifyDate)
+{
+    Delta delta;
+    delta.addedSize = size;
+    delta.addedCount = 1;
+    delta.hasAddedDate = true;
+    delta.addedDate = modifyDate;
+
+    const auto file = directory->files.find(name);
+    if (file != directory->files.end())
+    {
+        delta.removedSize = file->second.size;
+        delta.removedCount = 1;
+        delta.hasRemovedDate = true;
+        delta.removedDate = file->second.modifyDate;
+
+        file->second = {size, modifyDate};
+    }
+    else
+    {
+        directory->files.emplace(name, FileEntry{size, modifyDate});
+    }
+
+    apply(directory, delta);
+}
+
+void DirectoryAggregates::eraseFile(Node *directory, const string_type &name)
+{
+    const auto file = directory->files.find(name);
+    if (file == directory->files.end())
+    {
+        return;
+    }
+
+    Delta delta;
+    delta.removedSize = file->second.size;
+    delta.removedCount = 1;
+    delta.hasRemovedDate = true;
+    delta.removedDate = file->second.modifyDate;
+
+    directory->files.erase(file);
+    apply(directory, delta);
+}
+
+std::unique_ptr<DirectoryAggregates::Node> DirectoryAggregates::detachDirectory(Node *parent, const string_type &name)
+{
+    const auto subdirectory = parent->subdirectories.find(name);
+    if (subdirectory == parent->subdirectories.end())
+    {
+        return nullptr;
+    }
+
+    auto result = std::move(subdirectory->second);
+    parent->subdirectories.erase(subdirectory);
+
+    apply(parent, makeSubtreeDelta(*result, true));
+    result->parent = nullptr;
+
+    return result;
+}
@@ -0,0 +1,126 @@
+#ifndef DIRECTORY_AGGREGATES_H
+#define DIRECTORY_AGGREGATES_H
+
+#include "path.h"
+#include <unordered_map>    // children of directory nodes
+#include <set>              // std::multiset
+#include <memory>           // std::unique_ptr
+#include <vector>           // query results
+#include <utility>          // std::pair
+#include <mutex>
+#include <chrono>           // std::chrono::system_clock
+#include <cstdint>          // std::uint64_t
+#include <cstddef>          // std::size_t
+
+
+/* DirectoryAggregates keeps total size, count and the latest modify date of files of every directory
+ * of tracked files (including files of its subdirectories), so "du" doesn't need rescans
+ * It's updated incrementally by DirectoryWatcher from change batches (see DirectoryWatcher::Options::aggregateDirectories)
+ *
+ * Directories are nodes of a tree of path components; every update costs O(depth * log(width)),
+ * renames of directories move the whole subtree at the same cost
+ * Queries and updates are thread safe */
+class DirectoryAggregates
+{
+public:
+    using TimePoint = std::chrono::system_clock::time_point;
+
+    struct Aggregate
+    {
+        std::uint64_t totalSize;        // of all files of the directory and its subdirectories
+        std::uint64_t filesCount;       // the same
+        TimePoint latestModifyDate;     // TimePoint() if there are no files
+    };
+
+
+    DirectoryAggregates();
+    ~DirectoryAggregates();
+
+    /*
+     * Adds the file or updates its attributes
+     * Parameters:
+     *  path        -   relative to tracked directory; components are delimited by '\' or '/'
+     *  isDirectory -   if true then the file is a directory node (its size and modify date are ignored)
+     */
+    void set(const filesystem::Path &path, std::uint64_t size, TimePoint modifyDate, bool isDirectory);
+
+    /* Erases the file or the directory with all its contents; does nothing if the path isn't known */
+    void erase(const filesystem::Path &path);
+
+    /* Moves the file or the directory with all its contents
+     * Does nothing and returns false if the old path isn't known */
+    bool rename(const filesystem::Path &oldPath, const filesystem::Path &newPath);
+
+    void clear();
+
+
+    /*
+     * Returns aggregate of the directory
+     * Parameters:
+     *  directory   -   relative to tracked directory; Path() means the tracked directory itself
+     *
+     * Throws:
+     *  std::out_of_range   -   the directory isn't known
+     */
+    Aggregate getAggregate(const filesystem::Path &directory) const;
+
+    /* Returns names and aggregates of direct subdirectories of the directory (see getAggregate) */
+    std::vector<std::pair<filesystem::Path, Aggregate>> getSubdirectories(const filesystem::Path &directory) const;
+
+private:
+    using string_type = filesystem::Path::string_type;
+
+    struct FileEntry
+    {
+        std::uint64_t size;
+        TimePoint modifyDate;
+    };
+
+    struct Node
+    {
+        Node *parent = nullptr;
+        std::unordered_map<string_type, std::unique_ptr<Node>> subdirectories;
+        std::unordered_map<string_type, FileEntry> files;
+
+        std::uint64_t totalSize = 0;
+        std::uint64_t filesCount = 0;
+        std::multiset<TimePoint> modifyDates;   // of direct files and the latest ones of nonempty subdirectories
+    };
+
+    /* Difference of aggregates which is applied to a node and all its ancestors */
+    struct Delta
+    {
+        std::uint64_t addedSize = 0, removedSize = 0;
+        std::uint64_t addedCount = 0, removedCount = 0;
+        bool hasRemovedDate = false, hasAddedDate = false;
+        TimePoint removedDate, addedDate;
+    };
+
+    Node root;
+    mutable std::mutex mutex;
+
+
+    DirectoryAggregates(const DirectoryAggregates&) = delete;
+    DirectoryAggregates& operator=(const DirectoryAggregates&) = delete;
+
+    static std::vector<string_type> split(const filesystem::Path &path);
+    static Aggregate makeAggregate(const Node &node);
+
+    /* Returns nullptr if the directory of the first count components isn't known */
+    Node* findDirectory(const std::vector<string_type> &components, std::size_t count);
+    const Node* findDirectory(const std::vector<string_type> &components, std::size_t count) const;
+
+    /* Creates missing directories */
+    Node* getDirectory(const std::vector<string_type> &components, std::size_t count);
+
+    static void apply(Node *node, Delta delta);
+
+    /* Delta which adds (or removes if isRemoving) the subtree of the node to its parent */
+    static Delta makeSubtreeDelta(const Node &node, bool isRemoving);
+
+    void setFile(Node *directory, const string_type &name, std::uint64_t size, TimePoint modifyDate);
+    void eraseFile(Node *directory, const string_type &name);
+    std::unique_ptr<Node> detachDirectory(Node *parent, const string_type &name);
+};
+
+#endif // DIRECTORY_AGGREGATES_H
@@ -2,29 +2,42 @@
 #define DIRECTORY_WATCHER_H
 
 #include "path.h"
+#include "path_filter.h"
+#include "latency_histogram.h"
+#include "watcher_statistics.h"
+#include "file_index.h"
+#include "directory_aggregates.h"
+#include "path_search_index.h"
+#include "event_recording.h"
+#include "self_change_registry.h"
 #include <functional>   // std::function
-#include <utility>      // std::forward
-#include <memory>       // std::unique_ptr
-#include <vector>       // ChangeContainer typedef
-#include <cstdint>      // std::uint64_t (IndexType typedef)
+#include <utility>      // std::forward, std::declval
+#include <memory>       // std::unique_ptr, std::shared_ptr
+#include <mutex>        // ChangeBatch::Pool
+#include <vector>       // ChangeContainer fields
+#include <iterator>     // std::random_access_iterator_tag
+#include <cstdint>      // std::uint64_t (IndexType typedef), std::uint32_t, etc.
+#include <cstddef>      // std::size_t, std::ptrdiff_t
+#include <chrono>       // std::chrono::milliseconds
+#include <exception>    // std::exception_ptr
 
 
 /* DirectoryWatcher provides base support for directory changes monitoring
- * Intended for single use only (call startWatch after shutdown by stopWatch is undefined behaviour
+ * Watching may be resumed by startWatch after shutdown by stopWatch (see startWatch method)
  * This class requires a separate thread for work (see startWatch method) */
 class DirectoryWatcher
 {
 public:
     class ChangeEntry;
+    class ChangeIterator;
 
 private:
     class Impl;
-    using ChangeContainer = std::vector<ChangeEntry>;
+    class ChangeContainer;
 
 public:
-    using ChangeIterator = ChangeContainer::const_iterator;     // implementation defined
-
-    /* ChangeEntry represents any change in directory */
+    /* ChangeEntry represents any change in directory
+     * It's a view of a change stored in a batch, so it's valid while the batch lives (and isn't moved) */
     class ChangeEntry
     {
     public:
@@ -36,6 +49,7 @@ public:
          */
         enum class ChangeType{ add, remove, rename, modify };
         using IndexType = std::uint64_t;
+        using Fingerprint = std::uint64_t;    // see filesystem::getContentFingerprint
 
 
         ChangeEntry(const ChangeEntry &src) = default;
@@ -58,43 +72,375 @@ public:
          * Note : on Windows, this function always returns false */
         bool isRoot() const;
 
+        /* returns true if this change has been made by this process through FileOperationsExecutor
+         * (see Options::selfChanges); false if the watcher has no registry of such changes */
+        bool isSelfOriginated() const;
+
         /*
          * returns old path (relative to tracked directory) of changed file
-         * if getType() == ChangeType::add then returns Path()
+         * if getType() == ChangeType::add then returns empty path
          * if getType() == ChangeType::remove then returns path of deleted file
          * if getType() == ChangeType::rename then returns old path of renamed file
-         * if getType() == ChangeType::modify then returns Path()
+         * if getType() == ChangeType::modify then returns empty path
+         * The view is valid while the batch lives
          */
-        const filesystem::Path& getOldPath() const;
+        filesystem::PathView getOldPath() const;
 
         /*
          * returns current path (relative to tracked directory) of changed file
          * if getType() == ChangeType::add then returns path of added file
-         * if getType() == ChangeType::remove then returns Path()
+         * if getType() == ChangeType::remove then returns empty path
          * if getType() == ChangeType::rename then returns new path of renamed file
          * if getType() == ChangeType::modify then returns path of this file
+         * The view is valid while the batch lives
+         */
+        filesystem::PathView getCurrentPath() const;
+
+        /*
+         * returns true if fingerprints of the file contents before and after this change are known
+         * Fingerprints are known for modify changes only if the watcher fingerprints contents
+         * (see Options::fingerprintContents) and both fingerprints have been computed successfully
          */
-        const filesystem::Path& getCurrentPath() const;
+        bool hasFingerprints() const;
+
+        /* returns fingerprint of the file contents before this change; if !hasFingerprints() then returns 0 */
+        Fingerprint getOldFingerprint() const;
+
+        /* returns fingerprint of the file contents after this change; if !hasFingerprints() then returns 0 */
+        Fingerprint getNewFingerprint() const;
+
+    private:
+        friend class DirectoryWatcher::ChangeIterator;
+        friend class DirectoryWatcher::ChangeContainer;
+
+        const ChangeContainer *container = nullptr;
+        std::size_t index = 0;
+
+        ChangeEntry() = default;
+        ChangeEntry(const ChangeContainer *container, std::size_t index);
+    };
+
+
+    /* Random access iterator of changes; it's dereferenced to a view of the change (see ChangeEntry) */
+    class ChangeIterator
+    {
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type = ChangeEntry;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const ChangeEntry*;
+        using reference = const ChangeEntry&;
+
+        ChangeIterator() = default;
+
+        reference operator*() const { return entry; }
+        pointer operator->() const { return &entry; }
+        ChangeEntry operator[](difference_type n) const { return *(*this + n); }
+
+        ChangeIterator& operator++() { ++entry.index; return *this; }
+        ChangeIterator operator++(int) { auto result = *this; ++entry.index; return result; }
+        ChangeIterator& operator--() { --entry.index; return *this; }
+        ChangeIterator operator--(int) { auto result = *this; --entry.index; return result; }
+
+        ChangeIterator& operator+=(difference_type n) { entry.index += n; return *this; }
+        ChangeIterator& operator-=(difference_type n) { entry.index -= n; return *this; }
+
+        ChangeIterator operator+(difference_type n) const { auto result = *this; return result += n; }
+        ChangeIterator operator-(difference_type n) const { auto result = *this; return result -= n; }
+        friend ChangeIterator operator+(difference_type n, const ChangeIterator &iter) { return iter + n; }
+
+        difference_type operator-(const ChangeIterator &right) const
+        { return static_cast<difference_type>(entry.index) - static_cast<difference_type>(right.entry.index); }
+
+        bool operator==(const ChangeIterator &right) const
+        { return (entry.index == right.entry.index) && (entry.container == right.entry.container); }
+        bool operator!=(const ChangeIterator &right) const { return !(*this == right); }
+        bool operator<(const ChangeIterator &right) const { return entry.index < right.entry.index; }
+        bool operator>(const ChangeIterator &right) const { return right < *this; }
+        bool operator<=(const ChangeIterator &right) const { return !(right < *this); }
+        bool operator>=(const ChangeIterator &right) const { return !(*this < right); }
+
+    private:
+        friend class DirectoryWatcher::ChangeContainer;
+
+        ChangeEntry entry;
+
+        ChangeIterator(const ChangeContainer *container, std::size_t index) : entry(container, index) {}
+    };
+
+private:
+    /* Compact storage of changes (structure of arrays):
+     *  records         -   packed type, flags and file index of every change and position of its paths
+     *  paths           -   characters of all paths; the old path of a change is followed by the current one,
+     *                      so empty paths take no space and only renames occupy two path slots
+     *  fingerprints    -   parallel to records if any change has fingerprints; empty otherwise */
+    class ChangeContainer
+    {
+    public:
+        struct Record
+        {
+            std::uint32_t fileIndex;
+            std::uint32_t pathOffset;           // position of the old path in paths
+            std::uint16_t oldPathLength;
+            std::uint16_t currentPathLength;
+            std::uint8_t flags;                 // the change type (see typeMask) and flags
+        };
+
+        struct Fingerprints
+        {
+            ChangeEntry::Fingerprint oldFingerprint;
+            ChangeEntry::Fingerprint newFingerprint;
+        };
+
+        static constexpr std::uint8_t typeMask = 0x03;
+        static constexpr std::uint8_t rootFlag = 0x04;
+        static constexpr std::uint8_t fingerprintedFlag = 0x08;
+        static constexpr std::uint8_t selfOriginatedFlag = 0x10;
+
+
+        ChangeIterator begin() const;
+        ChangeIterator end() const;
+
+        std::size_t size() const;
+        bool empty() const;
+
+        /* Returns count of changes which can be stored without reallocation */
+        std::size_t capacity() const;
+
+        /* Returns count of bytes allocated by the container */
+        std::size_t getMemoryUsage() const;
+
+        ChangeEntry operator[](std::size_t index) const;
+
+        const Record& getRecord(std::size_t index) const;
+        filesystem::PathView getOldPath(std::size_t index) const;
+        filesystem::PathView getCurrentPath(std::size_t index) const;
+        const Fingerprints& getFingerprints(std::size_t index) const;
+
+        /*
+         * Appends change with fileIndex = 0
+         * Throws:
+         *  std::length_error   -   a path is longer than 65535 characters
+         */
+        void push(ChangeEntry::ChangeType type, filesystem::PathView oldPath, filesystem::PathView currentPath,
+                  bool isRoot);
+
+        /*
+         * Throws:
+         *  std::length_error   -   fileIndex doesn't fit 32 bits
+         */
+        void setFileIndex(std::size_t index, ChangeEntry::IndexType fileIndex);
+        void setFingerprints(std::size_t index, ChangeEntry::Fingerprint oldFingerprint,
+                             ChangeEntry::Fingerprint newFingerprint);
+        void setSelfOriginated(std::size_t index);
+
+        /* Changes type of the change to add (the old path is dropped) or to remove (the current path is dropped) */
+        void retype(std::size_t index, ChangeEntry::ChangeType type);
+
+        /* Replaces change with index to by change with index from (characters of the old one aren't freed) */
+        void moveChange(std::size_t from, std::size_t to);
+
+        /* Drops all changes starting with index count */
+        void truncate(std::size_t count);
+
+        /* Keeps allocated memory */
+        void clear();
+
+    private:
+        std::vector<Record> records;
+        std::vector<filesystem::Path::char_type> paths;
+        std::vector<Fingerprints> fingerprints;
+    };
+
+public:
+    /* ChangeBatch owns changes of one batch; it's movable only
+     * Storage of destroyed batches is recycled by the watcher for the next batches,
+     * so a handler can take a batch away for asynchronous processing without copying of changes
+     * (iterators and entries refer to the batch object, so take them after the move) */
+    class ChangeBatch
+    {
+    public:
+        class Pool;
+
+        ChangeBatch() = default;
+        ChangeBatch(ChangeBatch &&src) noexcept;
+        ChangeBatch& operator=(ChangeBatch &&right) noexcept;
+        ~ChangeBatch();
+
+        ChangeIterator begin() const;
+        ChangeIterator end() const;
+
+        std::size_t size() const;
+        bool empty() const;
+
+        ChangeEntry operator[](std::size_t index) const;
 
     private:
-        friend class DirectoryWatcher;
         friend class DirectoryWatcher::Impl;
 
-        ChangeType changeType;
-        IndexType fileIndex;
-        filesystem::Path oldPath;
-        filesystem::Path currentPath;
-        bool root;
-
-        template<typename OPath, typename CPath>
-        ChangeEntry(ChangeType type, IndexType fileIndex,
-                    OPath &&oldPath, CPath &&currentPath,
-                    bool isRoot)
-            : changeType(type), fileIndex(fileIndex),
-              oldPath(std::forward<OPath>(oldPath)), currentPath(std::forward<CPath>(currentPath)),
-              root(isRoot)
+        ChangeContainer changes;
+        std::shared_ptr<Pool> pool;     // nullptr if the storage isn't recycled
+
+        ChangeBatch(ChangeContainer &&changes, std::shared_ptr<Pool> pool);
+
+        ChangeBatch(const ChangeBatch&) = delete;
+        ChangeBatch& operator=(const ChangeBatch&) = delete;
+
+        void recycle() noexcept;
+    };
+
+    /* Storage of destroyed batches which is ready for reuse; thread safe */
+    class ChangeBatch::Pool
+    {
+    public:
+        /* Returns empty storage (with capacity of a recycled one if there is any) */
+        ChangeContainer acquire();
+
+        void release(ChangeContainer &&changes) noexcept;
+
+    private:
+        static constexpr std::size_t maxFreeCount = 4;
+        static constexpr std::size_t maxRecycledCapacity = 64 * 1024;  // larger storages are freed
+
+        std::mutex mutex;
+        std::vector<ChangeContainer> free;
+    };
+
+    /* Handle of a system object which can be waited for (event handle on Windows) */
+    using NativeHandle = void*;
+
+    /* Executes the passed function (for example, posts it into an event loop) */
+    using Executor = std::function<void(std::function<void()>)>;
+
+
+    /* Awaitable result of nextBatch (see it) */
+    class BatchAwaiter
+    {
+    public:
+        /* Returns true if the batch is available without waiting */
+        bool await_ready();
+
+        /*
+         * Starts waiting for the batch; continuation is called when the batch is available
+         * Parameters:
+         *  continuation    -   any callable without parameters (std::coroutine_handle<> too)
+         */
+        template<typename Continuation>
+        void await_suspend(Continuation continuation)
         {
+            suspend(std::function<void()>(std::move(continuation)));
         }
+
+        /* Returns the batch; rethrows an exception which occured during waiting */
+        ChangeBatch await_resume();
+
+    private:
+        friend class DirectoryWatcher;
+
+        DirectoryWatcher &watcher;
+        Executor executor;
+        std::exception_ptr error;
+
+        BatchAwaiter(DirectoryWatcher &watcher, Executor &&executor);
+
+        void suspend(std::function<void()> &&continuation);
+    };
+
+
+    /*
+     * Per-stage latencies of change batches processing
+     *  parse       -   from kernel read completion till the batch has been parsed
+     *  update      -   from parsed batch till the end of the tracked files list update
+     *  dispatch    -   from the end of the files list update till the changeHandler entry
+     *  handler     -   changeHandler execution
+     *  total       -   from kernel read completion till the changeHandler exit
+     * Batches taken by nextBatch have no handler stage; their dispatch and total end when they are taken
+     */
+    struct LatencyStats
+    {
+        LatencyHistogram::Summary parse;
+        LatencyHistogram::Summary update;
+        LatencyHistogram::Summary dispatch;
+        LatencyHistogram::Summary handler;
+        LatencyHistogram::Summary total;
+    };
+
+
+    /*
+     * Sources of changes
+     *  notifications   -   change notifications of the system
+     *  polling         -   periodical listing of the directory compared with the tracked files list;
+     *                      intended for filesystems without change notifications (some network shares, etc.)
+     *  automatic       -   notifications if the filesystem supports them; polling otherwise
+     */
+    enum class Backend{ automatic, notifications, polling };
+
+
+    /* Optional settings of DirectoryWatcher */
+    struct Options
+    {
+        /* Runtime counters to publish into; if nullptr then DirectoryWatcher creates its own */
+        std::shared_ptr<WatcherStatistics> statistics;
+
+        /* Files which are rejected by the filter are never tracked nor reported */
+        PathFilter filter;
+
+        /* If true then contents of tracked files are fingerprinted (see filesystem::getContentFingerprint)
+         * and modify changes which leave the contents unchanged (touch, metadata-only writes, rewrites with
+         * the same data) are not reported. Fingerprints are computed by fingerprintThreads background threads
+         * (0 means count of hardware threads) */
+        bool fingerprintContents = false;
+        std::size_t fingerprintThreads = 0;
+
+        Backend backend = Backend::automatic;
+
+        /* Bounds of the polling interval. The interval is halved after every poll which has found changes
+         * and doubled after every idle one. The directory is listed only if its modify date has changed
+         * or the last listing is older than maxPollInterval (writes into files don't change the directory
+         * modify date), so idle directories cost a single attributes request per poll */
+        std::chrono::milliseconds minPollInterval{100};
+        std::chrono::milliseconds maxPollInterval{5000};
+
+        /* Limit of changes count per batch during full scanning of the directory (the initial one and after
+         * retarget) and during its listing after an overflow of notifications; 0 means no limit. Chunks are
+         * delivered while enumeration progresses, so the first files are reported before the scanning completes */
+        std::size_t scanChunkSize = 1024;
+
+        /* If true then secondary indexes of the tracked files (by size, modify date and extension) are
+         * maintained from change batches (see getFilesIndex). Attributes of files are taken from scanning
+         * and polling results; for notified adds and modifies they are requested from the system */
+        bool indexFiles = false;
+
+        /* If true then total size, count and the latest modify date of files are maintained for the tracked
+         * directory and its known subdirectories (see getDirectoryAggregates); attributes are taken as for indexFiles */
+        bool aggregateDirectories = false;
+
+        /* If true then the tracked paths are indexed for prefix, substring and glob queries
+         * (see getPathSearchIndex); the index is maintained from change batches */
+        bool indexPaths = false;
+
+        /* If not empty then the tracked files list is published after every batch into the shared memory
+         * region of this name, so other processes can read it (see SharedSnapshotReader). The region holds
+         * two buffers of sharedSnapshotCapacity bytes; lists which don't fit them are published incomplete
+         * Sizes and modify dates of files are published if indexFiles is set (they are taken from the index)
+         * Every publication copies the whole list, so it's made at most once per sharedSnapshotInterval;
+         * the list of the last batch is published when the interval passes */
+        filesystem::Path::string_type sharedSnapshotName;
+        std::size_t sharedSnapshotCapacity = 16 * 1024 * 1024;
+        std::chrono::milliseconds sharedSnapshotInterval{100};
+
+        /* If set then raw change buffers are taken from the source instead of the system, so recorded event
+         * streams can be replayed through parsing, the tracked files list and the handler (see ChangeEventReplayer).
+         * The directory is still listed by the initial scan; recorded overflows are counted by statistics only,
+         * so replays don't depend on the current state of the directory. backend is ignored */
+        std::shared_ptr<ChangeEventSource> eventSource;
+
+        /* If set then every raw change buffer is recorded before parsing (see ChangeEventRecorder) */
+        std::shared_ptr<ChangeEventRecorder> eventRecorder;
+
+        /* If set then changes of paths registered in it are tagged as self-originated (see
+         * ChangeEntry::isSelfOriginated); every registration tags one change of the old or the current path */
+        std::shared_ptr<SelfChangeRegistry> selfChanges;
     };
 
 
@@ -103,27 +449,36 @@ public:
      *
      * Parameters:
      *  path                -   full path to tracked directory
+     *  options             -   optional settings (see Options)
      *
      * Throws:
      *  std::system_error   -   directory processing with this path causes a error
      *                          (for example, the directory does not exists)
+     *                          or the shared snapshot region can't be created
      */
     DirectoryWatcher(const filesystem::Path &path);
     DirectoryWatcher(filesystem::Path &&path);    
+    DirectoryWatcher(const filesystem::Path &path, const Options &options);
+    DirectoryWatcher(filesystem::Path &&path, const Options &options);
 
     ~DirectoryWatcher();
 
     /*
      * Starts monitoring the directory with path, specified in constructor
      * blocks current thread until call stopWatch()
+     * The first batch consists of adds of all files of the directory. If watching is resumed (startWatch is
+     * called again after it has returned) then the first batch is built from the tracked files list without
+     * rescanning, and changes made while the watcher was stopped follow it
      * call from current changeHandler is undefined behaviour
      * call from a several threads is undefined behaviour (NO THREAD-SAFETY)
      *
      * Parameters:
      *  Callable &&changeHandler    -   calls when directory change event(s) have been registered
-     *      changeHandler signature :
+     *      changeHandler signature is one of :
      *          void(ChangeIterator begin, ChangeIterator end)
-     *              where begin, end = iterators of range [begin, end) of changes
+     *              where begin, end = iterators of range [begin, end) of changes; valid until the handler exit
+     *          void(ChangeBatch &&batch)
+     *              the handler may take ownership of the batch by move
      *
      * Throws:
      *  std::system_error           -   any system error occured
@@ -131,12 +486,64 @@ public:
     template<typename Callable>
     void startWatch(Callable &&changeHandler)
     {
-        handler = std::forward<Callable>(changeHandler);
+        handler = makeHandler(std::forward<Callable>(changeHandler), 0);
         startWatch();
     }
 
     /*
-     * Stops directory monitoring operation. After this operation, calling startWatch again is undefined behaviour
+     * Returns awaitable of the next non-empty batch of changes; alternative to startWatch which doesn't take over
+     * a thread, so a lot of watchers can be served by a few threads
+     * The first batch consists of adds of all files of the directory (it's skipped if the directory is empty)
+     * After stopWatch call the awaiting completes with an empty batch
+     *
+     * Usage:
+     *  with C++20 coroutines   :   ChangeBatch batch = co_await watcher.nextBatch();
+     *  without                 :   auto awaiter = watcher.nextBatch();
+     *                              if (awaiter.await_ready()) { use awaiter.await_resume() }
+     *                              else { awaiter.await_suspend(callback); and use awaiter.await_resume() in callback }
+     *
+     * Continuation of the awaiting is invoked by a thread of the system thread pool
+     * (or passed to the executor if it isn't nullptr). The awaiter must live until the continuation is invoked.
+     * Only one awaiting at a time is allowed; mixing with startWatch is undefined behaviour (NO THREAD-SAFETY)
+     * Destroying the watcher during awaiting is undefined behaviour (call stopWatch and wait for the continuation)
+     *
+     * Throws (from await_ready, await_suspend and await_resume):
+     *  std::system_error           -   any system error occured
+     */
+    BatchAwaiter nextBatch();
+    BatchAwaiter nextBatch(Executor executor);
+
+    /*
+     * Returns handle which becomes signaled when processPending has something to do; alternative to startWatch
+     * for callers with their own event loop (WaitForMultipleObjects, RegisterWaitForSingleObject, etc.)
+     * The handle is signaled until the first processPending call (the first batch consists of adds of all files)
+     * The handle is owned by the watcher and doesn't change during its lifetime
+     */
+    NativeHandle getReadinessHandle();
+
+    /*
+     * Processes pending changes without blocking: calls changeHandler for at most maxEvents changes
+     * (0 means no limit) if there are any. Changes of one batch may be split between several calls
+     * Mixing with startWatch or nextBatch is undefined behaviour (NO THREAD-SAFETY)
+     *
+     * Parameters:
+     *  changeHandler   -   the same as for startWatch
+     *  maxEvents       -   limit of changes passed to changeHandler per call
+     *
+     * Returns:
+     *  true if more changes are pending already; call processPending again without waiting for the handle
+     *  false if the handle should be waited for before the next call (and after stopWatch)
+     *
+     * Throws:
+     *  std::system_error           -   any system error occured
+     */
+    bool processPending(const std::function<void(ChangeIterator, ChangeIterator)> &changeHandler,
+                        std::size_t maxEvents);
+
+    /*
+     * Stops directory monitoring operation (makes startWatch return); the tracked files list is kept,
+     * so startWatch may be called again to resume monitoring. If startWatch isn't running now then the next call
+     * of it returns immediately
      *
      * Throws:
      *  std::system_error           -   any system error occured
@@ -144,13 +551,67 @@ public:
     void stopWatch();
 
     /*
-     * Returns path specified by constructor
+     * Switches the watcher to another directory as if it was constructed with the new path, but reuses
+     * its buffers, system events and memory of the tracked files list
+     * Call only when the watcher isn't running (startWatch has returned, no awaiting of nextBatch, etc.)
+     *
+     * Throws:
+     *  std::system_error           -   the new directory can't be opened; the watcher keeps the old one then
+     */
+    void retarget(const filesystem::Path &path);
+    void retarget(filesystem::Path &&path);
+
+    /*
+     * Returns path specified by constructor (or by the last retarget)
      */
     const filesystem::Path& getPath() const;
 
+    /*
+     * Returns false if the directory at getPath() isn't the watched one anymore: the watched directory has been
+     * renamed or removed (and maybe another one has been created at its path) or the check has failed
+     * Then retarget(getPath()) makes the watcher track the directory which is there now
+     */
+    bool isTrackingPath() const;
+
+    /*
+     * Returns backend which is used now (notifications or polling)
+     * Can be called from any thread
+     */
+    Backend getBackend() const;
+
+    /*
+     * Returns secondary indexes of the tracked files; nullptr if Options::indexFiles is false
+     * The index lives while the watcher lives; it can be queried from any thread
+     */
+    const FileIndex* getFilesIndex() const;
+
+    /*
+     * Returns aggregates of the tracked directory and its subdirectories; nullptr if Options::aggregateDirectories
+     * is false. The aggregates live while the watcher lives; they can be queried from any thread
+     */
+    const DirectoryAggregates* getDirectoryAggregates() const;
+
+    /*
+     * Returns search index of the tracked paths; nullptr if Options::indexPaths is false
+     * The index lives while the watcher lives; it can be queried from any thread
+     */
+    const PathSearchIndex* getPathSearchIndex() const;
+
+    /*
+     * Returns latency percentiles of all change batches delivered so far
+     * Can be called from any thread (lock-free)
+     */
+    LatencyStats getLatencyStats() const;
+
+    /*
+     * Returns current values of runtime counters
+     * Can be called from any thread (lock-free)
+     */
+    WatcherStatistics::Snapshot getStatistics() const;
+
 private:    
     const std::unique_ptr<Impl> pImpl;
-    std::function<void(ChangeIterator, ChangeIterator)> handler;    
+    std::function<void(ChangeBatch&)> handler;
 
 
     DirectoryWatcher(const DirectoryWatcher&) = delete;
@@ -160,6 +621,26 @@ private:
     DirectoryWatcher& operator=(DirectoryWatcher&&) = delete;
 
     void startWatch();
+
+    /* Handlers which accept ChangeBatch are preferred (int is better match for 0 than long) */
+    template<typename Callable>
+    static auto makeHandler(Callable &&changeHandler, int)
+        -> decltype(changeHandler(std::declval<ChangeBatch>()), std::function<void(ChangeBatch&)>())
+    {
+        return [changeHandler = std::forward<Callable>(changeHandler)](ChangeBatch &batch) mutable
+               {
+                   changeHandler(std::move(batch));
+               };
+    }
+
+    template<typename Callable>
+    static std::function<void(ChangeBatch&)> makeHandler(Callable &&changeHandler, long)
+    {
+        return [changeHandler = std::forward<Callable>(changeHandler)](ChangeBatch &batch) mutable
+               {
+                   changeHandler(batch.begin(), batch.end());
+               };
+    }
 };
 
 
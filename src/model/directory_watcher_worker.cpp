@@ -2,6 +2,9 @@
 #include <utility>  // std::move
 
 
+constexpr std::size_t DirectoryWatcherWorker::defaultWarmWatchersCount;
+
+
 class DirectoryWatcherWorker::WorkerRoutine
 {
 public:
@@ -20,20 +23,24 @@ public:
         while (!context.needExit)
         {
             std::exception_ptr exception = nullptr;
+            std::unique_ptr<DirectoryWatcher> watcher;    // destroyed under the lock only
 
             try
             {
                 context.onStart();
 
-                DirectoryWatcher watcher(context.path);
-                context.watcher = &watcher;
+                watcher = context.acquireWatcher();
+                context.watcher = watcher.get();
 
                 lock.unlock();
 
-                using Iter = DirectoryWatcher::ChangeIterator;
-                watcher.startWatch([this](Iter begin, Iter end){ context.onUpdate(begin, end); });
+                using Batch = DirectoryWatcher::ChangeBatch;
+                watcher->startWatch([this](Batch &&batch){ context.onBatch(std::move(batch)); });
 
                 lock.lock();
+
+                context.watcher = nullptr;
+                context.releaseWatcher(std::move(watcher));
             }
             catch (...)
             {
@@ -46,6 +53,7 @@ public:
             }
 
             context.watcher = nullptr;
+            watcher.reset();
 
             context.onStop(exception);
 
@@ -60,12 +68,20 @@ private:
 
 
 
-DirectoryWatcherWorker::DirectoryWatcherWorker()
+DirectoryWatcherWorker::DirectoryWatcherWorker(std::size_t warmWatchersCount)
+    : warmWatchersCount(warmWatchersCount), statistics(std::make_shared<WatcherStatistics>()),
+      selfChanges(std::make_shared<SelfChangeRegistry>())
 {
     workerThread = std::move(std::thread(WorkerRoutine(*this)));
 }
 
 DirectoryWatcherWorker::~DirectoryWatcherWorker()
+{
+    shutdown();
+}
+
+
+void DirectoryWatcherWorker::shutdown()
 {
     {
         std::lock_guard<decltype(mutex)> lock(mutex);
@@ -108,6 +124,18 @@ const filesystem::Path& DirectoryWatcherWorker::getPath() const
 }
 
 
+WatcherStatistics::Snapshot DirectoryWatcherWorker::getStatistics() const
+{
+    return statistics->snapshot();
+}
+
+
+const std::shared_ptr<SelfChangeRegistry>& DirectoryWatcherWorker::getSelfChanges() const
+{
+    return selfChanges;
+}
+
+
 void DirectoryWatcherWorker::stopWithoutLock()
 {
     if (watcher == nullptr)
@@ -117,3 +145,55 @@ void DirectoryWatcherWorker::stopWithoutLock()
 
     watcher->stopWatch();
 }
+
+
+std::unique_ptr<DirectoryWatcher> DirectoryWatcherWorker::acquireWatcher()
+{
+    for (auto iter = warmWatchers.begin(); iter != warmWatchers.end(); ++iter)
+    {
+        if ((*iter)->getPath() == path)
+        {
+            auto result = std::move(*iter);
+            warmWatchers.erase(iter);
+
+            // the directory may have been replaced by another one, then the stale handle mustn't be resumed
+            if (!result->isTrackingPath())
+            {
+                result->retarget(path);
+            }
+
+            return result;
+        }
+    }
+
+    if (!warmWatchers.empty() && (warmWatchers.size() >= warmWatchersCount))
+    {
+        // the watcher is kept warm for its old directory if retargeting fails
+        warmWatchers.back()->retarget(path);
+
+        auto result = std::move(warmWatchers.back());
+        warmWatchers.pop_back();
+
+        return result;
+    }
+
+    DirectoryWatcher::Options options;
+    options.statistics = statistics;
+    options.selfChanges = selfChanges;
+
+    return std::make_unique<DirectoryWatcher>(path, options);
+}
+
+void DirectoryWatcherWorker::releaseWatcher(std::unique_ptr<DirectoryWatcher> &&stopped)
+{
+    if (warmWatchersCount == 0)
+    {
+        return;
+    }
+
+    warmWatchers.push_front(std::move(stopped));
+    while (warmWatchers.size() > warmWatchersCount)
+    {
+        warmWatchers.pop_back();
+    }
+}
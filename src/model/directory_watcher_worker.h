@@ -4,12 +4,21 @@
 #include "path.h"
 #include "file_operations.h"
 #include "directory_watcher.h"
+#include "watcher_statistics.h"
+#include "self_change_registry.h"
 #include <thread>
 #include <mutex>
 #include <condition_variable>
 #include <exception>
+#include <memory>       // std::shared_ptr, std::unique_ptr
+#include <list>         // warmWatchers field
+#include <cstddef>      // std::size_t
 
 /* Abstract class DirectoryWatcherWorker represents a wrapper around DirectoryWatcher with a built-in separate thread for DirectoryWatcher running
+ * Stopped DirectoryWatchers of a few recently tracked directories are kept warm (their files lists are kept
+ * and changes are buffered by the system), so switching back to such a directory doesn't rescan it.
+ * If there are too many warm DirectoryWatchers then the least recently used one is retargeted to the new
+ * directory, so its buffers and memory are reused
  * DirectoryWatcherWorker isn't thread safe; intended for use in parent thread */
 class DirectoryWatcherWorker
 {
@@ -17,10 +26,11 @@ public:
     virtual ~DirectoryWatcherWorker();
 
     /*
-     * Calls stop() and then launch a new DirectoryWatcher in build-in thread
+     * Calls stop() and then launch a DirectoryWatcher in build-in thread
+     * (a warm one if the directory has been tracked recently)
      *
      * Parameters:
-     *  path    -   full path to tracked directory; will be passed to new DirectoryWatcher instance
+     *  path    -   full path to tracked directory
      */
     void run(const filesystem::Path &path);
     void run(filesystem::Path &&path);
@@ -36,8 +46,33 @@ public:
      */
     const filesystem::Path& getPath() const;
 
+    /*
+     * Returns runtime counters of DirectoryWatchers launched by this worker
+     * Event counters are accumulated over all launched DirectoryWatchers
+     * Can be called from any thread (lock-free)
+     */
+    WatcherStatistics::Snapshot getStatistics() const;
+
+    /*
+     * Returns registry of changes made by this process which is shared by DirectoryWatchers launched by this worker
+     * (see DirectoryWatcher::Options::selfChanges); pass it to FileOperationsExecutor to tag its changes
+     */
+    const std::shared_ptr<SelfChangeRegistry>& getSelfChanges() const;
+
 protected:
-    DirectoryWatcherWorker();
+    static constexpr std::size_t defaultWarmWatchersCount = 4;
+
+    /*
+     * Parameters:
+     *  warmWatchersCount   -   maximum count of stopped DirectoryWatchers which are kept warm
+     */
+    explicit DirectoryWatcherWorker(std::size_t warmWatchersCount = defaultWarmWatchersCount);
+
+    /*
+     * Stops the current DirectoryWatcher and finishes the built-in thread; run() mustn't be called after it
+     * Derived classes whose overriders use their own members call it from their destructors
+     */
+    void shutdown();
 
     /* Calls when a new DirectoryWatcher starts tracking directory */
     virtual inline void onStart() {}
@@ -54,11 +89,22 @@ protected:
                                  DirectoryWatcher::ChangeIterator end)
     { (void)begin; (void)end; }
 
+    /*
+     * Calls when directory change event(s) have been registered; overriders may take ownership of the batch
+     * Default implementation calls onUpdate(batch.begin(), batch.end())
+     */
+    virtual inline void onBatch(DirectoryWatcher::ChangeBatch &&batch)
+    { onUpdate(batch.begin(), batch.end()); }
+
 private:
     class WorkerRoutine;
 
     DirectoryWatcher *watcher = nullptr;
     filesystem::Path path;
+    const std::size_t warmWatchersCount;
+    std::list<std::unique_ptr<DirectoryWatcher>> warmWatchers;     // used by the built-in thread only; MRU first
+    const std::shared_ptr<WatcherStatistics> statistics;
+    const std::shared_ptr<SelfChangeRegistry> selfChanges;
     mutable std::mutex mutex;
     std::condition_variable workerSleep;
     std::thread workerThread;
@@ -84,6 +130,12 @@ private:
 
 
     void stopWithoutLock();
+
+    /* Returns a warm DirectoryWatcher of path, the retargeted least recently used one or a new one */
+    std::unique_ptr<DirectoryWatcher> acquireWatcher();
+
+    /* Keeps stopped DirectoryWatcher warm */
+    void releaseWatcher(std::unique_ptr<DirectoryWatcher> &&stopped);
 };
 
 #endif // DIRECTORY_WATCHER_WORKER_H
@@ -0,0 +1,136 @@
+#ifndef EVENT_RECORDING_H
+#define EVENT_RECORDING_H
+
+#include "path.h"
+#include <vector>       // replayed records
+#include <memory>       // std::unique_ptr
+#include <atomic>       // replay position
+#include <chrono>       // std::chrono::steady_clock
+#include <cstdint>      // std::uint64_t, std::uint8_t
+#include <cstddef>      // std::size_t
+
+
+/* Raw change buffers are the ones DirectoryWatcher reads from the system before parsing
+ * (chains of FILE_NOTIFY_INFORMATION on Windows); an empty buffer means the system buffer has overflowed
+ * (a replayed one doesn't make the watcher list the directory, so the changes lost by it stay lost)
+ *
+ * Recording file format (native byte order):
+ *  file header     -   uint32 magic "DWER", uint32 format version
+ *  record          -   uint64 microseconds since the recording start, uint32 size of the buffer, uint32 reserved,
+ *                      then the buffer padded with zeros to a multiple of 8 bytes */
+
+
+/* ChangeEventSource supplies raw change buffers to DirectoryWatcher instead of the system
+ * (see DirectoryWatcher::Options::eventSource); its methods are called by the watching thread only */
+class ChangeEventSource
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    virtual ~ChangeEventSource() = default;
+
+    /* Returns when the next buffer is due; Clock::time_point::max() if there are no more buffers */
+    virtual Clock::time_point getNextTime() const = 0;
+
+    /*
+     * Copies the next buffer into destination if it's due
+     * Returns false if there is no buffer yet; size is set to 0 for an overflow
+     * Parameters:
+     *  destination -   aligned as DWORD
+     *
+     * Throws:
+     *  std::length_error   -   the buffer exceeds capacity
+     */
+    virtual bool read(void *destination, std::size_t capacity, std::size_t &size) = 0;
+};
+
+
+/* ChangeEventRecorder writes raw change buffers of a DirectoryWatcher into a file with their arrival times
+ * (see DirectoryWatcher::Options::eventRecorder); it must not be shared by running watchers */
+class ChangeEventRecorder
+{
+public:
+    /*
+     * Creates the file (an existing one is truncated); times of records are counted from this call
+     *
+     * Throws:
+     *  std::system_error   -   the file can't be created
+     */
+    explicit ChangeEventRecorder(const filesystem::Path &file);
+    ~ChangeEventRecorder();
+
+    /*
+     * Appends the buffer; size == 0 records an overflow
+     *
+     * Throws:
+     *  std::system_error   -   the file can't be written
+     */
+    void record(const void *buffer, std::size_t size);
+
+    std::size_t getRecordsCount() const;
+
+private:
+    class Impl;
+
+    std::unique_ptr<Impl> pImpl;
+
+
+    ChangeEventRecorder(const ChangeEventRecorder&) = delete;
+    ChangeEventRecorder& operator=(const ChangeEventRecorder&) = delete;
+};
+
+
+/* ChangeEventReplayer is ChangeEventSource of a recording made by ChangeEventRecorder
+ * The whole file is loaded by constructor, so replaying doesn't wait for the disk
+ * The first buffer is due immediately; with Pace::original every next one is due after the same interval
+ * as it was recorded, with Pace::unlimited as soon as the previous one is parsed */
+class ChangeEventReplayer : public ChangeEventSource
+{
+public:
+    enum class Pace{ original, unlimited };
+
+
+    /*
+     * Loads the recording
+     *
+     * Throws:
+     *  std::system_error   -   the file can't be read
+     *  std::runtime_error  -   the file isn't a valid recording
+     */
+    ChangeEventReplayer(const filesystem::Path &file, Pace pace);
+
+    Clock::time_point getNextTime() const override;
+    bool read(void *destination, std::size_t capacity, std::size_t &size) override;
+
+    /* Count of records in the recording */
+    std::size_t size() const;
+
+    /*
+     * Returns true if all records have been read
+     * Can be called from any thread
+     */
+    bool isExhausted() const;
+
+private:
+    struct Record
+    {
+        std::uint64_t time;         // microseconds since the recording start
+        std::size_t offset;         // of the buffer in data
+        std::size_t size;
+    };
+
+    std::vector<std::uint8_t> data;
+    std::vector<Record> records;
+    const Pace pace;
+    Clock::time_point start;        // when the first record has been read
+    std::atomic<std::size_t> position;
+
+
+    ChangeEventReplayer(const ChangeEventReplayer&) = delete;
+    ChangeEventReplayer& operator=(const ChangeEventReplayer&) = delete;
+
+    /* Checks that the records of the buffer stay within it */
+    static bool isValidBuffer(const std::uint8_t *buffer, std::size_t size);
+};
+
+#endif // EVENT_RECORDING_H
@@ -0,0 +1,255 @@
+#include "file_index.h"
+#include <utility>      // std::move
+
+
+void FileIndex::set(const filesystem::Path &path, std::uint64_t size, TimePoint modifyDate)
+{
+    std::lock_guard<decltype(mutex)> lock(mutex);
+
+    const auto file = files.find(path);
+    if (file == files.end())
+    {
+        insertWithoutLock(filesystem::Path(path), size, modifyDate);
+        return;
+    }
+
+    auto &entry = file->second;
+    if (entry.size != size)
+    {
+        bySize.erase(entry.bySize);
+        entry.bySize = bySize.emplace(size, &entry);
+        entry.size = size;
+    }
+    if (entry.modifyDate != modifyDate)
+    {
+        byDate.erase(entry.byDate);
+        entry.byDate = byDate.emplace(modifyDate, &entry);
+        entry.modifyDate = modifyDate;
+    }
+}
+
+void FileIndex::erase(const filesystem::Path &path)
+{
+    std::lock_guard<decltype(mutex)> lock(mutex);
+
+    const auto file = files.find(path);
+    if (file != files.end())
+    {
+        eraseWithoutLock(file);
+    }
+}
+
+bool FileIndex::rename(const filesystem::Path &oldPath, const filesystem::Path &newPath)
+{
+    std::lock_guard<decltype(mutex)> lock(mutex);
+
+    const auto file = files.find(oldPath);
+    if (file == files.end())
+    {
+        return false;
+    }
+
+    const auto size = file->second.size;
+    const auto modifyDate = file->second.modifyDate;
+    eraseWithoutLock(file);
+
+    const auto previous = files.find(newPath);     // the rename replaces an existing file
+    if (previous != files.end())
+    {
+        eraseWithoutLock(previous);
+    }
+
+    insertWithoutLock(filesystem::Path(newPath), size, modifyDate);
+    return true;
+}
+
+void FileIndex::clear()
+{
+    std::lock_guard<decltype(mutex)> lock(mutex);
+
+    bySize.clear();
+    byDate.clear();
+    byExtension.clear();
+    files.clear();
+}
+
+
+bool FileIndex::getAttributes(const filesystem::Path &path, std::uint64_t &size, TimePoint &modifyDate) const
+{
+    std::lock_guard<decltype(mutex)> lock(mutex);
+
+    const auto file = files.find(path);
+    if (file == files.end())
+    {
+        return false;
+    }
+
+    size = file->second.size;
+    modifyDate = file->second.modifyDate;
+    return true;
+}
+
+
+std::size_t FileIndex::size() const
+{
+    std::lock_guard<decltype(mutex)> lock(mutex);
+    return files.size();
+}
+
+std::size_t FileIndex::getMemoryUsage() const
+{
+    // nodes of the maps hold the values and about three pointers each
+    constexpr std::size_t treeNodeOverhead = 4 * sizeof(void*);
+    constexpr std::size_t hashNodeOverhead = 2 * sizeof(void*);
+
+    std::lock_guard<decltype(mutex)> lock(mutex);
+
+    std::size_t result = files.bucket_count() * sizeof(void*) +
+                         files.size() * (sizeof(Files::value_type) + hashNodeOverhead) +
+                         bySize.size() * (sizeof(SizeIndex::value_type) + treeNodeOverhead) +
+                         byDate.size() * (sizeof(DateIndex::value_type) + treeNodeOverhead) +
+                         byExtension.bucket_count() * sizeof(void*);
+
+    for (const auto &extension : byExtension)
+    {
+        result += sizeof(ExtensionIndex::value_type) + hashNodeOverhead +
+                  extension.second.bucket_count() * sizeof(void*) +
+                  extension.second.size() * (sizeof(const Entry*) + hashNodeOverhead);
+    }
+
+    return result;
+}
+
+
+std::vector<FileIndex::FileInfo> FileIndex::getLargest(std::size_t count) const
+{
+    std::lock_guard<decltype(mutex)> lock(mutex);
+    return (count == 0) ? std::vector<FileInfo>() : collect(bySize.crbegin(), bySize.crend(), count);
+}
+
+std::vector<FileIndex::FileInfo> FileIndex::getBySize(std::uint64_t minSize, std::uint64_t maxSize,
+                                                      std::size_t limit) const
+{
+    std::lock_guard<decltype(mutex)> lock(mutex);
+
+    if (minSize > maxSize)
+    {
+        return {};
+    }
+
+    return collect(bySize.lower_bound(minSize), bySize.upper_bound(maxSize), limit);
+}
+
+std::vector<FileIndex::FileInfo> FileIndex::getRecentlyModified(std::size_t count) const
+{
+    std::lock_guard<decltype(mutex)> lock(mutex);
+    return (count == 0) ? std::vector<FileInfo>() : collect(byDate.crbegin(), byDate.crend(), count);
+}
+
+std::vector<FileIndex::FileInfo> FileIndex::getByModifyDate(TimePoint from, TimePoint to, std::size_t limit) const
+{
+    std::lock_guard<decltype(mutex)> lock(mutex);
+
+    if (from > to)
+    {
+        return {};
+    }
+
+    return collect(byDate.lower_bound(from), byDate.upper_bound(to), limit);
+}
+
+std::vector<FileIndex::FileInfo> FileIndex::getByExtension(const filesystem::Path::string_type &extension,
+                                                           std::size_t limit) const
+{
+    std::lock_guard<decltype(mutex)> lock(mutex);
+
+    std::vector<FileInfo> result;
+
+    const auto files = byExtension.find(extension);
+    if (files != byExtension.cend())
+    {
+        for (const auto *entry : files->second)
+        {
+            if ((limit != 0) && (result.size() == limit))
+            {
+                break;
+            }
+
+            result.push_back(makeInfo(*entry));
+        }
+    }
+
+    return result;
+}
+
+
+filesystem::Path::string_type FileIndex::getExtension(const filesystem::Path &path)
+{
+    using CharType = filesystem::Path::char_type;
+    static const CharType delimiters[] = { CharType('\\'), CharType('/'), CharType(0) };
+
+    const auto &string = path.getPathString();
+    const auto delimiter = string.find_last_of(delimiters);
+    const auto nameBegin = (delimiter == string.npos) ? 0 : delimiter + 1;
+
+    // the leading dot starts a hidden file name (".gitignore") rather than an extension
+    const auto dot = string.find_last_of(CharType('.'));
+    if ((dot == string.npos) || (dot <= nameBegin))
+    {
+        return {};
+    }
+
+    return string.substr(dot + 1);
+}
+
+
+void FileIndex::eraseWithoutLock(Files::iterator file)
+{
+    const auto extension = byExtension.find(getExtension(file->first));
+    if (extension != byExtension.end())
+    {
+        extension->second.erase(&file->second);
+        if (extension->second.empty())
+        {
+            byExtension.erase(extension);
+        }
+    }
+
+    bySize.erase(file->second.bySize);
+    byDate.erase(file->second.byDate);
+    files.erase(file);
+}
+
+void FileIndex::insertWithoutLock(filesystem::Path &&path, std::uint64_t size, TimePoint modifyDate)
+{
+    const auto file = files.emplace(std::move(path), Entry{nullptr, size, modifyDate, bySize.end(), byDate.end()}).first;
+    auto &entry = file->second;
+    entry.path = &file->first;
+
+    try
+    {
+        entry.bySize = bySize.emplace(size, &entry);
+        entry.byDate = byDate.emplace(modifyDate, &entry);
+        byExtension[getExtension(file->first)].insert(&entry);
+    }
+    catch (...)
+    {
+        if (entry.bySize != bySize.end())
+        {
+            bySize.erase(entry.bySize);
+        }
+        if (entry.byDate != byDate.end())
+        {
+            byDate.erase(entry.byDate);
+        }
+        files.erase(file);
+
+        throw;
+    }
+}
+
+
+FileIndex::FileInfo FileIndex::makeInfo(const Entry &entry)
+{
+    return {*entry.path, entry.size, entry.modifyDate};
+}
@@ -0,0 +1,129 @@
+#ifndef FILE_INDEX_H
+#define FILE_INDEX_H
+
+#include "path.h"
+#include <unordered_map>    // files and extensions indexes
+#include <unordered_set>    // files of an extension
+#include <map>              // size and modify date indexes
+#include <vector>           // query results
+#include <mutex>
+#include <chrono>           // std::chrono::system_clock
+#include <cstdint>          // std::uint64_t
+#include <cstddef>          // std::size_t
+
+
+/* FileIndex keeps secondary indexes of tracked files: ordered by size, ordered by modify date
+ * and hashed by extension. It's updated incrementally by DirectoryWatcher from change batches
+ * (see DirectoryWatcher::Options::indexFiles), so queries don't touch the disk
+ *
+ * Ordered queries cost O(log n + k) where k is count of returned files; queries by extension cost O(k)
+ * Queries and updates are thread safe */
+class FileIndex
+{
+public:
+    using TimePoint = std::chrono::system_clock::time_point;
+
+    struct FileInfo
+    {
+        filesystem::Path path;      // relative to tracked directory
+        std::uint64_t size;
+        TimePoint modifyDate;
+    };
+
+
+    FileIndex() = default;
+
+    /* Adds the file or updates its attributes */
+    void set(const filesystem::Path &path, std::uint64_t size, TimePoint modifyDate);
+
+    /* Does nothing if the file isn't indexed */
+    void erase(const filesystem::Path &path);
+
+    /* Keeps attributes of the file; does nothing and returns false if the file isn't indexed */
+    bool rename(const filesystem::Path &oldPath, const filesystem::Path &newPath);
+
+    void clear();
+
+    /* Returns false if the file isn't indexed */
+    bool getAttributes(const filesystem::Path &path, std::uint64_t &size, TimePoint &modifyDate) const;
+
+    std::size_t size() const;
+
+    /* Returns approximate count of bytes allocated by the indexes (paths strings aren't included) */
+    std::size_t getMemoryUsage() const;
+
+
+    /*
+     * Queries; limit == 0 means no limit
+     */
+
+    /* Returns at most count largest files in descending order of size */
+    std::vector<FileInfo> getLargest(std::size_t count) const;
+
+    /* Returns files with minSize <= size <= maxSize in ascending order of size */
+    std::vector<FileInfo> getBySize(std::uint64_t minSize, std::uint64_t maxSize, std::size_t limit) const;
+
+    /* Returns at most count recently modified files in descending order of modify date */
+    std::vector<FileInfo> getRecentlyModified(std::size_t count) const;
+
+    /* Returns files with from <= modify date <= to in ascending order of modify date */
+    std::vector<FileInfo> getByModifyDate(TimePoint from, TimePoint to, std::size_t limit) const;
+
+    /*
+     * Returns files with the extension in unspecified order
+     * Parameters:
+     *  extension   -   without the leading dot; empty one means files without extension
+     *                  (characters case is respected according to CASE_SENSITIVE_PATHS)
+     */
+    std::vector<FileInfo> getByExtension(const filesystem::Path::string_type &extension, std::size_t limit) const;
+
+private:
+    struct Entry;
+
+    using SizeIndex = std::multimap<std::uint64_t, const Entry*>;
+    using DateIndex = std::multimap<TimePoint, const Entry*>;
+
+    struct Entry
+    {
+        const filesystem::Path *path;   // the key of this entry in files
+        std::uint64_t size;
+        TimePoint modifyDate;
+        SizeIndex::iterator bySize;
+        DateIndex::iterator byDate;
+    };
+
+    using Files = std::unordered_map<filesystem::Path, Entry>;
+    using ExtensionIndex = std::unordered_map<filesystem::Path::string_type, std::unordered_set<const Entry*>>;
+
+    // indexes refer to the elements of files, which don't move while they are in the map
+    Files files;
+    SizeIndex bySize;
+    DateIndex byDate;
+    ExtensionIndex byExtension;
+    mutable std::mutex mutex;
+
+
+    FileIndex(const FileIndex&) = delete;
+    FileIndex& operator=(const FileIndex&) = delete;
+
+    static filesystem::Path::string_type getExtension(const filesystem::Path &path);
+
+    void eraseWithoutLock(Files::iterator file);
+    void insertWithoutLock(filesystem::Path &&path, std::uint64_t size, TimePoint modifyDate);
+
+    static FileInfo makeInfo(const Entry &entry);
+
+    template<typename Iterator>
+    std::vector<FileInfo> collect(Iterator begin, Iterator end, std::size_t limit) const
+    {
+        std::vector<FileInfo> result;
+        for (; (begin != end) && ((limit == 0) || (result.size() < limit)); ++begin)
+        {
+            result.push_back(makeInfo(*begin->second));
+        }
+
+        return result;
+    }
+};
+
+#endif // FILE_INDEX_H
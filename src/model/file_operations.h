@@ -49,7 +49,43 @@ namespace filesystem
      */
     std::chrono::system_clock::time_point getModifyDate(const Path &path);
 
+    /*
+     * Returns 64-bit fingerprint (non-cryptographic hash) of file contents
+     * Contents are read through a memory mapping. Files larger than 4 MB are fingerprinted by sampled chunks
+     * (the first and the last megabytes and 64 KB chunks evenly spaced between them), so changes outside
+     * of the sampled chunks are noticed only if they change the file size
+     *
+     * Parameters
+     *  path    -   full path to file
+     *
+     * Throws:
+     *  std::system_error   -   any system error occured (for example, the file does not exists or it's a directory)
+     */
+    std::uint64_t getContentFingerprint(const Path &path);
+
     void rename(const Path &oldPath, const Path &newPath);
+
+    /*
+     * Moves file or directory; unlike rename it copies files between volumes (and removes the sources)
+     *
+     * Parameters
+     *  oldPath, newPath    -   full paths; the new path mustn't exist
+     *
+     * Throws:
+     *  std::system_error   -   any system error occured
+     */
+    void move(const Path &oldPath, const Path &newPath);
+
+    /*
+     * Removes file or empty directory
+     *
+     * Parameters
+     *  path    -   full path to file
+     *
+     * Throws:
+     *  std::system_error   -   any system error occured (for example, the directory isn't empty)
+     */
+    void remove(const Path &path);
 }
 
 #endif // FILE_OPERATIONS_H
@@ -0,0 +1,151 @@
+#include "file_operations_executor.h"
+#include "file_operations.h"
+#include <mutex>
+#include <algorithm>    // std::min, std::sort
+#include <iterator>     // std::make_move_iterator
+#include <utility>      // std::move
+
+
+constexpr std::size_t FileOperationsExecutor::chunkSize;
+
+
+struct FileOperationsExecutor::Batch
+{
+    std::vector<Operation> operations;
+    Completion onCompletion;
+    std::promise<Result> promise;
+
+    std::mutex mutex;
+    Result result;
+    std::size_t pendingChunks = 0;
+};
+
+
+FileOperationsExecutor::FileOperationsExecutor(std::size_t threadsCount,
+                                               std::shared_ptr<SelfChangeRegistry> selfChanges)
+    : selfChanges(std::move(selfChanges)), pool(threadsCount)
+{
+}
+
+
+std::future<FileOperationsExecutor::Result> FileOperationsExecutor::submit(std::vector<Operation> operations,
+                                                                           Completion onCompletion)
+{
+    const auto batch = std::make_shared<Batch>();
+    batch->operations = std::move(operations);
+    batch->onCompletion = std::move(onCompletion);
+    auto result = batch->promise.get_future();
+
+    const std::size_t size = batch->operations.size();
+    if (size == 0)
+    {
+        complete(*batch);
+        return result;
+    }
+
+    batch->pendingChunks = (size + chunkSize - 1) / chunkSize;
+    for (std::size_t begin = 0; begin < size; begin += chunkSize)
+    {
+        const std::size_t end = std::min(begin + chunkSize, size);
+        pool.submit([this, batch, begin, end]{ executeChunk(*batch, begin, end); });
+    }
+
+    return result;
+}
+
+
+void FileOperationsExecutor::executeChunk(Batch &batch, std::size_t begin, std::size_t end)
+{
+    Result chunkResult;
+    for (std::size_t i = begin; i < end; ++i)
+    {
+        try
+        {
+            execute(batch.operations[i]);
+            ++chunkResult.succeeded;
+        }
+        catch (...)
+        {
+            chunkResult.failures.push_back({i, std::current_exception()});
+        }
+    }
+
+    {
+        std::lock_guard<decltype(batch.mutex)> lock(batch.mutex);
+
+        batch.result.succeeded += chunkResult.succeeded;
+        batch.result.failures.insert(batch.result.failures.end(),
+                                     std::make_move_iterator(chunkResult.failures.begin()),
+                                     std::make_move_iterator(chunkResult.failures.end()));
+        if (--batch.pendingChunks != 0)
+        {
+            return;
+        }
+    }
+
+    std::sort(batch.result.failures.begin(), batch.result.failures.end(),
+              [](const Failure &left, const Failure &right){ return left.index < right.index; });
+    complete(batch);
+}
+
+
+void FileOperationsExecutor::execute(const Operation &operation)
+{
+    const bool hasTarget = (operation.type != OperationType::remove);
+
+    if (selfChanges)
+    {
+        selfChanges->add(operation.path);
+        if (hasTarget)
+        {
+            selfChanges->add(operation.newPath);
+        }
+    }
+
+    try
+    {
+        switch (operation.type)
+        {
+            case OperationType::rename:
+                filesystem::rename(operation.path, operation.newPath);
+                break;
+            case OperationType::remove:
+                filesystem::remove(operation.path);
+                break;
+            case OperationType::move:
+                filesystem::move(operation.path, operation.newPath);
+                break;
+        }
+    }
+    catch (...)
+    {
+        if (selfChanges)
+        {
+            selfChanges->cancel(operation.path);
+            if (hasTarget)
+            {
+                selfChanges->cancel(operation.newPath);
+            }
+        }
+        throw;
+    }
+}
+
+
+void FileOperationsExecutor::complete(Batch &batch)
+{
+    try
+    {
+        if (batch.onCompletion)
+        {
+            batch.onCompletion(batch.result);
+        }
+    }
+    catch (...)
+    {
+        batch.promise.set_exception(std::current_exception());
+        return;
+    }
+
+    batch.promise.set_value(std::move(batch.result));
+}
@@ -0,0 +1,95 @@
+#ifndef FILE_OPERATIONS_EXECUTOR_H
+#define FILE_OPERATIONS_EXECUTOR_H
+
+#include "path.h"
+#include "thread_pool.h"
+#include "self_change_registry.h"
+#include <vector>       // batches of operations
+#include <future>       // std::future, std::promise
+#include <functional>   // std::function
+#include <memory>       // std::shared_ptr
+#include <exception>    // std::exception_ptr
+#include <cstddef>      // std::size_t
+
+
+/* FileOperationsExecutor executes batches of file operations (see file_operations.h) in background threads,
+ * so callers (e.g. GUI thread) aren't blocked by the file system
+ * A batch is split into chunks of chunkSize operations which are executed by the threads concurrently,
+ * so operations of a batch must be independent (e.g. renames a -> b and b -> c must be submitted
+ * as separate batches, the second one after completion of the first one)
+ * With a single thread all operations are executed in submission order
+ * Failed operations don't interrupt the batch: their errors are collected into the batch result
+ * Paths of every operation are registered in the SelfChangeRegistry (if any) before the operation is made,
+ * so DirectoryWatchers sharing the registry tag the resulting changes as self-originated
+ * Destructor executes all already submitted batches
+ * submit is thread safe */
+class FileOperationsExecutor
+{
+public:
+    enum class OperationType{ rename, remove, move };
+
+    struct Operation
+    {
+        OperationType type;
+        filesystem::Path path;          // full path of the source file
+        filesystem::Path newPath;       // full path of the target (for rename and move only)
+    };
+
+    struct Failure
+    {
+        std::size_t index;              // of the operation in the batch
+        std::exception_ptr error;       // std::system_error usually
+    };
+
+    struct Result
+    {
+        std::size_t succeeded = 0;
+        std::vector<Failure> failures;  // sorted by index
+    };
+
+    /* Called by one of the threads when the whole batch is executed */
+    using Completion = std::function<void(const Result&)>;
+
+    static constexpr std::size_t chunkSize = 64;
+
+
+    /*
+     * Parameters:
+     *  threadsCount    -   count of threads; 0 means count of hardware threads
+     *  selfChanges     -   registry of changes made by this process; may be nullptr
+     */
+    explicit FileOperationsExecutor(std::size_t threadsCount,
+                                    std::shared_ptr<SelfChangeRegistry> selfChanges = nullptr);
+
+    /*
+     * Schedules execution of the batch
+     * Returns future of the batch result; an exception thrown by onCompletion is stored into it instead
+     *
+     * Parameters:
+     *  onCompletion    -   may be empty; for an empty batch it's called by the calling thread
+     */
+    std::future<Result> submit(std::vector<Operation> operations, Completion onCompletion = nullptr);
+
+private:
+    struct Batch;
+
+    const std::shared_ptr<SelfChangeRegistry> selfChanges;
+    ThreadPool pool;        // is destroyed first, so running operations use the registry safely
+
+
+    FileOperationsExecutor(const FileOperationsExecutor&) = delete;
+    FileOperationsExecutor& operator=(const FileOperationsExecutor&) = delete;
+
+    /* Executes operations [begin, end) of the batch; the last finished chunk completes the batch */
+    void executeChunk(Batch &batch, std::size_t begin, std::size_t end);
+
+    /*
+     * Throws:
+     *  std::system_error   -   any system error occured
+     */
+    void execute(const Operation &operation);
+
+    static void complete(Batch &batch);
+};
+
+#endif // FILE_OPERATIONS_EXECUTOR_H
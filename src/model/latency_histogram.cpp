@@ -0,0 +1,129 @@
+#include "latency_histogram.h"
+#include <algorithm>    // std::min
+
+
+namespace
+{
+    unsigned getMostSignificantBit(std::uint64_t value)
+    {
+        unsigned result = 0;
+        for (unsigned shift = 32; shift > 0; shift /= 2)
+        {
+            if ((value >> shift) != 0)
+            {
+                value >>= shift;
+                result += shift;
+            }
+        }
+
+        return result;
+    }
+
+    /* Returns 1-based rank of the value which is the perMille/1000 quantile of count values */
+    std::uint64_t getRank(std::uint64_t count, std::uint64_t perMille)
+    {
+        const std::uint64_t rank = (count * perMille + 999) / 1000;
+        return (rank == 0) ? 1 : rank;
+    }
+}
+
+
+constexpr unsigned LatencyHistogram::subBucketBits;
+constexpr std::uint64_t LatencyHistogram::subBucketCount;
+constexpr std::size_t LatencyHistogram::bucketCount;
+
+
+LatencyHistogram::LatencyHistogram()
+{
+    reset();
+}
+
+
+void LatencyHistogram::record(Duration duration)
+{
+    const std::uint64_t value = (duration.count() < 0) ? 0 : static_cast<std::uint64_t>(duration.count());
+
+    buckets[getBucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+
+    std::uint64_t currentMax = maxValue.load(std::memory_order_relaxed);
+    while ((value > currentMax)
+           && !maxValue.compare_exchange_weak(currentMax, value, std::memory_order_relaxed))
+    {
+    }
+}
+
+
+LatencyHistogram::Summary LatencyHistogram::summarize() const
+{
+    Summary result{0, Duration::zero(), Duration::zero(), Duration::zero(), Duration::zero()};
+
+    const std::uint64_t total = count.load(std::memory_order_relaxed);
+    if (total == 0)
+    {
+        return result;
+    }
+
+    const std::uint64_t max = maxValue.load(std::memory_order_relaxed);
+    const std::uint64_t ranks[3]{ getRank(total, 500), getRank(total, 990), getRank(total, 999) };
+    Duration * const targets[3]{ &result.p50, &result.p99, &result.p999 };
+
+    std::uint64_t accumulated = 0;
+    std::size_t target = 0;
+    for (std::size_t i = 0; (i < bucketCount) && (target < 3); ++i)
+    {
+        accumulated += buckets[i].load(std::memory_order_relaxed);
+        for (; (target < 3) && (accumulated >= ranks[target]); ++target)
+        {
+            *targets[target] = Duration(static_cast<Duration::rep>(std::min(getBucketUpperBound(i), max)));
+        }
+    }
+
+    // buckets may lag behind count if values are being recorded concurrently
+    for (; target < 3; ++target)
+    {
+        *targets[target] = Duration(static_cast<Duration::rep>(max));
+    }
+
+    result.count = total;
+    result.max = Duration(static_cast<Duration::rep>(max));
+
+    return result;
+}
+
+
+void LatencyHistogram::reset()
+{
+    for (auto &bucket : buckets)
+    {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+
+    count.store(0, std::memory_order_relaxed);
+    maxValue.store(0, std::memory_order_relaxed);
+}
+
+
+std::size_t LatencyHistogram::getBucketIndex(std::uint64_t value)
+{
+    if (value < 2 * subBucketCount)
+    {
+        return static_cast<std::size_t>(value);
+    }
+
+    const unsigned shift = getMostSignificantBit(value) - subBucketBits;
+    return static_cast<std::size_t>(shift * subBucketCount + (value >> shift));
+}
+
+std::uint64_t LatencyHistogram::getBucketUpperBound(std::size_t index)
+{
+    if (index < 2 * subBucketCount)
+    {
+        return index;
+    }
+
+    const unsigned shift = static_cast<unsigned>(index / subBucketCount - 1);
+    const std::uint64_t lowerBound = (index % subBucketCount + subBucketCount) << shift;
+
+    return lowerBound + ((std::uint64_t(1) << shift) - 1);
+}
@@ -0,0 +1,62 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <atomic>       // std::atomic
+#include <array>        // buckets field
+#include <chrono>       // std::chrono::nanoseconds
+#include <cstdint>      // std::uint64_t
+#include <cstddef>      // std::size_t
+
+
+/* Lock-free HDR-style (log-linear) latency histogram
+ * Every power of two is split into 32 linear sub-buckets, so any recorded value is reported
+ * with relative error below ~3%. Values below 64 ns are stored exactly
+ * record and summarize are thread-safe and never block each other; summarize is not an atomic
+ * snapshot (values recorded concurrently may be partially included) */
+class LatencyHistogram
+{
+public:
+    using Duration = std::chrono::nanoseconds;
+
+    /* Percentiles of recorded durations; all durations are Duration::zero() if count == 0 */
+    struct Summary
+    {
+        std::uint64_t count;
+        Duration p50;
+        Duration p99;
+        Duration p999;
+        Duration max;
+    };
+
+
+    LatencyHistogram();
+
+    /* Adds a single duration into the histogram; negative durations are counted as zero */
+    void record(Duration duration);
+
+    /* Returns percentiles of all durations recorded so far */
+    Summary summarize() const;
+
+    /* Drops all recorded durations */
+    void reset();
+
+private:
+    static constexpr unsigned subBucketBits = 5;
+    static constexpr std::uint64_t subBucketCount = std::uint64_t(1) << subBucketBits;
+    static constexpr std::size_t bucketCount = (64 - subBucketBits + 1) * subBucketCount;
+
+    std::array<std::atomic<std::uint64_t>, bucketCount> buckets;
+    std::atomic<std::uint64_t> count;
+    std::atomic<std::uint64_t> maxValue;
+
+
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+    static std::size_t getBucketIndex(std::uint64_t value);
+
+    /* Returns the largest value which falls into bucket with specified index */
+    static std::uint64_t getBucketUpperBound(std::size_t index);
+};
+
+#endif // LATENCY_HISTOGRAM_H
@@ -5,6 +5,19 @@
 #include <functional>   //std::hash
 #include <cstddef>      //std::size_t
 
+
+/* CASE_SENSITIVE_PATHS selects paths comparison policy (may be overridden at build time):
+ *  0   -   case-insensitive comparison and hashing (see CICharTraits); default on Windows
+ *  1   -   plain std::char_traits comparison and raw-bytes hashing; default on other systems */
+#ifndef CASE_SENSITIVE_PATHS
+    #ifdef _WIN32
+        #define CASE_SENSITIVE_PATHS 0
+    #else
+        #define CASE_SENSITIVE_PATHS 1
+    #endif
+#endif
+
+
 namespace filesystem
 {
     namespace
@@ -55,14 +68,26 @@ namespace filesystem
         static int_type eof();
 
         static int_type not_eof( int_type e ) noexcept;
+
+        /* Returns the character which is used instead of c in case-insensitive comparisons */
+        static char_type toLower(const char_type &c);
     };
 
-    /* Class representing filesystem path */
+#if CASE_SENSITIVE_PATHS
+    using PathCharTraits = std::char_traits<CharType>;
+#else
+    using PathCharTraits = CICharTraits;
+#endif
+
+
+    /* Class representing filesystem path
+     * Hash of the path string is computed on first demand and cached until the path is modified
+     * (so concurrent calls of getHash for the same object before the first one completes are unsafe) */
     class Path
     {
     public:
         using char_type = CharType;
-        using string_type = std::basic_string<char_type, CICharTraits>;
+        using string_type = std::basic_string<char_type, PathCharTraits>;
 
         Path();
         Path(const string_type &pathString);
@@ -75,9 +100,18 @@ namespace filesystem
         {
         }        
 
+        Path(const Path &src) = default;
+        Path(Path &&src) noexcept;
+
+        Path& operator=(const Path &right) = default;
+        Path& operator=(Path &&right) noexcept;
+
 
         const string_type& getPathString() const;        
 
+        /* Returns std::hash of the path string (cached) */
+        std::size_t getHash() const;
+
         Path getRelativePath() const;
 
         /* Returns all after the last dir-delimiter */
@@ -87,7 +121,34 @@ namespace filesystem
         Path& operator/=(const Path &right);
 
     private:
+        friend bool operator==(const Path &left, const Path &right);
+
         string_type path;
+        mutable std::size_t hash = 0;
+        mutable bool hashCached = false;
+    };
+
+
+    /* Non-owning view of a path string (not null-terminated necessarily)
+     * It's valid while the viewed characters live; converts to Path by copying */
+    class PathView
+    {
+    public:
+        using char_type = Path::char_type;
+
+        PathView();
+        PathView(const char_type *pathData, std::size_t length);
+        PathView(const Path &path);
+
+        const char_type* data() const;
+        std::size_t size() const;
+        bool empty() const;
+
+        operator Path() const;
+
+    private:
+        const char_type *pathData;
+        std::size_t length;
     };
 
 
@@ -100,11 +161,13 @@ namespace filesystem
     Path operator/(const Path &left, const Path &right);
 
 
+#if !CASE_SENSITIVE_PATHS
     template<typename OStream>
     OStream& operator<<(OStream &stream, const Path::string_type &string)
     {
         return stream << string.c_str();
     }
+#endif
 
     template<typename OStream>
     OStream& operator<<(OStream &stream, const Path &path)
@@ -116,13 +179,16 @@ namespace filesystem
 
 namespace std
 {
-    /* std::hash specializations for Path and Path::string_type */
+    /* std::hash specializations for Path and Path::string_type
+     * (for case-sensitive paths the standard hash of Path::string_type is used) */
 
+#if !CASE_SENSITIVE_PATHS
     template<>
     struct hash<filesystem::Path::string_type>
     {
         std::size_t operator()(const filesystem::Path::string_type &src) const;
     };
+#endif
 
     template<>
     struct hash<filesystem::Path>
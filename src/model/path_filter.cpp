@@ -0,0 +1,396 @@
+#include "path_filter.h"
+#include <algorithm>        // std::copy
+#include <utility>          // std::move
+#include <initializer_list> // lists of masks and patterns
+#include <type_traits>      // std::make_unsigned
+
+
+namespace
+{
+    using CharType = PathFilter::char_type;
+    using UnsignedChar = std::make_unsigned<CharType>::type;
+
+    constexpr std::size_t stackMaskWords = 8;
+
+
+    inline UnsignedChar toUnsigned(CharType c)
+    {
+        return static_cast<UnsignedChar>(c);
+    }
+
+    inline bool isDelimiter(CharType c)
+    {
+        return (c == CharType('/')) || (c == CharType('\\'));
+    }
+
+    /* Returns the character which is used for matching instead of c */
+    inline CharType fold(CharType c)
+    {
+#if CASE_SENSITIVE_PATHS
+        return c;
+#else
+        if (toUnsigned(c) < 0x80)
+        {
+            return ((c >= CharType('A')) && (c <= CharType('Z'))) ? CharType(c + ('a' - 'A')) : c;
+        }
+
+        return filesystem::CICharTraits::toLower(c);
+#endif
+    }
+
+    inline void setBit(std::uint64_t *mask, std::size_t bit)
+    {
+        mask[bit / 64] |= std::uint64_t(1) << (bit % 64);
+    }
+
+    inline bool intersects(const std::uint64_t *left, const std::uint64_t *right, std::size_t words)
+    {
+        for (std::size_t i = 0; i < words; ++i)
+        {
+            if ((left[i] & right[i]) != 0)
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+}
+
+
+struct PathFilter::Token
+{
+    enum class Kind{ literal, anyChar, charClass };
+
+    Kind kind;
+    CharType literal;
+    CharClass charClass;
+    bool followedByStar;
+};
+
+struct PathFilter::Pattern
+{
+    bool leadingStar = false;
+    bool directoryOnly = false;
+    std::vector<Token> tokens;
+};
+
+
+constexpr std::size_t PathFilter::asciiCount;
+
+
+bool PathFilter::CharClass::contains(char_type c, char_type alternative) const
+{
+    bool result = false;
+    for (const auto &range : ranges)
+    {
+        if (((toUnsigned(range.first) <= toUnsigned(c)) && (toUnsigned(c) <= toUnsigned(range.second)))
+            || ((toUnsigned(range.first) <= toUnsigned(alternative)) && (toUnsigned(alternative) <= toUnsigned(range.second))))
+        {
+            result = true;
+            break;
+        }
+    }
+
+    return result != negated;
+}
+
+
+PathFilter::PathFilter() = default;
+
+PathFilter::PathFilter(const std::vector<string_type> &includePatterns, const std::vector<string_type> &excludePatterns)
+{
+    std::vector<std::pair<Pattern, bool>> patterns;     // pattern, isInclude
+    std::size_t statesCount = 0;
+
+    for (const auto *list : { &includePatterns, &excludePatterns })
+    {
+        for (const auto &pattern : *list)
+        {
+            patterns.emplace_back(parse(pattern), list == &includePatterns);
+            statesCount += patterns.back().first.tokens.size() + 1;
+        }
+    }
+
+    hasIncludePatterns = !includePatterns.empty();
+    words = (statesCount + 63) / 64;
+
+    asciiMasks.assign(asciiCount * words, 0);
+    for (auto *mask : { &anyCharMask, &startMask, &loopMask,
+                        &includeAccept, &includeDirectoryAccept, &excludeAccept, &excludeDirectoryAccept })
+    {
+        mask->assign(words, 0);
+    }
+
+    // state (start + i) means "first i tokens of the pattern are matched"
+    std::size_t start = 0;
+    for (const auto &entry : patterns)
+    {
+        const Pattern &pattern = entry.first;
+        const std::size_t accept = start + pattern.tokens.size();
+
+        setBit(startMask.data(), start);
+        if (pattern.leadingStar)
+        {
+            setBit(loopMask.data(), start);
+        }
+
+        for (std::size_t i = 0; i < pattern.tokens.size(); ++i)
+        {
+            addTransitions(start + i + 1, pattern.tokens[i]);
+            if (pattern.tokens[i].followedByStar)
+            {
+                setBit(loopMask.data(), start + i + 1);
+            }
+        }
+
+        Mask &acceptMask = entry.second ? (pattern.directoryOnly ? includeDirectoryAccept : includeAccept)
+                                        : (pattern.directoryOnly ? excludeDirectoryAccept : excludeAccept);
+        setBit(acceptMask.data(), accept);
+
+        start = accept + 1;
+    }
+}
+
+
+bool PathFilter::isEmpty() const
+{
+    return words == 0;
+}
+
+PathFilter::Decision PathFilter::check(const char_type *name, std::size_t length) const
+{
+    const Matches matches = match(name, length);
+
+    const bool asFile = decide(matches, false);
+    if (asFile == decide(matches, true))
+    {
+        return asFile ? Decision::accepted : Decision::rejected;
+    }
+
+    return asFile ? Decision::acceptedIfNotDirectory : Decision::acceptedIfDirectory;
+}
+
+bool PathFilter::isAccepted(const char_type *name, std::size_t length, bool isDirectory) const
+{
+    return decide(match(name, length), isDirectory);
+}
+
+
+PathFilter::Pattern PathFilter::parse(const string_type &source)
+{
+    Pattern result;
+
+    std::size_t end = source.length();
+    for (; (end > 0) && isDelimiter(source[end - 1]); --end)
+    {
+        result.directoryOnly = true;
+    }
+
+    for (std::size_t i = 0; i < end; ++i)
+    {
+        const CharType c = source[i];
+
+        if (c == CharType('*'))
+        {
+            if (result.tokens.empty())
+            {
+                result.leadingStar = true;
+            }
+            else
+            {
+                result.tokens.back().followedByStar = true;
+            }
+
+            continue;
+        }
+
+        Token token{Token::Kind::literal, fold(c), CharClass{false, {}}, false};
+
+        if (c == CharType('?'))
+        {
+            token.kind = Token::Kind::anyChar;
+        }
+        else if (c == CharType('['))
+        {
+            // "[!" and "[]" / "[!]" forms: the first character after them is a member of the set
+            std::size_t j = i + 1;
+            CharClass charClass{false, {}};
+
+            if ((j < end) && (source[j] == CharType('!')))
+            {
+                charClass.negated = true;
+                ++j;
+            }
+
+            const std::size_t first = j;
+            for (; (j < end) && ((j == first) || (source[j] != CharType(']'))); ++j)
+            {
+                if ((j + 2 < end) && (source[j + 1] == CharType('-')) && (source[j + 2] != CharType(']')))
+                {
+                    charClass.ranges.emplace_back(source[j], source[j + 2]);
+                    j += 2;
+                }
+                else
+                {
+                    charClass.ranges.emplace_back(source[j], source[j]);
+                }
+            }
+
+            if (j < end)     // otherwise '[' isn't closed and is treated as literal
+            {
+                token.kind = Token::Kind::charClass;
+                token.charClass = std::move(charClass);
+                i = j;
+            }
+        }
+
+        result.tokens.push_back(std::move(token));
+    }
+
+    return result;
+}
+
+
+void PathFilter::addTransitions(std::size_t state, const Token &token)
+{
+    switch (token.kind)
+    {
+        case Token::Kind::literal:
+            if (toUnsigned(token.literal) < asciiCount)
+            {
+                setBit(&asciiMasks[toUnsigned(token.literal) * words], state);
+            }
+            else
+            {
+                auto &mask = nonAsciiLiteralMasks[token.literal];
+                mask.resize(words, 0);
+                setBit(mask.data(), state);
+            }
+            break;
+        case Token::Kind::anyChar:
+            setBit(anyCharMask.data(), state);
+            for (std::size_t c = 0; c < asciiCount; ++c)
+            {
+                setBit(&asciiMasks[c * words], state);
+            }
+            break;
+        case Token::Kind::charClass:
+            for (std::size_t c = 0; c < asciiCount; ++c)
+            {
+                const auto ch = static_cast<CharType>(c);
+
+                // asciiMasks are looked up by folded characters, so uppercase members must be reachable too
+                CharType alternative = ch;
+#if !CASE_SENSITIVE_PATHS
+                if ((ch >= CharType('a')) && (ch <= CharType('z')))
+                {
+                    alternative = CharType(ch - ('a' - 'A'));
+                }
+#endif
+                const bool isMember = token.charClass.contains(ch, alternative);
+                if (isMember)
+                {
+                    setBit(&asciiMasks[c * words], state);
+                }
+            }
+
+            classStates.emplace_back(state, token.charClass);
+            break;
+    }
+}
+
+
+PathFilter::Matches PathFilter::match(const char_type *name, std::size_t length) const
+{
+    Matches result{false, false, false, false};
+
+    if (words == 0)
+    {
+        return result;
+    }
+
+    // states and a mask for non-ASCII characters
+    std::uint64_t stackBuffer[2 * stackMaskWords];
+    std::vector<std::uint64_t> heapBuffer;
+    std::uint64_t *states = stackBuffer;
+    if (words > stackMaskWords)
+    {
+        heapBuffer.resize(2 * words);
+        states = heapBuffer.data();
+    }
+    std::uint64_t * const nonAsciiMask = states + words;
+
+    std::copy(startMask.cbegin(), startMask.cend(), states);
+
+    for (std::size_t i = 0; i < length; ++i)
+    {
+        const CharType c = fold(name[i]);
+
+        const std::uint64_t *charMask = nonAsciiMask;
+        if (toUnsigned(c) < asciiCount)
+        {
+            charMask = &asciiMasks[toUnsigned(c) * words];
+        }
+        else
+        {
+            fillNonAsciiMask(name[i], c, nonAsciiMask);
+        }
+
+        std::uint64_t carry = 0;
+        std::uint64_t alive = 0;
+        for (std::size_t w = 0; w < words; ++w)
+        {
+            const std::uint64_t current = states[w];
+            states[w] = (((current << 1) | carry) & charMask[w]) | (current & loopMask[w]);
+            carry = current >> 63;
+            alive |= states[w];
+        }
+
+        if (alive == 0)
+        {
+            return result;
+        }
+    }
+
+    result.include = intersects(states, includeAccept.data(), words);
+    result.includeDirectory = intersects(states, includeDirectoryAccept.data(), words);
+    result.exclude = intersects(states, excludeAccept.data(), words);
+    result.excludeDirectory = intersects(states, excludeDirectoryAccept.data(), words);
+
+    return result;
+}
+
+
+void PathFilter::fillNonAsciiMask(char_type original, char_type folded, std::uint64_t *mask) const
+{
+    std::copy(anyCharMask.cbegin(), anyCharMask.cend(), mask);
+
+    const auto literal = nonAsciiLiteralMasks.find(folded);
+    if (literal != nonAsciiLiteralMasks.cend())
+    {
+        for (std::size_t w = 0; w < words; ++w)
+        {
+            mask[w] |= literal->second[w];
+        }
+    }
+
+    for (const auto &entry : classStates)
+    {
+        if (entry.second.contains(original, folded))
+        {
+            setBit(mask, entry.first);
+        }
+    }
+}
+
+
+bool PathFilter::decide(const Matches &matches, bool isDirectory) const
+{
+    if (matches.exclude || (isDirectory && matches.excludeDirectory))
+    {
+        return false;
+    }
+
+    return !hasIncludePatterns || matches.include || (isDirectory && matches.includeDirectory);
+}
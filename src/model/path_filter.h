@@ -0,0 +1,103 @@
+#ifndef PATH_FILTER_H
+#define PATH_FILTER_H
+
+#include "path.h"
+#include <vector>           // patterns lists, masks
+#include <unordered_map>    // masks of non-ASCII literals
+#include <utility>          // std::pair
+#include <cstdint>          // std::uint64_t
+#include <cstddef>          // std::size_t
+
+
+/* PathFilter decides which files should be tracked by their names
+ *
+ * Filter is built from lists of include and exclude glob patterns. Every pattern is matched against the whole name:
+ *  *               -   any sequence of characters (including the empty one)
+ *  ?               -   any single character
+ *  [abc], [a-z]    -   any single character from the set
+ *  [!abc]          -   any single character not from the set
+ *  trailing '/'    -   pattern matches directories only (for example, ".git/")
+ * Characters case is respected according to CASE_SENSITIVE_PATHS (see path.h)
+ *
+ * A name is accepted if it doesn't match any exclude pattern and either include list is empty or the name matches
+ * at least one include pattern
+ *
+ * All patterns are compiled into a single bit-parallel automaton, so a name is processed in one pass
+ * regardless of patterns count; matching doesn't allocate memory unless there are hundreds of patterns */
+class PathFilter
+{
+public:
+    using char_type = filesystem::Path::char_type;
+    using string_type = filesystem::Path::string_type;
+
+    /* Constructs filter accepting everything */
+    PathFilter();
+
+    PathFilter(const std::vector<string_type> &includePatterns, const std::vector<string_type> &excludePatterns);
+
+
+    /* Returns true if this filter accepts all names */
+    bool isEmpty() const;
+
+    /* Result of a name check which is done without knowledge about file type */
+    enum class Decision{ accepted, rejected, acceptedIfDirectory, acceptedIfNotDirectory };
+
+    /*
+     * Checks name by this filter
+     * Result depends on file type (acceptedIfDirectory or acceptedIfNotDirectory) only if
+     * directory-only patterns are matched
+     *
+     * Parameters:
+     *  name, length    -   the name (not null-terminated necessarily)
+     */
+    Decision check(const char_type *name, std::size_t length) const;
+
+    /* Returns true if name of a file with known type is accepted by this filter */
+    bool isAccepted(const char_type *name, std::size_t length, bool isDirectory) const;
+
+private:
+    using Mask = std::vector<std::uint64_t>;
+
+    struct Matches
+    {
+        bool include;
+        bool includeDirectory;
+        bool exclude;
+        bool excludeDirectory;
+    };
+
+    struct CharClass
+    {
+        bool negated;
+        std::vector<std::pair<char_type, char_type>> ranges;
+
+        /* Returns true if c or alternative (the same character in other case) is a member of the class */
+        bool contains(char_type c, char_type alternative) const;
+    };
+
+    struct Token;
+    struct Pattern;
+
+    static constexpr std::size_t asciiCount = 128;
+
+    std::size_t words = 0;              // count of 64-bit words per states mask
+    bool hasIncludePatterns = false;
+
+    Mask asciiMasks;                    // asciiCount masks of states reachable by every (folded) ASCII character
+    Mask anyCharMask;                   // states reachable by any character ('?' tokens)
+    std::unordered_map<char_type, Mask> nonAsciiLiteralMasks;
+    std::vector<std::pair<std::size_t, CharClass>> classStates;     // used for non-ASCII characters only
+    Mask startMask;
+    Mask loopMask;                      // states followed by '*'
+    Mask includeAccept, includeDirectoryAccept, excludeAccept, excludeDirectoryAccept;
+
+
+    static Pattern parse(const string_type &pattern);
+    void addTransitions(std::size_t state, const Token &token);
+
+    Matches match(const char_type *name, std::size_t length) const;
+    void fillNonAsciiMask(char_type original, char_type folded, std::uint64_t *mask) const;
+    bool decide(const Matches &matches, bool isDirectory) const;
+};
+
+#endif // PATH_FILTER_H
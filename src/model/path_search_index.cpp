@@ -0,0 +1,563 @@
+#include "path_search_index.h"
+#include "path_filter.h"
+#include <algorithm>        // std::lower_bound, std::sort, std::unique, std::mismatch
+#include <utility>          // std::move
+#include <type_traits>      // std::make_unsigned
+
+
+namespace
+{
+    using CharType = filesystem::Path::char_type;
+    using UnsignedChar = std::make_unsigned<CharType>::type;
+
+    constexpr std::size_t trigramLength = 3;
+    constexpr unsigned trigramCharBits = 21;    // enough for any Unicode code point
+
+
+    inline bool isDelimiter(CharType c)
+    {
+        return (c == CharType('/')) || (c == CharType('\\'));
+    }
+
+    inline bool isWildcard(CharType c)
+    {
+        return (c == CharType('*')) || (c == CharType('?')) || (c == CharType('['));
+    }
+
+    /* Returns the character which is used for searching instead of c */
+    inline CharType fold(CharType c)
+    {
+#if CASE_SENSITIVE_PATHS
+        return c;
+#else
+        if (static_cast<UnsignedChar>(c) < 0x80)
+        {
+            return ((c >= CharType('A')) && (c <= CharType('Z'))) ? CharType(c + ('a' - 'A')) : c;
+        }
+
+        return filesystem::CICharTraits::toLower(c);
+#endif
+    }
+
+    inline std::uint64_t makeTrigram(const CharType *chars)
+    {
+        constexpr std::uint64_t charMask = (std::uint64_t(1) << trigramCharBits) - 1;
+
+        return ((static_cast<UnsignedChar>(chars[0]) & charMask) << (2 * trigramCharBits)) |
+               ((static_cast<UnsignedChar>(chars[1]) & charMask) << trigramCharBits) |
+               (static_cast<UnsignedChar>(chars[2]) & charMask);
+    }
+
+    /*
+     * Splits the glob pattern (see PathFilter) into its literal prefix and its longest literal part
+     * Character classes and trailing delimiters aren't literals
+     */
+    template<typename String>
+    void getGlobLiterals(const String &pattern, String &prefix, String &longest)
+    {
+        std::size_t end = pattern.length();
+        for (; (end > 0) && isDelimiter(pattern[end - 1]); --end)
+        {
+        }
+
+        bool isPrefix = true;
+        std::size_t partBegin = 0;
+        for (std::size_t i = 0; i <= end; ++i)
+        {
+            if ((i < end) && !isWildcard(pattern[i]))
+            {
+                continue;
+            }
+
+            if (isPrefix)
+            {
+                prefix.assign(pattern, 0, i);
+                isPrefix = false;
+            }
+            if (i - partBegin > longest.length())
+            {
+                longest.assign(pattern, partBegin, i - partBegin);
+            }
+
+            if ((i < end) && (pattern[i] == CharType('[')))
+            {
+                // the same rules as PathFilter::parse: the first character of the set may be ']'
+                std::size_t j = i + 1;
+                if ((j < end) && (pattern[j] == CharType('!')))
+                {
+                    ++j;
+                }
+
+                const std::size_t first = j;
+                for (; (j < end) && ((j == first) || (pattern[j] != CharType(']'))); ++j)
+                {
+                }
+
+                if (j == end)   // '[' isn't closed; the rest is skipped rather than taken as literals
+                {
+                    break;
+                }
+                i = j;
+            }
+
+            partBegin = i + 1;
+        }
+    }
+}
+
+
+constexpr PathSearchIndex::Id PathSearchIndex::noId;
+
+
+PathSearchIndex::PathSearchIndex() = default;
+PathSearchIndex::~PathSearchIndex() = default;
+
+
+void PathSearchIndex::insert(const filesystem::Path &path)
+{
+    const Key key = makeKey(path.getPathString());
+
+    std::lock_guard<decltype(mutex)> lock(mutex);
+    if (findWithoutLock(key) == noId)
+    {
+        insertWithoutLock(path, key);
+    }
+}
+
+void PathSearchIndex::erase(const filesystem::Path &path)
+{
+    const Key key = makeKey(path.getPathString());
+
+    std::lock_guard<decltype(mutex)> lock(mutex);
+    eraseWithoutLock(key);
+}
+
+void PathSearchIndex::rename(const filesystem::Path &oldPath, const filesystem::Path &newPath)
+{
+    const Key oldKey = makeKey(oldPath.getPathString());
+    const Key newKey = makeKey(newPath.getPathString());
+
+    std::lock_guard<decltype(mutex)> lock(mutex);
+
+    if (findWithoutLock(oldKey) == noId)
+    {
+        return;
+    }
+
+    eraseWithoutLock(oldKey);
+    eraseWithoutLock(newKey);   // the rename replaces an existing file
+    insertWithoutLock(newPath, newKey);
+}
+
+void PathSearchIndex::clear()
+{
+    std::lock_guard<decltype(mutex)> lock(mutex);
+
+    root.children.clear();
+    root.id = noId;
+    paths.clear();
+    freeIds.clear();
+    count = 0;
+    trigrams.clear();
+}
+
+
+std::size_t PathSearchIndex::size() const
+{
+    std::lock_guard<decltype(mutex)> lock(mutex);
+    return count;
+}
+
+std::size_t PathSearchIndex::getMemoryUsage() const
+{
+    constexpr std::size_t hashNodeOverhead = 2 * sizeof(void*);
+
+    std::lock_guard<decltype(mutex)> lock(mutex);
+
+    std::size_t result = getTrieMemoryUsage(root) +
+                         paths.capacity() * sizeof(filesystem::Path) + freeIds.capacity() * sizeof(Id) +
+                         trigrams.bucket_count() * sizeof(void*) +
+                         trigrams.size() * (sizeof(Trigrams::value_type) + hashNodeOverhead);
+
+    for (const auto &path : paths)
+    {
+        result += path.getPathString().capacity() * sizeof(char_type);
+    }
+    for (const auto &trigram : trigrams)
+    {
+        result += trigram.second.capacity() * sizeof(Id);
+    }
+
+    return result;
+}
+
+
+std::vector<filesystem::Path> PathSearchIndex::findByPrefix(const string_type &prefix, std::size_t limit) const
+{
+    const Key key = makeKey(prefix);
+
+    std::lock_guard<decltype(mutex)> lock(mutex);
+
+    std::vector<filesystem::Path> result;
+
+    const TrieNode *const subtree = findSubtree(key);
+    if (subtree != nullptr)
+    {
+        visitSubtree(*subtree, [this, &result, limit](Id id)
+        {
+            result.push_back(paths[id]);
+            return (limit == 0) || (result.size() < limit);
+        });
+    }
+
+    return result;
+}
+
+std::vector<filesystem::Path> PathSearchIndex::findBySubstring(const string_type &substring, std::size_t limit) const
+{
+    std::lock_guard<decltype(mutex)> lock(mutex);
+
+    std::vector<filesystem::Path> result;
+
+    // string_type compares characters according to CASE_SENSITIVE_PATHS, so candidates are checked as they are
+    const auto check = [this, &result, &substring, limit](Id id)
+    {
+        if (paths[id].getPathString().find(substring) != string_type::npos)
+        {
+            result.push_back(paths[id]);
+        }
+
+        return (limit == 0) || (result.size() < limit);
+    };
+
+    if (substring.length() < trigramLength)
+    {
+        visitSubtree(root, check);
+        return result;
+    }
+
+    const PostingList *const candidates = getCandidates(makeKey(substring));
+    if (candidates != nullptr)
+    {
+        for (const Id id : *candidates)
+        {
+            if (!check(id))
+            {
+                break;
+            }
+        }
+    }
+
+    return result;
+}
+
+std::vector<filesystem::Path> PathSearchIndex::findByGlob(const string_type &pattern, std::size_t limit) const
+{
+    const PathFilter filter({pattern}, {});
+
+    string_type prefix, longest;
+    getGlobLiterals(pattern, prefix, longest);
+
+    const Key prefixKey = makeKey(prefix);
+    const Key longestKey = makeKey(longest);
+
+    std::lock_guard<decltype(mutex)> lock(mutex);
+
+    std::vector<filesystem::Path> result;
+
+    const auto check = [this, &result, &filter, limit](Id id)
+    {
+        const auto &string = paths[id].getPathString();
+        if (filter.check(string.c_str(), string.length()) != PathFilter::Decision::rejected)
+        {
+            result.push_back(paths[id]);
+        }
+
+        return (limit == 0) || (result.size() < limit);
+    };
+
+    // a longer literal prefix usually selects fewer paths than trigrams do
+    if (prefixKey.empty() && (longestKey.length() >= trigramLength))
+    {
+        const PostingList *const candidates = getCandidates(longestKey);
+        if (candidates != nullptr)
+        {
+            for (const Id id : *candidates)
+            {
+                if (!check(id))
+                {
+                    break;
+                }
+            }
+        }
+    }
+    else
+    {
+        const TrieNode *const subtree = findSubtree(prefixKey);
+        if (subtree != nullptr)
+        {
+            visitSubtree(*subtree, check);
+        }
+    }
+
+    return result;
+}
+
+
+PathSearchIndex::Key PathSearchIndex::makeKey(const string_type &string)
+{
+    Key result(string.length(), char_type());
+    std::transform(string.cbegin(), string.cend(), result.begin(), fold);
+
+    return result;
+}
+
+std::vector<std::uint64_t> PathSearchIndex::getTrigrams(const Key &key)
+{
+    std::vector<std::uint64_t> result;
+    if (key.length() < trigramLength)
+    {
+        return result;
+    }
+
+    result.reserve(key.length() - trigramLength + 1);
+    for (std::size_t i = 0; i + trigramLength <= key.length(); ++i)
+    {
+        result.push_back(makeTrigram(key.data() + i));
+    }
+
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+
+    return result;
+}
+
+
+std::vector<std::unique_ptr<PathSearchIndex::TrieNode>>::iterator
+PathSearchIndex::findChild(TrieNode &node, char_type c)
+{
+    return std::lower_bound(node.children.begin(), node.children.end(), c,
+                            [](const std::unique_ptr<TrieNode> &child, char_type value)
+                            {
+                                return child->label[0] < value;
+                            });
+}
+
+PathSearchIndex::Id PathSearchIndex::findWithoutLock(const Key &key) const
+{
+    const TrieNode *node = &root;
+    std::size_t position = 0;
+
+    while (position < key.length())
+    {
+        auto &children = node->children;
+        const auto child = findChild(const_cast<TrieNode&>(*node), key[position]);
+        if ((child == children.end()) || ((*child)->label[0] != key[position]) ||
+            (key.compare(position, (*child)->label.length(), (*child)->label) != 0))
+        {
+            return noId;
+        }
+
+        position += (*child)->label.length();
+        node = child->get();
+    }
+
+    return node->id;
+}
+
+const PathSearchIndex::TrieNode* PathSearchIndex::findSubtree(const Key &prefix) const
+{
+    const TrieNode *node = &root;
+    std::size_t position = 0;
+
+    while (position < prefix.length())
+    {
+        auto &children = node->children;
+        const auto child = findChild(const_cast<TrieNode&>(*node), prefix[position]);
+        if ((child == children.end()) || ((*child)->label[0] != prefix[position]))
+        {
+            return nullptr;
+        }
+
+        // the prefix may end in the middle of the label
+        const auto &label = (*child)->label;
+        const std::size_t length = std::min(label.length(), prefix.length() - position);
+        if (prefix.compare(position, length, label, 0, length) != 0)
+        {
+            return nullptr;
+        }
+
+        position += length;
+        node = child->get();
+    }
+
+    return node;
+}
+
+
+void PathSearchIndex::insertWithoutLock(const filesystem::Path &path, const Key &key)
+{
+    Id id;
+    if (!freeIds.empty())
+    {
+        id = freeIds.back();
+        paths[id] = path;
+        freeIds.pop_back();
+    }
+    else
+    {
+        id = static_cast<Id>(paths.size());
+        paths.push_back(path);
+    }
+
+    TrieNode *node = &root;
+    std::size_t position = 0;
+    while (position < key.length())
+    {
+        const auto child = findChild(*node, key[position]);
+        if ((child == node->children.end()) || ((*child)->label[0] != key[position]))
+        {
+            auto leaf = std::make_unique<TrieNode>();
+            leaf->label.assign(key, position, Key::npos);
+            node = node->children.insert(child, std::move(leaf))->get();
+            break;
+        }
+
+        auto &label = (*child)->label;
+        const std::size_t length = std::min(label.length(), key.length() - position);
+        const std::size_t common = std::mismatch(label.cbegin(), label.cbegin() + length,
+                                                 key.cbegin() + position).first - label.cbegin();
+
+        if (common < label.length())    // the edge is split by the new key
+        {
+            auto middle = std::make_unique<TrieNode>();
+            middle->label.assign(label, 0, common);
+            label.erase(0, common);
+            middle->children.push_back(std::move(*child));
+            *child = std::move(middle);
+        }
+
+        position += common;
+        node = child->get();
+    }
+
+    node->id = id;
+    ++count;
+
+    for (const auto trigram : getTrigrams(key))
+    {
+        auto &postingList = trigrams[trigram];
+        postingList.insert(std::lower_bound(postingList.begin(), postingList.end(), id), id);
+    }
+}
+
+void PathSearchIndex::eraseWithoutLock(const Key &key)
+{
+    std::vector<TrieNode*> nodes{&root};
+    std::size_t position = 0;
+
+    while (position < key.length())
+    {
+        TrieNode *const node = nodes.back();
+        const auto child = findChild(*node, key[position]);
+        if ((child == node->children.end()) || ((*child)->label[0] != key[position]) ||
+            (key.compare(position, (*child)->label.length(), (*child)->label) != 0))
+        {
+            return;
+        }
+
+        position += (*child)->label.length();
+        nodes.push_back(child->get());
+    }
+
+    TrieNode *node = nodes.back();
+    const Id id = node->id;
+    if (id == noId)
+    {
+        return;
+    }
+
+    for (const auto trigram : getTrigrams(key))
+    {
+        const auto postingList = trigrams.find(trigram);
+        if (postingList == trigrams.end())
+        {
+            continue;
+        }
+
+        auto &ids = postingList->second;
+        const auto entry = std::lower_bound(ids.begin(), ids.end(), id);
+        if ((entry != ids.end()) && (*entry == id))
+        {
+            ids.erase(entry);
+        }
+        if (ids.empty())
+        {
+            trigrams.erase(postingList);
+        }
+    }
+
+    node->id = noId;
+    paths[id] = filesystem::Path();
+    freeIds.push_back(id);
+    --count;
+
+    // the trie is kept compact: there are no empty leaves and no pass-through nodes besides the root
+    if ((node != &root) && node->children.empty())
+    {
+        TrieNode *const parent = nodes[nodes.size() - 2];
+        parent->children.erase(findChild(*parent, node->label[0]));
+        nodes.pop_back();
+        node = parent;
+    }
+
+    if ((node != &root) && (node->id == noId) && (node->children.size() == 1))
+    {
+        std::unique_ptr<TrieNode> child = std::move(node->children.front());
+        node->label += child->label;
+        node->id = child->id;
+        node->children = std::move(child->children);
+    }
+}
+
+
+const PathSearchIndex::PostingList* PathSearchIndex::getCandidates(const Key &key) const
+{
+    const PostingList *result = nullptr;
+    for (const auto trigram : getTrigrams(key))
+    {
+        const auto postingList = trigrams.find(trigram);
+        if (postingList == trigrams.cend())
+        {
+            return nullptr;
+        }
+
+        if ((result == nullptr) || (postingList->second.size() < result->size()))
+        {
+            result = &postingList->second;
+        }
+    }
+
+    return result;
+}
+
+std::size_t PathSearchIndex::getTrieMemoryUsage(const TrieNode &node)
+{
+    std::size_t result = 0;
+
+    std::vector<const TrieNode*> stack{&node};
+    while (!stack.empty())
+    {
+        const TrieNode *const current = stack.back();
+        stack.pop_back();
+
+        result += sizeof(TrieNode) + current->label.capacity() * sizeof(char_type) +
+                  current->children.capacity() * sizeof(std::unique_ptr<TrieNode>);
+        for (const auto &child : current->children)
+        {
+            stack.push_back(child.get());
+        }
+    }
+
+    return result;
+}
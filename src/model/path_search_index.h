@@ -0,0 +1,140 @@
+#ifndef PATH_SEARCH_INDEX_H
+#define PATH_SEARCH_INDEX_H
+
+#include "path.h"
+#include <unordered_map>    // trigrams index
+#include <vector>           // paths, posting lists, query results
+#include <memory>           // std::unique_ptr
+#include <mutex>
+#include <string>           // std::basic_string
+#include <cstdint>          // std::uint32_t, std::uint64_t
+#include <cstddef>          // std::size_t
+
+
+/* PathSearchIndex answers name queries over tracked paths without scanning all of them
+ * It's updated incrementally by DirectoryWatcher from change batches (see DirectoryWatcher::Options::indexPaths)
+ *
+ * Paths are kept in a radix trie of case-folded names for prefix and glob queries (a glob is matched within
+ * the subtree of its literal prefix) and in an index of trigrams for substring queries (only paths having
+ * all trigrams of the query are checked). Memory overhead is about 4 bytes per trigram of every path plus
+ * the trie nodes; it's reported by getMemoryUsage
+ * Characters case is respected according to CASE_SENSITIVE_PATHS (see path.h)
+ * Queries and updates are thread safe */
+class PathSearchIndex
+{
+public:
+    using string_type = filesystem::Path::string_type;
+
+    PathSearchIndex();
+    ~PathSearchIndex();
+
+    /* Does nothing if the path is indexed already */
+    void insert(const filesystem::Path &path);
+
+    /* Does nothing if the path isn't indexed */
+    void erase(const filesystem::Path &path);
+
+    /* The rename replaces the new path if it's indexed; does nothing if the old path isn't indexed */
+    void rename(const filesystem::Path &oldPath, const filesystem::Path &newPath);
+
+    void clear();
+
+    std::size_t size() const;
+
+    /* Returns approximate count of bytes allocated by the index (paths strings are included); costs O(n) */
+    std::size_t getMemoryUsage() const;
+
+
+    /*
+     * Queries; limit == 0 means no limit
+     */
+
+    /* Returns paths starting with the prefix in ascending order of case-folded paths */
+    std::vector<filesystem::Path> findByPrefix(const string_type &prefix, std::size_t limit) const;
+
+    /*
+     * Returns paths containing the substring in unspecified order
+     * Substrings shorter than 3 characters can't use trigrams, so all paths are checked
+     */
+    std::vector<filesystem::Path> findBySubstring(const string_type &substring, std::size_t limit) const;
+
+    /*
+     * Returns paths matching the glob pattern (see PathFilter for the syntax) in unspecified order
+     * Directory-only patterns (with trailing '/') aren't distinguished, since types of files aren't indexed
+     * Candidates are taken from the literal prefix of the pattern or from the trigrams of its longest literal part
+     */
+    std::vector<filesystem::Path> findByGlob(const string_type &pattern, std::size_t limit) const;
+
+private:
+    using char_type = filesystem::Path::char_type;
+    using Key = std::basic_string<char_type>;   // case-folded path
+    using Id = std::uint32_t;
+    using PostingList = std::vector<Id>;        // sorted ids of paths having a trigram
+    using Trigrams = std::unordered_map<std::uint64_t, PostingList>;
+
+    static constexpr Id noId = ~Id(0);
+
+    struct TrieNode
+    {
+        Key label;                                          // of the edge from the parent
+        std::vector<std::unique_ptr<TrieNode>> children;    // sorted by the first characters of labels
+        Id id = noId;                                       // of the path ending at this node
+    };
+
+    TrieNode root;
+    std::vector<filesystem::Path> paths;    // by ids; freed ones are empty
+    std::vector<Id> freeIds;
+    std::size_t count = 0;
+    Trigrams trigrams;
+    mutable std::mutex mutex;
+
+
+    PathSearchIndex(const PathSearchIndex&) = delete;
+    PathSearchIndex& operator=(const PathSearchIndex&) = delete;
+
+    static Key makeKey(const string_type &string);
+
+    /* Returns sorted unique trigrams of the key */
+    static std::vector<std::uint64_t> getTrigrams(const Key &key);
+
+    /* Returns iterator to the child whose label starts with c or the position where it should be inserted */
+    static std::vector<std::unique_ptr<TrieNode>>::iterator findChild(TrieNode &node, char_type c);
+
+    /* Returns noId if the key isn't found */
+    Id findWithoutLock(const Key &key) const;
+
+    /* Returns the topmost node whose subtree contains all keys with the prefix; nullptr if there are none */
+    const TrieNode* findSubtree(const Key &prefix) const;
+
+    void insertWithoutLock(const filesystem::Path &path, const Key &key);
+    void eraseWithoutLock(const Key &key);
+
+    /* Calls visitor(id) for every id of the subtree in ascending order of keys until it returns false */
+    template<typename Visitor>
+    static void visitSubtree(const TrieNode &node, Visitor &&visitor)
+    {
+        std::vector<const TrieNode*> stack{&node};
+        while (!stack.empty())
+        {
+            const TrieNode *const current = stack.back();
+            stack.pop_back();
+
+            if ((current->id != noId) && !visitor(current->id))
+            {
+                return;
+            }
+
+            for (auto child = current->children.crbegin(); child != current->children.crend(); ++child)
+            {
+                stack.push_back(child->get());
+            }
+        }
+    }
+
+    /* Returns the shortest posting list of the trigrams; nullptr if some of them isn't indexed */
+    const PostingList* getCandidates(const Key &key) const;
+
+    static std::size_t getTrieMemoryUsage(const TrieNode &node);
+};
+
+#endif // PATH_SEARCH_INDEX_H
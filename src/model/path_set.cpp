@@ -0,0 +1,285 @@
+#include "path_set.h"
+#include <algorithm>        // std::fill, std::copy
+#include <limits>           // std::numeric_limits
+#include <stdexcept>        // std::length_error
+#include <type_traits>      // std::make_unsigned
+#include <utility>          // std::move
+
+
+namespace
+{
+    using CharType = PathSet::char_type;
+    using UnsignedChar = std::make_unsigned<CharType>::type;
+
+
+    /* Returns the character which is hashed instead of c */
+    inline CharType fold(CharType c)
+    {
+#if CASE_SENSITIVE_PATHS
+        return c;
+#else
+        if (static_cast<UnsignedChar>(c) < 0x80)
+        {
+            return ((c >= CharType('A')) && (c <= CharType('Z'))) ? CharType(c + ('a' - 'A')) : c;
+        }
+
+        return filesystem::CICharTraits::toLower(c);
+#endif
+    }
+}
+
+
+constexpr std::size_t PathSet::npos;
+constexpr PathSet::Id PathSet::emptySlot;
+constexpr std::size_t PathSet::minSlotsCount;
+constexpr std::size_t PathSet::minCompactedLength;
+
+
+std::size_t PathSet::size() const
+{
+    return order.size();
+}
+
+bool PathSet::empty() const
+{
+    return order.empty();
+}
+
+
+filesystem::PathView PathSet::operator[](std::size_t position) const
+{
+    const auto &record = records[order[position]];
+    return filesystem::PathView(chars.data() + record.offset, record.length);
+}
+
+std::size_t PathSet::find(filesystem::PathView path) const
+{
+    if (slots.empty())
+    {
+        return npos;
+    }
+
+    const Id slot = slots[findSlot(path, hash(path))];
+    return (slot == emptySlot) ? npos : records[slot - 1].position;
+}
+
+
+std::size_t PathSet::pushBack(filesystem::PathView path)
+{
+    if ((order.size() + 1) * 4 > slots.size() * 3)
+    {
+        rehash(std::max(minSlotsCount, slots.size() * 2));
+    }
+
+    const auto pathHash = hash(path);
+    const auto slot = findSlot(path, pathHash);
+    if (slots[slot] != emptySlot)
+    {
+        return npos;
+    }
+
+    const Record record{storeChars(path), static_cast<std::uint32_t>(path.size()),
+                        static_cast<std::uint32_t>(order.size()), pathHash};
+
+    Id id;
+    if (!freeIds.empty())
+    {
+        id = freeIds.back();
+        records[id] = record;
+        freeIds.pop_back();
+    }
+    else
+    {
+        id = static_cast<Id>(records.size());
+        records.push_back(record);
+    }
+
+    // the slot is still the same, since storing of the characters doesn't touch the table
+    order.push_back(id);
+    slots[slot] = id + 1;
+
+    return record.position;
+}
+
+void PathSet::erase(std::size_t position)
+{
+    const Id id = order[position];
+
+    eraseSlot(findSlot(id));
+    freeIds.push_back(id);
+
+    order.erase(order.begin() + position);
+    for (std::size_t i = position; i < order.size(); ++i)
+    {
+        records[order[i]].position = static_cast<std::uint32_t>(i);
+    }
+
+    releaseChars(records[id].length);
+}
+
+bool PathSet::assign(std::size_t position, filesystem::PathView path)
+{
+    const Id id = order[position];
+    const auto pathHash = hash(path);
+
+    const Id existing = slots[findSlot(path, pathHash)];
+    if (existing != emptySlot)
+    {
+        if (existing - 1 != id)
+        {
+            return false;
+        }
+
+        // the same path with another characters case; equal paths have equal lengths, so it's replaced in place
+        std::copy(path.data(), path.data() + path.size(), chars.begin() + records[id].offset);
+        return true;
+    }
+
+    const auto offset = storeChars(path);
+    eraseSlot(findSlot(id));
+
+    auto &record = records[id];
+    const auto oldLength = record.length;
+    record.offset = offset;
+    record.length = static_cast<std::uint32_t>(path.size());
+    record.hash = pathHash;
+    slots[findSlot(path, pathHash)] = id + 1;
+
+    releaseChars(oldLength);
+    return true;
+}
+
+void PathSet::clear()
+{
+    chars.clear();
+    garbageLength = 0;
+    records.clear();
+    freeIds.clear();
+    order.clear();
+    std::fill(slots.begin(), slots.end(), emptySlot);
+}
+
+
+std::size_t PathSet::getMemoryUsage() const
+{
+    return chars.capacity() * sizeof(char_type) + records.capacity() * sizeof(Record) +
+           (freeIds.capacity() + order.capacity() + slots.capacity()) * sizeof(Id);
+}
+
+
+std::uint32_t PathSet::hash(filesystem::PathView path)
+{
+    // FNV-1a over the folded characters
+    std::uint32_t result = 2166136261u;
+    for (std::size_t i = 0; i < path.size(); ++i)
+    {
+        result = (result ^ static_cast<UnsignedChar>(fold(path.data()[i]))) * 16777619u;
+    }
+
+    return result;
+}
+
+bool PathSet::equals(const Record &record, filesystem::PathView path) const
+{
+    return (record.length == path.size()) &&
+           (filesystem::PathCharTraits::compare(chars.data() + record.offset, path.data(), path.size()) == 0);
+}
+
+
+std::size_t PathSet::findSlot(filesystem::PathView path, std::uint32_t pathHash) const
+{
+    const std::size_t mask = slots.size() - 1;
+    for (std::size_t slot = pathHash & mask; ; slot = (slot + 1) & mask)
+    {
+        const Id id = slots[slot];
+        if ((id == emptySlot) || ((records[id - 1].hash == pathHash) && equals(records[id - 1], path)))
+        {
+            return slot;
+        }
+    }
+}
+
+std::size_t PathSet::findSlot(Id id) const
+{
+    const std::size_t mask = slots.size() - 1;
+    std::size_t slot = records[id].hash & mask;
+    for (; slots[slot] != id + 1; slot = (slot + 1) & mask)
+    {
+    }
+
+    return slot;
+}
+
+void PathSet::eraseSlot(std::size_t slot)
+{
+    // backward shift deletion keeps probe sequences unbroken without tombstones
+    const std::size_t mask = slots.size() - 1;
+    for (std::size_t next = (slot + 1) & mask; slots[next] != emptySlot; next = (next + 1) & mask)
+    {
+        const std::size_t home = records[slots[next] - 1].hash & mask;
+        if (((next - home) & mask) >= ((next - slot) & mask))
+        {
+            slots[slot] = slots[next];
+            slot = next;
+        }
+    }
+
+    slots[slot] = emptySlot;
+}
+
+void PathSet::rehash(std::size_t slotsCount)
+{
+    slots.assign(slotsCount, emptySlot);
+
+    const std::size_t mask = slotsCount - 1;
+    for (const Id id : order)
+    {
+        std::size_t slot = records[id].hash & mask;
+        for (; slots[slot] != emptySlot; slot = (slot + 1) & mask)
+        {
+        }
+
+        slots[slot] = id + 1;
+    }
+}
+
+
+std::uint32_t PathSet::storeChars(filesystem::PathView path)
+{
+    if (chars.size() + path.size() > std::numeric_limits<std::uint32_t>::max())
+    {
+        throw std::length_error("Too long paths of a set");
+    }
+
+    const auto result = static_cast<std::uint32_t>(chars.size());
+    chars.insert(chars.end(), path.data(), path.data() + path.size());
+
+    return result;
+}
+
+void PathSet::releaseChars(std::size_t length)
+{
+    garbageLength += length;
+    if ((garbageLength >= minCompactedLength) && (garbageLength * 2 > chars.size()))
+    {
+        compact();
+    }
+}
+
+void PathSet::compact()
+{
+    // the live paths are laid out in the order of positions, so iteration reads the buffer sequentially
+    std::vector<char_type> compacted;
+    compacted.reserve(chars.size() - garbageLength);
+
+    for (const Id id : order)
+    {
+        auto &record = records[id];
+        const auto offset = static_cast<std::uint32_t>(compacted.size());
+        compacted.insert(compacted.end(), chars.data() + record.offset, chars.data() + record.offset + record.length);
+        record.offset = offset;
+    }
+
+    chars = std::move(compacted);
+    garbageLength = 0;
+}
@@ -0,0 +1,101 @@
+#ifndef PATH_SET_H
+#define PATH_SET_H
+
+#include "path.h"
+#include <vector>       // strings buffer, records, order and lookup table
+#include <cstdint>      // std::uint32_t
+#include <cstddef>      // std::size_t
+
+
+/* Insertion order preserving set of paths which keeps every path string once in a shared characters buffer
+ *
+ * A path costs its characters plus about 24 bytes (a record, a position in the order and a slot of the lookup table),
+ * while a Path object costs a string object with its own allocation (and OrderedSet<Path> keeps two of them).
+ * Paths are materialized as PathView on demand; views are valid until the set is modified
+ * Characters case is respected according to CASE_SENSITIVE_PATHS (see path.h)
+ *
+ * Erasing costs O(n) since positions of the following paths are shifted (as in OrderedSet) */
+class PathSet
+{
+public:
+    using char_type = filesystem::Path::char_type;
+
+    static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+
+    PathSet() = default;
+
+    std::size_t size() const;
+    bool empty() const;
+
+    filesystem::PathView operator[](std::size_t position) const;
+
+    /* Returns position of the path or npos if it isn't present */
+    std::size_t find(filesystem::PathView path) const;
+
+    /*
+     * Appends the path to the end
+     * Returns position of the path or npos if it's present already
+     *
+     * Throws:
+     *  std::length_error   -   total length of paths exceeds 2^32 characters
+     */
+    std::size_t pushBack(filesystem::PathView path);
+
+    void erase(std::size_t position);
+
+    /*
+     * Replaces the path at the position keeping the position (a path differing in characters case only is respelled)
+     * Returns false (and does nothing) if the new path is present at another position
+     *
+     * Throws:
+     *  std::length_error   -   see pushBack
+     */
+    bool assign(std::size_t position, filesystem::PathView path);
+
+    /* Keeps allocated memory */
+    void clear();
+
+    /* Returns count of bytes allocated by the set (including the paths strings) */
+    std::size_t getMemoryUsage() const;
+
+private:
+    using Id = std::uint32_t;
+
+    struct Record
+    {
+        std::uint32_t offset;       // in chars
+        std::uint32_t length;
+        std::uint32_t position;     // in order
+        std::uint32_t hash;
+    };
+
+    static constexpr Id emptySlot = 0;      // slots keep ids increased by 1
+    static constexpr std::size_t minSlotsCount = 16;
+    static constexpr std::size_t minCompactedLength = 4096;
+
+    std::vector<char_type> chars;
+    std::size_t garbageLength = 0;          // characters of erased and replaced paths
+    std::vector<Record> records;            // by ids
+    std::vector<Id> freeIds;
+    std::vector<Id> order;                  // ids by positions
+    std::vector<Id> slots;                  // open addressing with linear probing; count is a power of 2
+
+
+    static std::uint32_t hash(filesystem::PathView path);
+    bool equals(const Record &record, filesystem::PathView path) const;
+
+    /* Returns the slot of the path or the empty slot where it should be inserted */
+    std::size_t findSlot(filesystem::PathView path, std::uint32_t pathHash) const;
+    std::size_t findSlot(Id id) const;
+    void eraseSlot(std::size_t slot);
+    void rehash(std::size_t slotsCount);
+
+    /* Returns offset of the stored copy */
+    std::uint32_t storeChars(filesystem::PathView path);
+    /* Compacts the characters if the most of them are released */
+    void releaseChars(std::size_t length);
+    void compact();
+};
+
+#endif // PATH_SET_H
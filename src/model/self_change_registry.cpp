@@ -0,0 +1,89 @@
+#include "self_change_registry.h"
+
+
+constexpr std::chrono::milliseconds SelfChangeRegistry::defaultExpiration;
+
+
+SelfChangeRegistry::SelfChangeRegistry(std::chrono::milliseconds expiration)
+    : expiration(expiration), nextSweep(Clock::now() + expiration), pathsCount(0)
+{
+}
+
+
+void SelfChangeRegistry::add(const filesystem::Path &path)
+{
+    const auto now = Clock::now();
+
+    std::lock_guard<decltype(mutex)> lock(mutex);
+
+    if (now >= nextSweep)
+    {
+        sweepWithoutLock(now);
+    }
+
+    auto &registration = registrations[path];
+    ++registration.count;
+    registration.deadline = now + expiration;
+
+    pathsCount.store(registrations.size(), std::memory_order_release);
+}
+
+
+void SelfChangeRegistry::cancel(const filesystem::Path &path)
+{
+    std::lock_guard<decltype(mutex)> lock(mutex);
+
+    const auto found = registrations.find(path);
+    if ((found != registrations.end()) && (--found->second.count == 0))
+    {
+        registrations.erase(found);
+        pathsCount.store(registrations.size(), std::memory_order_release);
+    }
+}
+
+
+bool SelfChangeRegistry::match(const filesystem::Path &path)
+{
+    const auto now = Clock::now();
+
+    std::lock_guard<decltype(mutex)> lock(mutex);
+
+    const auto found = registrations.find(path);
+    if (found == registrations.end())
+    {
+        return false;
+    }
+
+    const bool live = (found->second.deadline > now);
+    if (!live || (--found->second.count == 0))
+    {
+        registrations.erase(found);
+        pathsCount.store(registrations.size(), std::memory_order_release);
+    }
+
+    return live;
+}
+
+
+bool SelfChangeRegistry::empty() const
+{
+    return pathsCount.load(std::memory_order_acquire) == 0;
+}
+
+
+void SelfChangeRegistry::sweepWithoutLock(Clock::time_point now)
+{
+    for (auto iter = registrations.begin(); iter != registrations.end();)
+    {
+        if (iter->second.deadline <= now)
+        {
+            iter = registrations.erase(iter);
+        }
+        else
+        {
+            ++iter;
+        }
+    }
+
+    nextSweep = now + expiration;
+}
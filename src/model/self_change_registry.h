@@ -0,0 +1,61 @@
+#ifndef SELF_CHANGE_REGISTRY_H
+#define SELF_CHANGE_REGISTRY_H
+
+#include "path.h"
+#include <unordered_map>    // registrations field
+#include <mutex>
+#include <atomic>           // registrations count
+#include <chrono>           // std::chrono::steady_clock
+#include <cstddef>          // std::size_t
+
+
+/* SelfChangeRegistry keeps paths which are about to be changed by this process (see FileOperationsExecutor),
+ * so DirectoryWatcher can tag the resulting change entries as self-originated (see DirectoryWatcher::Options)
+ * Every registration is consumed by one matching change; registrations which are not matched
+ * within the expiration interval are dropped (the system may coalesce or not report a change)
+ * Paths must be built as the watched directory joined with the file name, as DirectoryWatcher does
+ * All methods are thread safe */
+class SelfChangeRegistry
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr std::chrono::milliseconds defaultExpiration{5000};
+
+
+    explicit SelfChangeRegistry(std::chrono::milliseconds expiration = defaultExpiration);
+
+    /* Registers one change of the path which is about to be made */
+    void add(const filesystem::Path &path);
+
+    /* Withdraws one registration of the path (the change hasn't been made) */
+    void cancel(const filesystem::Path &path);
+
+    /* Consumes one registration of the path; returns false if there is no live one */
+    bool match(const filesystem::Path &path);
+
+    /* Returns true if nothing is registered; lock-free, so the watcher checks it before building paths */
+    bool empty() const;
+
+private:
+    struct Registration
+    {
+        std::size_t count;
+        Clock::time_point deadline;     // of the latest registration
+    };
+
+    const std::chrono::milliseconds expiration;
+    std::unordered_map<filesystem::Path, Registration> registrations;
+    Clock::time_point nextSweep;
+    std::atomic<std::size_t> pathsCount;
+    mutable std::mutex mutex;
+
+
+    SelfChangeRegistry(const SelfChangeRegistry&) = delete;
+    SelfChangeRegistry& operator=(const SelfChangeRegistry&) = delete;
+
+    /* Drops expired registrations; mutex must be locked */
+    void sweepWithoutLock(Clock::time_point now);
+};
+
+#endif // SELF_CHANGE_REGISTRY_H
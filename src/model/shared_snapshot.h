@@ -0,0 +1,102 @@
+#ifndef SHARED_SNAPSHOT_H
+#define SHARED_SNAPSHOT_H
+
+#include "path.h"
+#include "path_set.h"
+#include "file_index.h"
+#include <vector>       // snapshot files
+#include <memory>       // std::unique_ptr
+#include <chrono>       // std::chrono::system_clock
+#include <cstdint>      // std::uint64_t
+#include <cstddef>      // std::size_t
+
+
+/* Shared snapshot is the tracked files list of a DirectoryWatcher published into a named shared memory region,
+ * so other processes can read it instead of running their own watchers and scans
+ *
+ * The region holds two buffers: the writer fills the one which isn't current and then switches the current one.
+ * Every buffer is guarded by a sequence counter (seqlock), so readers take consistent snapshots lock-free
+ * and without system calls; a reader retries only if the writer has published twice while it was copying
+ * There must be at most one writer per region name */
+
+
+/* Mapped view of a region (defined by the platform implementation) */
+class SharedSnapshotRegion;
+
+
+class SharedSnapshotWriter
+{
+public:
+    /*
+     * Creates the region (or opens the existing one created with the same capacity)
+     * Parameters:
+     *  name        -   name of the region (for example, "Local\\dirwatch-projects")
+     *  capacity    -   bytes of every buffer; snapshots which don't fit it are published incomplete
+     *
+     * Throws:
+     *  std::system_error   -   the region can't be created or it exists with another layout
+     */
+    SharedSnapshotWriter(const filesystem::Path::string_type &name, std::size_t capacity);
+    ~SharedSnapshotWriter();
+
+    /*
+     * Publishes the files; returns false if they don't fit the capacity (the first ones are published then)
+     * Parameters:
+     *  attributes  -   source of sizes and modify dates of the files; may be nullptr, then they are published
+     *                  as unknown
+     */
+    bool publish(const filesystem::Path &directory, const PathSet &files, const FileIndex *attributes = nullptr);
+
+private:
+    std::unique_ptr<SharedSnapshotRegion> region;
+
+
+    SharedSnapshotWriter(const SharedSnapshotWriter&) = delete;
+    SharedSnapshotWriter& operator=(const SharedSnapshotWriter&) = delete;
+};
+
+
+class SharedSnapshotReader
+{
+public:
+    struct File
+    {
+        filesystem::Path path;          // relative to the directory
+        bool hasAttributes = false;     // false if the writer doesn't know size and modify date of the file
+        std::uint64_t size = 0;
+        std::chrono::system_clock::time_point modifyDate;
+    };
+
+    struct Snapshot
+    {
+        std::uint64_t version = 0;      // count of publications; 0 if nothing has been published yet
+        std::chrono::system_clock::time_point publishTime;
+        bool complete = true;           // false if the files didn't fit the region
+        filesystem::Path directory;
+        std::vector<File> files;        // in order of the tracked files list
+    };
+
+
+    /*
+     * Opens the region for reading
+     *
+     * Throws:
+     *  std::system_error   -   the region doesn't exist or it has unknown layout
+     */
+    explicit SharedSnapshotReader(const filesystem::Path::string_type &name);
+    ~SharedSnapshotReader();
+
+    /* Returns version of the current snapshot; it's cheap, so it can be polled for changes */
+    std::uint64_t getVersion() const;
+
+    Snapshot read() const;
+
+private:
+    std::unique_ptr<SharedSnapshotRegion> region;
+
+
+    SharedSnapshotReader(const SharedSnapshotReader&) = delete;
+    SharedSnapshotReader& operator=(const SharedSnapshotReader&) = delete;
+};
+
+#endif // SHARED_SNAPSHOT_H
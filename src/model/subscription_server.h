@@ -0,0 +1,81 @@
+#ifndef SUBSCRIPTION_SERVER_H
+#define SUBSCRIPTION_SERVER_H
+
+#include "directory_watcher_worker.h"
+#include "path.h"
+#include <memory>       // std::unique_ptr
+#include <exception>    // std::exception_ptr
+#include <cstdint>      // std::uint32_t, std::uint64_t
+#include <cstddef>      // std::size_t
+
+
+/* SubscriptionServer is a DirectoryWatcherWorker which fans out change batches of the tracked directory
+ * to local processes connected to its named pipe, so many consumers share one watcher and one scan
+ *
+ * Protocol (message-mode pipe, native byte order, paths are UTF-16 without terminating zero):
+ *  subscriber -> server    the first message is a path prefix; only changes of paths starting with it are delivered
+ *                          (characters case is respected according to CASE_SENSITIVE_PATHS); empty means everything
+ *  server -> subscriber    messages start with MessageHeader:
+ *                           snapshot   -   uint32 directory length, the directory, then count of entries
+ *                                          (all matching tracked files as adds); it replaces the subscriber state
+ *                                          and covers all batches up to its sequence number
+ *                           batch      -   count of entries
+ *                          every entry is EntryHeader followed by the old path and the current path
+ *
+ * Every subscriber receives a snapshot after registration. If a subscriber doesn't read fast enough and its
+ * queued batches exceed maxQueuedBytes, the queue is dropped and a fresh snapshot is sent once the pipe
+ * is writable, so slow subscribers never block the watcher nor the others
+ * Pipe I/O is done by a built-in thread; at most maxSubscribers are served at once */
+class SubscriptionServer : public DirectoryWatcherWorker
+{
+public:
+    enum class MessageType : std::uint32_t { snapshot = 1, batch = 2 };
+
+    struct MessageHeader
+    {
+        MessageType type;
+        std::uint32_t count;        // of entries
+        std::uint64_t sequence;     // of the last batch which is included; increases with every batch
+    };
+
+    struct EntryHeader
+    {
+        std::uint8_t type;          // DirectoryWatcher::ChangeEntry::ChangeType
+        std::uint8_t reserved;
+        std::uint16_t oldPathLength;
+        std::uint16_t currentPathLength;
+        std::uint16_t reserved2;
+    };
+
+    static constexpr std::size_t defaultMaxQueuedBytes = 4 * 1024 * 1024;
+    static constexpr std::size_t maxSubscribers = 60;
+
+
+    /*
+     * Creates the pipe and starts accepting subscribers; a directory is tracked after run() call
+     * Parameters:
+     *  pipeName        -   for example, "\\.\pipe\dirwatch"
+     *  maxQueuedBytes  -   limit of batch messages queued per subscriber; the snapshot isn't counted
+     *                      and a single batch is accepted by an empty queue even if it exceeds the limit
+     *
+     * Throws:
+     *  std::system_error   -   the pipe can't be created
+     */
+    explicit SubscriptionServer(const filesystem::Path::string_type &pipeName,
+                                std::size_t maxQueuedBytes = defaultMaxQueuedBytes);
+    ~SubscriptionServer() override;
+
+    std::size_t getSubscribersCount() const;
+
+protected:
+    void onStart() override;
+    void onStop(std::exception_ptr exception) override;
+    void onBatch(DirectoryWatcher::ChangeBatch &&batch) override;
+
+private:
+    class Impl;
+
+    std::unique_ptr<Impl> pImpl;
+};
+
+#endif // SUBSCRIPTION_SERVER_H
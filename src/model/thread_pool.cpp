@@ -0,0 +1,88 @@
+#include "thread_pool.h"
+#include <utility>  // std::move
+
+
+ThreadPool::ThreadPool(std::size_t threadsCount)
+{
+    if (threadsCount == 0)
+    {
+        threadsCount = std::thread::hardware_concurrency();
+        threadsCount = (threadsCount == 0) ? 1 : threadsCount;
+    }
+
+    threads.reserve(threadsCount);
+
+    try
+    {
+        for (std::size_t i = 0; i < threadsCount; ++i)
+        {
+            threads.emplace_back([this]{ run(); });
+        }
+    }
+    catch (...)
+    {
+        stop();
+        throw;
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    stop();
+}
+
+
+std::size_t ThreadPool::getThreadsCount() const
+{
+    return threads.size();
+}
+
+
+void ThreadPool::stop()
+{
+    {
+        std::lock_guard<decltype(mutex)> lock(mutex);
+        needExit = true;
+    }
+
+    hasTasks.notify_all();
+
+    for (auto &thread : threads)
+    {
+        if (thread.joinable())
+        {
+            thread.join();
+        }
+    }
+}
+
+void ThreadPool::push(std::function<void()> &&task)
+{
+    {
+        std::lock_guard<decltype(mutex)> lock(mutex);
+        tasks.push(std::move(task));
+    }
+
+    hasTasks.notify_one();
+}
+
+void ThreadPool::run()
+{
+    std::unique_lock<decltype(mutex)> lock(mutex);
+
+    while (true)
+    {
+        hasTasks.wait(lock, [this]{ return (needExit || !tasks.empty()); });
+        if (tasks.empty())  // needExit and nothing to do
+        {
+            return;
+        }
+
+        auto task = std::move(tasks.front());
+        tasks.pop();
+
+        lock.unlock();
+        task();
+        lock.lock();
+    }
+}
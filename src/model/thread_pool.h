@@ -0,0 +1,64 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>       // std::future, std::packaged_task
+#include <functional>   // std::function
+#include <memory>       // std::make_shared
+#include <queue>        // tasks field
+#include <vector>       // threads field
+#include <utility>      // std::forward
+#include <cstddef>      // std::size_t
+
+
+/* ThreadPool is a fixed-size set of threads executing submitted tasks in FIFO order
+ * Destructor executes all already submitted tasks and then joins the threads
+ * submit is thread safe */
+class ThreadPool
+{
+public:
+    /*
+     * Parameters:
+     *  threadsCount    -   count of threads; 0 means count of hardware threads
+     */
+    explicit ThreadPool(std::size_t threadsCount);
+    ~ThreadPool();
+
+    /*
+     * Schedules execution of task() in one of the pool threads
+     * Returns future of the task result (exception thrown by the task is stored in the future)
+     */
+    template<typename Callable>
+    auto submit(Callable &&task) -> std::future<decltype(task())>
+    {
+        using Result = decltype(task());
+
+        const auto packagedTask = std::make_shared<std::packaged_task<Result()>>(std::forward<Callable>(task));
+        auto result = packagedTask->get_future();
+        push([packagedTask]{ (*packagedTask)(); });
+
+        return result;
+    }
+
+    std::size_t getThreadsCount() const;
+
+private:
+    std::mutex mutex;
+    std::condition_variable hasTasks;
+    std::queue<std::function<void()>> tasks;
+    std::vector<std::thread> threads;
+    bool needExit = false;
+
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /* Executes already submitted tasks and joins the threads */
+    void stop();
+    void push(std::function<void()> &&task);
+    void run();
+};
+
+#endif // THREAD_POOL_H
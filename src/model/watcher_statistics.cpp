@@ -0,0 +1,111 @@
+#include "watcher_statistics.h"
+#include <initializer_list>   // counters list in reset method
+
+
+std::uint64_t WatcherStatistics::Snapshot::getTotalEvents() const
+{
+    return addEvents + removeEvents + renameEvents + modifyEvents;
+}
+
+
+WatcherStatistics::WatcherStatistics()
+{
+    reset();
+}
+
+
+WatcherStatistics::Snapshot WatcherStatistics::snapshot() const
+{
+    Snapshot result;
+
+    result.takenAt = std::chrono::steady_clock::now();
+
+    result.addEvents = addEventsCount.load(std::memory_order_relaxed);
+    result.removeEvents = removeEventsCount.load(std::memory_order_relaxed);
+    result.renameEvents = renameEventsCount.load(std::memory_order_relaxed);
+    result.modifyEvents = modifyEventsCount.load(std::memory_order_relaxed);
+    result.suppressedModifyEvents = suppressedModifyEventsCount.load(std::memory_order_relaxed);
+
+    result.batches = batches.load(std::memory_order_relaxed);
+    result.overflowRescans = overflowRescans.load(std::memory_order_relaxed);
+    result.bytesRead = bytesRead.load(std::memory_order_relaxed);
+
+    result.lastBatchSize = lastBatchSize.load(std::memory_order_relaxed);
+    result.maxBatchSize = maxBatchSize.load(std::memory_order_relaxed);
+    result.trackedFiles = trackedFiles.load(std::memory_order_relaxed);
+    result.filesSetMemory = filesSetMemory.load(std::memory_order_relaxed);
+    result.changesMemory = changesMemory.load(std::memory_order_relaxed);
+
+    return result;
+}
+
+
+void WatcherStatistics::reset()
+{
+    for (Counter *counter : { &addEventsCount, &removeEventsCount, &renameEventsCount, &modifyEventsCount, &suppressedModifyEventsCount,
+                              &batches, &overflowRescans, &bytesRead,
+                              &lastBatchSize, &maxBatchSize,
+                              &trackedFiles, &filesSetMemory, &changesMemory })
+    {
+        counter->store(0, std::memory_order_relaxed);
+    }
+}
+
+
+void WatcherStatistics::addEvents(std::uint64_t add, std::uint64_t remove, std::uint64_t rename, std::uint64_t modify)
+{
+    addEventsCount.fetch_add(add, std::memory_order_relaxed);
+    removeEventsCount.fetch_add(remove, std::memory_order_relaxed);
+    renameEventsCount.fetch_add(rename, std::memory_order_relaxed);
+    modifyEventsCount.fetch_add(modify, std::memory_order_relaxed);
+}
+
+void WatcherStatistics::addBatch(std::uint64_t batchSize)
+{
+    batches.fetch_add(1, std::memory_order_relaxed);
+    lastBatchSize.store(batchSize, std::memory_order_relaxed);
+
+    // only the watching thread updates counters, so load + store is enough here
+    if (batchSize > maxBatchSize.load(std::memory_order_relaxed))
+    {
+        maxBatchSize.store(batchSize, std::memory_order_relaxed);
+    }
+}
+
+void WatcherStatistics::addSuppressedModifies(std::uint64_t count)
+{
+    suppressedModifyEventsCount.fetch_add(count, std::memory_order_relaxed);
+}
+
+void WatcherStatistics::addOverflowRescan()
+{
+    overflowRescans.fetch_add(1, std::memory_order_relaxed);
+}
+
+void WatcherStatistics::addBytesRead(std::uint64_t bytes)
+{
+    bytesRead.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void WatcherStatistics::setFilesSet(std::uint64_t trackedFiles, std::uint64_t filesSetMemory)
+{
+    this->trackedFiles.store(trackedFiles, std::memory_order_relaxed);
+    this->filesSetMemory.store(filesSetMemory, std::memory_order_relaxed);
+}
+
+void WatcherStatistics::setChangesMemory(std::uint64_t changesMemory)
+{
+    this->changesMemory.store(changesMemory, std::memory_order_relaxed);
+}
+
+
+double getEventsPerSecond(const WatcherStatistics::Snapshot &earlier, const WatcherStatistics::Snapshot &later)
+{
+    const std::chrono::duration<double> elapsed = later.takenAt - earlier.takenAt;
+    if (elapsed.count() <= 0)
+    {
+        return 0;
+    }
+
+    return static_cast<double>(later.getTotalEvents() - earlier.getTotalEvents()) / elapsed.count();
+}
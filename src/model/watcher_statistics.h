@@ -0,0 +1,79 @@
+#ifndef WATCHER_STATISTICS_H
+#define WATCHER_STATISTICS_H
+
+#include <atomic>       // std::atomic
+#include <chrono>       // std::chrono::steady_clock
+#include <cstdint>      // std::uint64_t
+
+
+/* WatcherStatistics is a set of always-on runtime counters of DirectoryWatcher
+ * Counters are updated by the watching thread and can be read from any thread without locking
+ * (see snapshot method). One instance can be shared between several sequential DirectoryWatchers
+ * (see DirectoryWatcher::Options), then event counters are accumulated over all of them */
+class WatcherStatistics
+{
+public:
+    /* Plain copy of all counters at the moment of snapshot() call */
+    struct Snapshot
+    {
+        std::chrono::steady_clock::time_point takenAt;
+
+        std::uint64_t addEvents;
+        std::uint64_t removeEvents;
+        std::uint64_t renameEvents;
+        std::uint64_t modifyEvents;
+        std::uint64_t suppressedModifyEvents;   // modify events dropped because file contents haven't changed
+
+        std::uint64_t batches;          // count of delivered change batches
+        std::uint64_t overflowRescans;  // count of system buffer overflows; each one but replayed is a listing
+        std::uint64_t bytesRead;        // total bytes of raw change notifications received from system
+
+        std::uint64_t lastBatchSize;    // count of changes in the last delivered batch
+        std::uint64_t maxBatchSize;
+        std::uint64_t trackedFiles;     // current size of the tracked files set
+        std::uint64_t filesSetMemory;   // approximate memory (in bytes) held by the tracked files set
+        std::uint64_t changesMemory;    // memory (in bytes) held by the change buffers
+
+        std::uint64_t getTotalEvents() const;
+    };
+
+
+    WatcherStatistics();
+
+    Snapshot snapshot() const;
+
+    /* Sets all counters to zero */
+    void reset();
+
+
+    /* Updaters; intended for use by DirectoryWatcher implementation */
+
+    void addEvents(std::uint64_t add, std::uint64_t remove, std::uint64_t rename, std::uint64_t modify);
+    void addBatch(std::uint64_t batchSize);
+    void addSuppressedModifies(std::uint64_t count);
+    void addOverflowRescan();
+    void addBytesRead(std::uint64_t bytes);
+    void setFilesSet(std::uint64_t trackedFiles, std::uint64_t filesSetMemory);
+    void setChangesMemory(std::uint64_t changesMemory);
+
+private:
+    using Counter = std::atomic<std::uint64_t>;
+
+    Counter addEventsCount, removeEventsCount, renameEventsCount, modifyEventsCount, suppressedModifyEventsCount;
+    Counter batches, overflowRescans, bytesRead;
+    Counter lastBatchSize, maxBatchSize;
+    Counter trackedFiles, filesSetMemory, changesMemory;
+
+
+    WatcherStatistics(const WatcherStatistics&) = delete;
+    WatcherStatistics& operator=(const WatcherStatistics&) = delete;
+};
+
+
+/*
+ * Returns average count of events per second between two snapshots
+ * Returns 0 if later snapshot wasn't taken after earlier one
+ */
+double getEventsPerSecond(const WatcherStatistics::Snapshot &earlier, const WatcherStatistics::Snapshot &later);
+
+#endif // WATCHER_STATISTICS_H
@@ -0,0 +1,330 @@
+#ifdef _WIN32
+
+#include "case_folding.h"
+#include <cstdint>      // std::uint16_t, std::uint64_t
+#include <cstring>      // std::memcpy
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+    #define CASE_FOLDING_X86
+    #include <immintrin.h>  // SSE2, AVX2 intrinsics
+
+    #ifdef _MSC_VER
+        #include <intrin.h>     // __cpuid, __cpuidex
+        #define TARGET_AVX2
+    #else
+        #define TARGET_AVX2 __attribute__((target("avx2")))
+    #endif
+#endif
+
+namespace filesystem
+{
+    namespace
+    {
+        static_assert(sizeof(wchar_t) == sizeof(std::uint16_t), "wchar_t is expected to be 16-bit wide");
+
+        using CompareFunction = int (*)(const wchar_t *s1, const wchar_t *s2, std::size_t n);
+
+        /* Folds hashBlockLength characters of src into dst */
+        using FoldBlockFunction = void (*)(const wchar_t *src, wchar_t *dst);
+
+        struct Kernels
+        {
+            CompareFunction compare;
+            FoldBlockFunction foldBlock;
+        };
+
+
+        constexpr std::size_t hashBlockLength = 16;     // characters per one hashing round (32 bytes)
+
+        constexpr std::uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+        constexpr std::uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+        constexpr std::uint64_t prime3 = 0x165667B19E3779F9ULL;
+
+
+        inline std::uint64_t rotateLeft(std::uint64_t value, unsigned bits)
+        {
+            return (value << bits) | (value >> (64 - bits));
+        }
+
+
+        /* ============================================ scalar ============================================ */
+
+        int compareScalar(const wchar_t *s1, const wchar_t *s2, std::size_t n)
+        {
+            for (; n > 0; --n, ++s1, ++s2)
+            {
+                const auto c1 = foldCase(*s1);
+                const auto c2 = foldCase(*s2);
+
+                if (c1 < c2)
+                {
+                    return -1;
+                }
+                if (c1 > c2)
+                {
+                    return 1;
+                }
+            }
+
+            return 0;
+        }
+
+        void foldBlockScalar(const wchar_t *src, wchar_t *dst)
+        {
+            for (std::size_t i = 0; i < hashBlockLength; ++i)
+            {
+                dst[i] = foldCase(src[i]);
+            }
+        }
+
+        /* Folds non-ASCII characters of the block which have been skipped by a vector kernel */
+        void foldBlockNonAscii(const wchar_t *src, wchar_t *dst)
+        {
+            for (std::size_t i = 0; i < hashBlockLength; ++i)
+            {
+                if (src[i] >= 0x80)
+                {
+                    dst[i] = foldCase(src[i]);
+                }
+            }
+        }
+
+#ifdef CASE_FOLDING_X86
+
+        /* ============================================= SSE2 ============================================= */
+
+        /* Folds 'A'..'Z' characters; all other characters are left as is */
+        inline __m128i foldAscii(__m128i chars)
+        {
+            const __m128i isUpper = _mm_and_si128(_mm_cmpgt_epi16(chars, _mm_set1_epi16(L'A' - 1)),
+                                                  _mm_cmplt_epi16(chars, _mm_set1_epi16(L'Z' + 1)));
+            return _mm_add_epi16(chars, _mm_and_si128(isUpper, _mm_set1_epi16(L'a' - L'A')));
+        }
+
+        inline bool isAscii(__m128i chars)
+        {
+            const __m128i nonAsciiBits = _mm_and_si128(chars, _mm_set1_epi16(static_cast<short>(0xFF80)));
+            return _mm_movemask_epi8(_mm_cmpeq_epi16(nonAsciiBits, _mm_setzero_si128())) == 0xFFFF;
+        }
+
+        int compareSse2(const wchar_t *s1, const wchar_t *s2, std::size_t n)
+        {
+            constexpr std::size_t step = sizeof(__m128i) / sizeof(wchar_t);
+
+            std::size_t i = 0;
+            for (; i + step <= n; i += step)
+            {
+                const __m128i chars1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s1 + i));
+                const __m128i chars2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s2 + i));
+
+                // non-ASCII block or a mismatch inside the block: let the scalar path find the first difference
+                if (!isAscii(_mm_or_si128(chars1, chars2))
+                    || (_mm_movemask_epi8(_mm_cmpeq_epi16(foldAscii(chars1), foldAscii(chars2))) != 0xFFFF))
+                {
+                    const int result = compareScalar(s1 + i, s2 + i, step);
+                    if (result != 0)
+                    {
+                        return result;
+                    }
+                }
+            }
+
+            return compareScalar(s1 + i, s2 + i, n - i);
+        }
+
+        void foldBlockSse2(const wchar_t *src, wchar_t *dst)
+        {
+            constexpr std::size_t step = sizeof(__m128i) / sizeof(wchar_t);
+            bool ascii = true;
+
+            for (std::size_t i = 0; i < hashBlockLength; i += step)
+            {
+                const __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), foldAscii(chars));
+                ascii = ascii && isAscii(chars);
+            }
+
+            if (!ascii)
+            {
+                foldBlockNonAscii(src, dst);
+            }
+        }
+
+
+        /* ============================================= AVX2 ============================================= */
+
+        TARGET_AVX2 inline __m256i foldAscii(__m256i chars)
+        {
+            const __m256i isUpper = _mm256_and_si256(_mm256_cmpgt_epi16(chars, _mm256_set1_epi16(L'A' - 1)),
+                                                     _mm256_cmpgt_epi16(_mm256_set1_epi16(L'Z' + 1), chars));
+            return _mm256_add_epi16(chars, _mm256_and_si256(isUpper, _mm256_set1_epi16(L'a' - L'A')));
+        }
+
+        TARGET_AVX2 inline bool isAscii(__m256i chars)
+        {
+            const __m256i nonAsciiBits = _mm256_and_si256(chars, _mm256_set1_epi16(static_cast<short>(0xFF80)));
+            return _mm256_testz_si256(nonAsciiBits, nonAsciiBits) != 0;
+        }
+
+        TARGET_AVX2 int compareAvx2(const wchar_t *s1, const wchar_t *s2, std::size_t n)
+        {
+            constexpr std::size_t step = sizeof(__m256i) / sizeof(wchar_t);
+
+            std::size_t i = 0;
+            for (; i + step <= n; i += step)
+            {
+                const __m256i chars1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s1 + i));
+                const __m256i chars2 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s2 + i));
+
+                if (!isAscii(_mm256_or_si256(chars1, chars2))
+                    || (_mm256_movemask_epi8(_mm256_cmpeq_epi16(foldAscii(chars1), foldAscii(chars2))) != -1))
+                {
+                    const int result = compareScalar(s1 + i, s2 + i, step);
+                    if (result != 0)
+                    {
+                        return result;
+                    }
+                }
+            }
+
+            return compareSse2(s1 + i, s2 + i, n - i);
+        }
+
+        TARGET_AVX2 void foldBlockAvx2(const wchar_t *src, wchar_t *dst)
+        {
+            static_assert(hashBlockLength * sizeof(wchar_t) == sizeof(__m256i), "hash block must fit AVX2 register");
+
+            const __m256i chars = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst), foldAscii(chars));
+
+            if (!isAscii(chars))
+            {
+                foldBlockNonAscii(src, dst);
+            }
+        }
+
+
+        bool isAvx2Supported()
+        {
+#ifdef _MSC_VER
+            int info[4];
+
+            __cpuid(info, 0);
+            if (info[0] < 7)
+            {
+                return false;
+            }
+
+            __cpuid(info, 1);
+            const bool osUsesXSave = (info[2] & (1 << 27)) != 0;
+            const bool avx = (info[2] & (1 << 28)) != 0;
+            if (!osUsesXSave || !avx || ((_xgetbv(0) & 0x6) != 0x6))    // XMM and YMM states are saved by OS
+            {
+                return false;
+            }
+
+            __cpuidex(info, 7, 0);
+            return (info[1] & (1 << 5)) != 0;
+#else
+            return __builtin_cpu_supports("avx2") != 0;
+#endif
+        }
+
+#endif  // #ifdef CASE_FOLDING_X86
+
+
+        Kernels selectKernels()
+        {
+#ifdef CASE_FOLDING_X86
+            if (isAvx2Supported())
+            {
+                return {compareAvx2, foldBlockAvx2};
+            }
+
+            return {compareSse2, foldBlockSse2};
+#else
+            return {compareScalar, foldBlockScalar};
+#endif
+        }
+
+        const Kernels& getKernels()
+        {
+            static const Kernels kernels = selectKernels();
+            return kernels;
+        }
+
+
+        /* Four independent lanes keep several multiplications in flight at once */
+        class Hasher
+        {
+        public:
+            void update(const wchar_t *foldedBlock)
+            {
+                std::uint64_t words[4];
+                static_assert(sizeof(words) == hashBlockLength * sizeof(wchar_t), "hash block size mismatch");
+                std::memcpy(words, foldedBlock, sizeof(words));
+
+                for (std::size_t i = 0; i < 4; ++i)
+                {
+                    lanes[i] = rotateLeft(lanes[i] + words[i] * prime2, 31) * prime1;
+                }
+            }
+
+            std::uint64_t finish(std::size_t length) const
+            {
+                std::uint64_t result = rotateLeft(lanes[0], 1) + rotateLeft(lanes[1], 7)
+                                       + rotateLeft(lanes[2], 12) + rotateLeft(lanes[3], 18);
+                result += static_cast<std::uint64_t>(length);
+
+                result ^= result >> 33;
+                result *= prime2;
+                result ^= result >> 29;
+                result *= prime3;
+                result ^= result >> 32;
+
+                return result;
+            }
+
+        private:
+            std::uint64_t lanes[4]{ prime1 + prime2, prime2, 0, 0 - prime1 };
+        };
+    }
+
+
+    int compareIgnoreCase(const wchar_t *s1, const wchar_t *s2, std::size_t n)
+    {
+        return getKernels().compare(s1, s2, n);
+    }
+
+
+    std::size_t hashIgnoreCase(const wchar_t *s, std::size_t n)
+    {
+        const FoldBlockFunction foldBlock = getKernels().foldBlock;
+        wchar_t folded[hashBlockLength];
+        Hasher hasher;
+
+        std::size_t i = 0;
+        for (; i + hashBlockLength <= n; i += hashBlockLength)
+        {
+            foldBlock(s + i, folded);
+            hasher.update(folded);
+        }
+
+        if (i < n)
+        {
+            wchar_t tail[hashBlockLength]{};
+            std::memcpy(tail, s + i, (n - i) * sizeof(wchar_t));
+
+            foldBlockScalar(tail, folded);
+            hasher.update(folded);
+        }
+
+        return static_cast<std::size_t>(hasher.finish(n));
+    }
+}
+
+#else   // #ifdef _WIN32
+
+#error "Macro _WIN32 isn't defined. Check target OS (required Windows) for this build"
+
+#endif  // #ifdef _WIN32
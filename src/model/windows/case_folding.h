@@ -0,0 +1,43 @@
+#ifdef _WIN32
+
+#ifndef CASE_FOLDING_H
+#define CASE_FOLDING_H
+
+#include <cstddef>      // std::size_t
+#include <cwctype>      // std::towlower
+
+namespace filesystem
+{
+    /* Returns lower case of c; ASCII characters are folded without std::towlower call */
+    inline wchar_t foldCase(wchar_t c)
+    {
+        if (c < 0x80)
+        {
+            return (static_cast<unsigned>(c - L'A') < 26u) ? static_cast<wchar_t>(c + (L'a' - L'A')) : c;
+        }
+
+        return static_cast<wchar_t>(std::towlower(c));
+    }
+
+    /*
+     * Case-insensitive comparison of first n characters of s1 and s2
+     * Returns negative value, 0 or positive value if s1 is less, equal or greater than s2 correspondingly
+     * Runs of ASCII characters are compared by SSE2/AVX2 kernels (selected at runtime)
+     */
+    int compareIgnoreCase(const wchar_t *s1, const wchar_t *s2, std::size_t n);
+
+    /*
+     * Case-insensitive hash of first n characters of s
+     * Strings which are equal by compareIgnoreCase have equal hashes
+     * Runs of ASCII characters are folded by SSE2/AVX2 kernels (selected at runtime)
+     */
+    std::size_t hashIgnoreCase(const wchar_t *s, std::size_t n);
+}
+
+#endif  // CASE_FOLDING_H
+
+#else   // #ifdef _WIN32
+
+#error "Macro _WIN32 isn't defined. Check target OS (required Windows) for this build"
+
+#endif  // #ifdef _WIN32
@@ -1,7 +1,7 @@
 #ifdef _WIN32
 
 #include "../path.h"
-#include <cwctype>      //std::towlower
+#include "case_folding.h"
 
 namespace filesystem
 {
@@ -18,12 +18,12 @@ namespace filesystem
 
     bool CICharTraits::eq(const char_type &c1, const char_type &c2)
     {
-        return Base::eq(std::towlower(c1), std::towlower(c2));
+        return Base::eq(foldCase(c1), foldCase(c2));
     }
 
     bool CICharTraits::lt(const char_type &c1, const char_type &c2)
     {
-        return Base::lt(std::towlower(c1), std::towlower(c2));
+        return Base::lt(foldCase(c1), foldCase(c2));
     }
 
 
@@ -40,22 +40,7 @@ namespace filesystem
 
     int CICharTraits::compare(const char_type *s1, const char_type *s2, std::size_t n)
     {
-        for (; n > 0; --n)
-        {
-            const auto c1 = std::towlower(*s1);
-            const auto c2 = std::towlower(*s2);
-
-            if (c1 < c2)
-            {
-                return -1;
-            }
-            if (c1 > c2)
-            {
-                return 1;
-            }
-        }
-
-        return 0;
+        return compareIgnoreCase(s1, s2, n);
     }
 
 
@@ -67,8 +52,14 @@ namespace filesystem
 
     const CICharTraits::char_type* CICharTraits::find(const char_type *s, std::size_t n, const char_type &a)
     {
-        const auto c = std::towlower(a);
-        for (; (n > 0) && (std::towlower(*s) != c); --n);
+        const auto c = foldCase(a);
+        for (; n > 0; --n, ++s)
+        {
+            if (foldCase(*s) == c)
+            {
+                return s;
+            }
+        }
 
         return nullptr;
     }
@@ -100,6 +91,12 @@ namespace filesystem
     {
         return Base::not_eof(e);
     }
+
+
+    CICharTraits::char_type CICharTraits::toLower(const char_type &c)
+    {
+        return foldCase(c);
+    }
 }
 
 #else   // #ifdef _WIN32
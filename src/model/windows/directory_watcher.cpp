@@ -1,432 +1,2093 @@
 #ifdef _WIN32
 
 #include "../directory_watcher.h"
-#include "../ordered_set.h"
+#include "../path_set.h"
+#include "../shared_snapshot.h"
+#include "../path_filter.h"
+#include "../file_operations.h"
+#include "../thread_pool.h"
 #include "win_extend_path_limit.h"
 #include <utility>                  // std::move, etc.
 #include <memory>                   // std::unique_ptr, etc.
-#include <stdexcept>                // std::runtime_error, std::out_of_range
+#include <stdexcept>                // std::runtime_error
 #include <system_error>             // std::system_error
 #include <atomic>                   // std::atomic_bool
-#include <type_traits>              // std::aligned_storage
-#include <stack>                    // std::stack
+#include <chrono>                   // std::chrono::steady_clock
 #include <iterator>                 // std::distance
+#include <algorithm>                // std::min, std::max
+#include <limits>                   // std::numeric_limits
+#include <unordered_map>            // fingerprints field
+#include <future>                   // std::future
+#include <vector>                   // fingerprint tasks, files missing from the listing
+#include <mutex>                    // std::mutex, std::lock_guard
+#include <functional>               // std::function
+#include <exception>                // std::exception_ptr
 #include <cstring>                  // std::memset
 #include <cstddef>                  // std::size_t
 #include <cstdint>                  // std::int8_t
-#include <cwchar>                   // std::wcsncmp
+#include <cwchar>                   // std::wcsncmp, std::wcslen
 #include <Windows.h>                // WinAPI
 
 
 /*
  * Work scheme:
- * 1. Full directory scanning (see fullFilesReupdate method)
+ * 1. Full directory scanning by chunks (see startScan method); every chunk is notified separately
  * 2. Notify
- * 3. ReadDirectoryChanges (see updateChangesList method)
+ * 3. ReadDirectoryChanges (see armWakeup method) and waiting for its completion
  * 4. if p.3 interrupted (see Impl::stopWatch method) -> loop break
- * 5. if system buffer from p.3 overflows (see refillFilesList method)
- *      -> full directory rescanning (see fullFilesReupdate method)
+ * 5. Collecting of the read results (see collectBatch method); the next read is started before parsing,
+ *    so the system buffer is drained while the batch is handled
+ *      if system buffer from p.3 overflows -> the directory listing is compared with the tracked files list
+ *      (see recoverFromOverflow method)
  * 6. back to p.2
+ *
+ * If the filesystem doesn't support change notifications (or polling is requested by options),
+ * p.3 waits for the poll interval and p.5 compares the directory listing with the tracked files list
+ * (see poll method)
+ *
+ * If an event source is set (see DirectoryWatcher::Options::eventSource), p.3 waits for its next buffer instead
+ * of ReadDirectoryChanges and p.5 parses that buffer
+ *
+ * Steps 3 and 5 never block, so they are driven either by the loop of startWatch method or by a wait
+ * of the system thread pool (see nextBatch method)
  */
 
 
 class DirectoryWatcher::Impl
 {
 public:
-    Impl(DirectoryWatcher &parent, const filesystem::Path &path)
-        : parent(parent), path(path), searchPath(createSearchPath()),
-          dirHandle(createDirHandle()),
+    Impl(DirectoryWatcher &parent, const filesystem::Path &path, const DirectoryWatcher::Options &options)
+        : parent(parent), path(path), searchPath(createSearchPath(this->path)),
+          dirHandle(createDirHandle(this->path)),
           ioEvent(createEvent()), breakEvent(createEvent()),
-          winAPIChanges(std::make_unique<WinAPIChangesBuffer>()),
+          changesBufferSize(options.eventSource ? maxChangesBufferSize : minChangesBufferSize),
+          targetChangesBufferSize(changesBufferSize),
+          winAPIChanges(createChangesBuffer(changesBufferSize)),
+          readBuffer(createChangesBuffer(changesBufferSize)),
+          batchPool(std::make_shared<DirectoryWatcher::ChangeBatch::Pool>()),
+          filter(options.filter),
+          statistics(createStatistics(options)),
+          fingerprintPool(createFingerprintPool(options)),
+          filesIndex(options.indexFiles ? std::make_unique<FileIndex>() : nullptr),
+          directoryAggregates(options.aggregateDirectories ? std::make_unique<DirectoryAggregates>() : nullptr),
+          pathSearchIndex(options.indexPaths ? std::make_unique<PathSearchIndex>() : nullptr),
+          sharedSnapshot(createSharedSnapshot(options)),
+          publishInterval(options.sharedSnapshotInterval),
+          eventSource(options.eventSource),
+          eventRecorder(options.eventRecorder),
+          selfChanges(options.selfChanges),
+          requestedBackend(options.eventSource ? DirectoryWatcher::Backend::notifications : options.backend),
+          backend((requestedBackend == DirectoryWatcher::Backend::polling) ? DirectoryWatcher::Backend::polling
+                                                                           : DirectoryWatcher::Backend::notifications),
+          minPollInterval(std::max(options.minPollInterval, std::chrono::milliseconds(1))),
+          maxPollInterval(std::max(options.maxPollInterval, minPollInterval)),
+          pollInterval(minPollInterval),
+          scanChunkSize((options.scanChunkSize == 0) ? std::numeric_limits<std::size_t>::max() : options.scanChunkSize),
           needBreak(false)
     {
     }
 
-    Impl(DirectoryWatcher &parent, filesystem::Path &&path)
-        : parent(parent), path(path), searchPath(createSearchPath()),
-          dirHandle(createDirHandle()),
+    Impl(DirectoryWatcher &parent, filesystem::Path &&path, const DirectoryWatcher::Options &options)
+        : parent(parent), path(path), searchPath(createSearchPath(this->path)),
+          dirHandle(createDirHandle(this->path)),
           ioEvent(createEvent()), breakEvent(createEvent()),
-          winAPIChanges(std::make_unique<WinAPIChangesBuffer>()),
+          changesBufferSize(options.eventSource ? maxChangesBufferSize : minChangesBufferSize),
+          targetChangesBufferSize(changesBufferSize),
+          winAPIChanges(createChangesBuffer(changesBufferSize)),
+          readBuffer(createChangesBuffer(changesBufferSize)),
+          batchPool(std::make_shared<DirectoryWatcher::ChangeBatch::Pool>()),
+          filter(options.filter),
+          statistics(createStatistics(options)),
+          fingerprintPool(createFingerprintPool(options)),
+          filesIndex(options.indexFiles ? std::make_unique<FileIndex>() : nullptr),
+          directoryAggregates(options.aggregateDirectories ? std::make_unique<DirectoryAggregates>() : nullptr),
+          pathSearchIndex(options.indexPaths ? std::make_unique<PathSearchIndex>() : nullptr),
+          sharedSnapshot(createSharedSnapshot(options)),
+          publishInterval(options.sharedSnapshotInterval),
+          eventSource(options.eventSource),
+          eventRecorder(options.eventRecorder),
+          selfChanges(options.selfChanges),
+          requestedBackend(options.eventSource ? DirectoryWatcher::Backend::notifications : options.backend),
+          backend((requestedBackend == DirectoryWatcher::Backend::polling) ? DirectoryWatcher::Backend::polling
+                                                                           : DirectoryWatcher::Backend::notifications),
+          minPollInterval(std::max(options.minPollInterval, std::chrono::milliseconds(1))),
+          maxPollInterval(std::max(options.maxPollInterval, minPollInterval)),
+          pollInterval(minPollInterval),
+          scanChunkSize((options.scanChunkSize == 0) ? std::numeric_limits<std::size_t>::max() : options.scanChunkSize),
           needBreak(false)
     {
     }
 
 
+    ~Impl()
+    {
+        HANDLE wait;
+        {
+            std::lock_guard<decltype(asyncWaitMutex)> lock(asyncWaitMutex);
+            wait = asyncWait;
+            asyncWait = NULL;
+        }
+
+        if (wait != NULL)
+        {
+            // waits for the callback completion
+            UnregisterWaitEx(wait, INVALID_HANDLE_VALUE);
+        }
+
+        cancelWakeup();
+        cancelRead();
+    }
+
+
     void startWatch()
     {
-        fullFilesReupdate();
-        notify();
+        if (!started)
+        {
+            startScan();
+        }
+        else if (!needBreak)   // resuming
+        {
+            collectSnapshot();
+            notify();
+        }
 
         while (!needBreak)
         {
-            updateChangesList();
-            updateFilesList();
+            armWakeup(false);
 
-            if (needBreak)
-            {                
-                break;
+            HANDLE handles[2]{ breakEvent.getHandle(), ioEvent.getHandle() };
+            static_assert(2 <= MAXIMUM_WAIT_OBJECTS, "count of wait objects > MAXIMUM_WAIT_OBJECTS");
+            switch (WaitForMultipleObjects(2, handles, FALSE, getWaitTimeout()))
+            {
+                case WAIT_FAILED:
+                    throw std::system_error(GetLastError(), std::system_category());
+                case WAIT_OBJECT_0:     // needBreak is set
+                    continue;
+                case WAIT_OBJECT_0 + 1:
+                case WAIT_TIMEOUT:
+                    break;
+                default:
+                    throw std::runtime_error("Unexpected result of a system call");
             }
 
-            notify();
+            if (collectBatch() && !needBreak)
+            {
+                notify();
+            }
         }
 
+        // the read stays pending while the watcher is stopped, so changes made meanwhile aren't lost
         parent.handler = nullptr;
         needBreak.store(false);
+
+        if (!ResetEvent(breakEvent.getHandle()))
+        {
+            throw std::system_error(GetLastError(), std::system_category());
+        }
+    }
+
+    void retarget(filesystem::Path &&newPath)
+    {
+        // the new directory is opened at first, so the watcher stays intact on failure
+        const HANDLE newDirHandle = createDirHandle(newPath);
+        cancelWakeup();
+        cancelRead();
+        dirHandle.reset(newDirHandle);
+
+        path = std::move(newPath);
+        searchPath = createSearchPath(path);
+
+        // clearing keeps the allocated memory for the new directory
+        changes.clear();
+        files.clear();
+        fingerprints.clear();
+        fileStates.clear();
+        scannedStates.clear();
+        if (filesIndex)
+        {
+            filesIndex->clear();
+        }
+        if (directoryAggregates)
+        {
+            directoryAggregates->clear();
+        }
+        if (pathSearchIndex)
+        {
+            pathSearchIndex->clear();
+        }
+        hasPendingRename = false;
+        scanEnumerator.reset();
+        isScanning = false;
+        isReconciling = false;
+        reconcilePresent.clear();
+        reconcileRemoved.clear();
+        started = false;
+        nextPublishTime = Clock::time_point();
+        isSnapshotStale = false;
+
+        backend = (requestedBackend == DirectoryWatcher::Backend::polling) ? DirectoryWatcher::Backend::polling
+                                                                          : DirectoryWatcher::Backend::notifications;
+        pollInterval = minPollInterval;
+        directoryWriteTime = 0;
+        lastListingTime = Clock::time_point();
+
+        pendingBatch = DirectoryWatcher::ChangeBatch();
+        pendingOffset = 0;
+        needBreak.store(false);
+
+        if (!ResetEvent(ioEvent.getHandle()) || !ResetEvent(breakEvent.getHandle()))
+        {
+            throw std::system_error(GetLastError(), std::system_category());
+        }
     }
 
     void stopWatch()
     {
         needBreak.store(true);
-        if (!SetEvent(breakEvent.getHandle()))
+
+        // ioEvent wakes up an awaiting of nextBatch
+        if (!SetEvent(breakEvent.getHandle()) || !SetEvent(ioEvent.getHandle()))
         {
             throw std::system_error(GetLastError(), std::system_category());
         }
     }
 
 
-    const filesystem::Path& getPath() const
+    /* Returns true if a non-empty batch is collected or watching is stopped; never blocks */
+    bool tryNextBatch()
     {
-        return path;
+        if (needBreak)
+        {
+            changes.clear();
+            return true;
+        }
+
+        if (!started)
+        {
+            startScan();
+        }
+
+        armWakeup(false);
+        return collectBatch() && !changes.empty();
     }
 
+    /* Calls continuation from a thread of the system thread pool when tryNextBatch succeeds */
+    void awaitNextBatch(std::function<void()> &&continuation, std::exception_ptr &error)
+    {
+        asyncContinuation = std::move(continuation);
+        asyncError = &error;
+        registerAsyncWait();
+    }
 
-private:
-    class RAIIHandle
+    HANDLE getReadinessHandle()
     {
-    public:
-        RAIIHandle(HANDLE handle) : handle(handle) {}
-        ~RAIIHandle() { CloseHandle(handle); handle = INVALID_HANDLE_VALUE; }
+        if (!started && !SetEvent(ioEvent.getHandle()))
+        {
+            throw std::system_error(GetLastError(), std::system_category());
+        }
 
-        HANDLE getHandle() const { return handle; }
+        return ioEvent.getHandle();
+    }
 
-    private:
-        HANDLE handle;
-    };
+    bool processPending(const std::function<void(ChangeIterator, ChangeIterator)> &changeHandler,
+                        std::size_t maxEvents)
+    {
+        if (pendingOffset == pendingBatch.size())
+        {
+            pendingBatch = DirectoryWatcher::ChangeBatch();
+            pendingOffset = 0;
+
+            if (tryNextBatch())
+            {
+                pendingBatch = takeBatch();
+            }
+        }
 
-    static constexpr std::size_t winAPIChangesBufferSize = 64 * 1024;   //64 KB is network limitation
-    using WinAPIChangesBuffer = typename std::aligned_storage<winAPIChangesBufferSize, alignof(DWORD)>::type;
+        if (pendingOffset != pendingBatch.size())
+        {
+            const std::size_t remaining = pendingBatch.size() - pendingOffset;
+            const std::size_t count = ((maxEvents == 0) || (maxEvents > remaining)) ? remaining : maxEvents;
 
+            const auto begin = pendingBatch.begin() + pendingOffset;
+            pendingOffset += count;
+            changeHandler(begin, begin + count);
 
-    DirectoryWatcher &parent;
-    const filesystem::Path path;
-    const filesystem::Path searchPath;
-    const RAIIHandle dirHandle;
-    const RAIIHandle ioEvent, breakEvent;
-    const std::unique_ptr<WinAPIChangesBuffer> winAPIChanges;
-    DirectoryWatcher::ChangeContainer changes;
-    OrderedSet<filesystem::Path> files;
-    std::atomic_bool needBreak;
+            if (pendingOffset != pendingBatch.size())
+            {
+                return true;
+            }
+        }
+
+        if (needBreak)
+        {
+            return false;
+        }
 
+        // the handle must become signaled by deadlines too, because the caller waits for it only
+        armWakeup(true);
+        return false;
+    }
 
-    static inline filesystem::Path getPathFromRaw(const WCHAR *path, DWORD sizeInBytes)
+    DirectoryWatcher::ChangeBatch takeBatch()
     {
-        return {path, path + sizeInBytes / sizeof(WCHAR)};
+        updateStatistics();
+
+        publishSnapshot();
+
+        // no handler is called, so the batch is delivered when it's taken
+        recordDeliveryLatencies(Clock::now());
+
+        DirectoryWatcher::ChangeBatch result(std::move(changes), batchPool);
+        changes = batchPool->acquire();
+
+        return result;
     }
 
 
-    HANDLE createDirHandle()
+    const filesystem::Path& getPath() const
     {
-        const HANDLE result = CreateFileW(MAKE_EXTENDED_PATH(path).c_str(),
-                                          FILE_LIST_DIRECTORY,
-                                          FILE_SHARE_DELETE | FILE_SHARE_READ | FILE_SHARE_WRITE,
-                                          NULL,
-                                          OPEN_EXISTING,
-                                          FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED,
-                                          NULL
-                                         );
+        return path;
+    }
 
-        if (result == INVALID_HANDLE_VALUE)
+    bool isTrackingPath() const
+    {
+        BY_HANDLE_FILE_INFORMATION watched;
+        if (!GetFileInformationByHandle(dirHandle.getHandle(), &watched))
         {
-            throw std::system_error(GetLastError(), std::system_category());
+            return false;
         }
 
-        return result;
+        // no access rights are requested, so the directory is only identified
+        const HANDLE current = CreateFileW(MAKE_EXTENDED_PATH(path).c_str(),
+                                           0,
+                                           FILE_SHARE_DELETE | FILE_SHARE_READ | FILE_SHARE_WRITE,
+                                           NULL,
+                                           OPEN_EXISTING,
+                                           FILE_FLAG_BACKUP_SEMANTICS,
+                                           NULL
+                                          );
+        if (current == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+        const RAIIHandle currentGuard(current);
+
+        BY_HANDLE_FILE_INFORMATION found;
+        if (!GetFileInformationByHandle(current, &found))
+        {
+            return false;
+        }
+
+        return (watched.dwVolumeSerialNumber == found.dwVolumeSerialNumber) &&
+               (watched.nFileIndexHigh == found.nFileIndexHigh) && (watched.nFileIndexLow == found.nFileIndexLow);
     }
 
-    HANDLE createEvent()
+
+    const FileIndex* getFilesIndex() const
     {
-        const HANDLE result = CreateEvent(NULL, TRUE, FALSE, NULL);
+        return filesIndex.get();
+    }
 
-        if (result == NULL)
-        {
-            throw std::system_error(GetLastError(), std::system_category());
-        }
+    const DirectoryAggregates* getDirectoryAggregates() const
+    {
+        return directoryAggregates.get();
+    }
 
-        return result;
+    const PathSearchIndex* getPathSearchIndex() const
+    {
+        return pathSearchIndex.get();
     }
 
 
-    filesystem::Path createSearchPath()
+    DirectoryWatcher::LatencyStats getLatencyStats() const
     {
-        filesystem::Path result = path / L"*";
-        return std::move(MAKE_EXTENDED_PATH(result));
+        return {parseLatency.summarize(), updateLatency.summarize(), dispatchLatency.summarize(),
+                handlerLatency.summarize(), totalLatency.summarize()};
     }
 
+    WatcherStatistics::Snapshot getStatistics() const
+    {
+        return statistics->snapshot();
+    }
 
-    void fullFilesReupdate()
+    DirectoryWatcher::Backend getBackend() const
     {
-        changes.clear();
-        generateAllFilesRemoved();
-        refillFilesList();
-        generateAllFilesAdded();
+        return backend.load();
     }
 
-    void generateAllFilesRemoved()
+
+private:
+    class RAIIHandle
+    {
+    public:
+        RAIIHandle(HANDLE handle) : handle(handle) {}
+        ~RAIIHandle() { CloseHandle(handle); handle = INVALID_HANDLE_VALUE; }
+
+        HANDLE getHandle() const { return handle; }
+        void reset(HANDLE newHandle) { CloseHandle(handle); handle = newHandle; }
+
+    private:
+        HANDLE handle;
+    };
+
+    using Clock = std::chrono::steady_clock;
+
+    /* Points of time passed by the current changes batch */
+    struct BatchTimestamps
+    {
+        Clock::time_point read;     // kernel read completion
+        Clock::time_point parsed;
+        Clock::time_point updated;  // tracked files list update completion
+    };
+
+    /* Attributes of a file which are compared by polling */
+    struct FileState
     {
-        ChangeEntry::IndexType i = 0;
-        for (const auto &file : files)
+        std::uint64_t size;
+        std::uint64_t writeTime;
+        bool isDirectory;
+
+        bool operator!=(const FileState &right) const
         {
-            changes.emplace_back(ChangeEntry(ChangeEntry::ChangeType::remove, i++,
-                                             file, filesystem::Path(), false));
+            return (size != right.size) || (writeTime != right.writeTime) || (isDirectory != right.isDirectory);
         }
-    }
+    };
 
-    void refillFilesList()
+    /* Resumable enumeration of the directory files which are accepted by the filter */
+    class DirectoryEnumerator
     {
-        files.clear();
-        WIN32_FIND_DATAW findFileData;
-
-        auto hFind = FindFirstFileW(searchPath.getPathString().c_str(), &findFileData);
-        if (hFind == INVALID_HANDLE_VALUE)
+    public:
+        DirectoryEnumerator(const filesystem::Path &searchPath, const PathFilter &filter)
+            : filter(filter)
         {
-            const auto err = GetLastError();
-            if (err != ERROR_FILE_NOT_FOUND)
+            // basic info level skips short names; large fetch reduces count of round trips to network shares
+            hFind = FindFirstFileExW(searchPath.getPathString().c_str(), FindExInfoBasic, &findFileData,
+                                     FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+            if (hFind == INVALID_HANDLE_VALUE)
             {
-                throw std::system_error(err, std::system_category());
+                const auto err = GetLastError();
+                if (err != ERROR_FILE_NOT_FOUND)
+                {
+                    throw std::system_error(err, std::system_category());
+                }
             }
+        }
 
-            return;
+        ~DirectoryEnumerator()
+        {
+            close();
         }
 
-        try
+        /* Returns nullptr if there are no more files */
+        const WIN32_FIND_DATAW* next()
         {
-            do
+            while (hFind != INVALID_HANDLE_VALUE)
             {
-                if (std::wcsncmp(findFileData.cFileName, L".", 2) == 0)
+                if (!hasCurrent && (FindNextFileW(hFind, &findFileData) == 0))
                 {
-                    continue;
+                    const auto err = GetLastError();
+                    close();
+
+                    if ((err != ERROR_SUCCESS) && (err != ERROR_NO_MORE_FILES))     // system buffer overflows
+                    {
+                        throw std::system_error(err, std::system_category());
+                    }
+
+                    return nullptr;
                 }
-                if (std::wcsncmp(findFileData.cFileName, L"..", 3) == 0)
+
+                hasCurrent = false;
+                if (isAccepted())
                 {
-                    continue;
+                    return &findFileData;
                 }
-
-                files.emplace_back(findFileData.cFileName);
             }
-            while (FindNextFileW(hFind, &findFileData) != 0);
 
-            const auto err = GetLastError();
-            if ((err != ERROR_SUCCESS) && (err != ERROR_NO_MORE_FILES))     // system buffer overflows
+            return nullptr;
+        }
+
+    private:
+        const PathFilter &filter;
+        HANDLE hFind;
+        WIN32_FIND_DATAW findFileData;
+        bool hasCurrent = true;     // findFileData holds a file which isn't returned yet
+
+
+        DirectoryEnumerator(const DirectoryEnumerator&) = delete;
+        DirectoryEnumerator& operator=(const DirectoryEnumerator&) = delete;
+
+        bool isAccepted() const
+        {
+            if ((std::wcsncmp(findFileData.cFileName, L".", 2) == 0) || (std::wcsncmp(findFileData.cFileName, L"..", 3) == 0))
             {
-                throw std::system_error(err, std::system_category());
+                return false;
             }
 
-            FindClose(hFind);
+            return filter.isAccepted(findFileData.cFileName, std::wcslen(findFileData.cFileName),
+                                     (findFileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0);
         }
-        catch (...)
+
+        void close()
         {
-            FindClose(hFind);
-            throw;
+            if (hFind != INVALID_HANDLE_VALUE)
+            {
+                FindClose(hFind);
+                hFind = INVALID_HANDLE_VALUE;
+            }
         }
-    }
+    };
 
-    void generateAllFilesAdded()
+    /* Name of renamed file; path is empty if the file isn't tracked */
+    struct RenameName
     {
-        ChangeEntry::IndexType i = 0;
-        for (const auto &file : files)
-        {
-            changes.emplace_back(ChangeEntry(ChangeEntry::ChangeType::add, i++,
-                                             filesystem::Path(), file, false));
-        }
+        bool tracked;
+        filesystem::Path path;
+    };
+
+
+    /*
+     * The system buffer of a directory handle has the size of the first read and keeps it until the handle is closed,
+     * so the buffer grows (see adaptChangesBufferSize method) only when the handle is reopened after an overflow
+     */
+    static constexpr DWORD minChangesBufferSize = 64 * 1024;    // 64 KB is network limitation
+    static constexpr DWORD maxChangesBufferSize = 1024 * 1024;
+
+    /* How long the old name of a renamed file waits for the new one when they arrive in different buffers */
+    static constexpr std::chrono::milliseconds renamePairTimeout{50};
+    using ChangesBuffer = std::unique_ptr<DWORD[]>;     // DWORD aligned, as FILE_NOTIFY_INFORMATION requires
+
+
+    DirectoryWatcher &parent;
+    filesystem::Path path;
+    filesystem::Path searchPath;
+    RAIIHandle dirHandle;
+    const RAIIHandle ioEvent, breakEvent;
+    DWORD changesBufferSize;
+    DWORD targetChangesBufferSize;      // the size for the next reopening of the directory handle
+    DWORD changesBufferSizeLimit = maxChangesBufferSize;
+    ChangesBuffer winAPIChanges;        // the buffer which is parsed
+    ChangesBuffer readBuffer;           // the buffer of the pending read
+    std::uint64_t syncWriteTime = 0;    // system time before which all changes have been read (FILETIME units)
+    DirectoryWatcher::ChangeContainer changes;
+    const std::shared_ptr<DirectoryWatcher::ChangeBatch::Pool> batchPool;  // storage for the next changes
+    RenameName pendingRenameOldName;        // the old name which is waiting for the new one
+    Clock::time_point pendingRenameDeadline;
+    bool hasPendingRename = false;
+    const PathFilter filter;
+    PathSet files;
+    const std::shared_ptr<WatcherStatistics> statistics;
+    const std::unique_ptr<ThreadPool> fingerprintPool;     // nullptr if contents aren't fingerprinted
+    std::unordered_map<filesystem::Path, ChangeEntry::Fingerprint> fingerprints;
+    const std::unique_ptr<FileIndex> filesIndex;           // nullptr if files aren't indexed
+    const std::unique_ptr<DirectoryAggregates> directoryAggregates;    // nullptr if directories aren't aggregated
+    const std::unique_ptr<PathSearchIndex> pathSearchIndex;             // nullptr if paths aren't indexed
+    const std::unique_ptr<SharedSnapshotWriter> sharedSnapshot;         // nullptr if files aren't published
+    const std::chrono::milliseconds publishInterval;
+    Clock::time_point nextPublishTime;
+    bool isSnapshotStale = false;           // a publication has been skipped by publishInterval
+    const std::shared_ptr<ChangeEventSource> eventSource;       // nullptr if changes are read from the system
+    const std::shared_ptr<ChangeEventRecorder> eventRecorder;   // nullptr if changes aren't recorded
+    const std::shared_ptr<SelfChangeRegistry> selfChanges;      // nullptr if changes aren't tagged
+    std::unordered_map<filesystem::Path, FileState> scannedStates;     // of files added by the current scan chunk
+    const DirectoryWatcher::Backend requestedBackend;
+    std::atomic<DirectoryWatcher::Backend> backend;     // the one in use: notifications or polling
+    std::unordered_map<filesystem::Path, FileState> fileStates;    // filled by polling only
+    const std::chrono::milliseconds minPollInterval, maxPollInterval;
+    std::chrono::milliseconds pollInterval;
+    std::uint64_t directoryWriteTime = 0;
+    Clock::time_point lastListingTime;
+    Clock::time_point nextPollTime;
+    OVERLAPPED overlapInfo;
+    bool isReadPending = false;
+    bool started = false;                   // the initial scan has been started
+    bool isSnapshotCollected = false;       // the current batch is the resume snapshot (see collectSnapshot)
+    const std::size_t scanChunkSize;
+    std::unique_ptr<DirectoryEnumerator> scanEnumerator;   // nullptr after the listing of scanning or reconciling
+    bool isScanning = false;
+    bool isReconciling = false;             // the scanning compares the listing with the files (see startReconcile)
+    std::uint64_t reconcileModifiedSince = 0;
+    std::vector<bool> reconcilePresent;     // by positions of the tracked files at the start of reconciling
+    std::vector<filesystem::Path> reconcileRemoved;    // reported after the listing completes
+    HANDLE wakeupTimer = NULL;
+    std::mutex asyncWaitMutex;
+    HANDLE asyncWait = NULL;                // wait of the system thread pool for ioEvent
+    std::function<void()> asyncContinuation;
+    std::exception_ptr *asyncError = nullptr;
+    DirectoryWatcher::ChangeBatch pendingBatch;     // batch which is being processed by processPending
+    std::size_t pendingOffset = 0;
+    std::atomic_bool needBreak;
+    BatchTimestamps timestamps;
+    LatencyHistogram parseLatency, updateLatency, dispatchLatency, handlerLatency, totalLatency;
+
+
+    static inline filesystem::Path getPathFromRaw(const WCHAR *path, DWORD sizeInBytes)
+    {
+        return {path, path + sizeInBytes / sizeof(WCHAR)};
     }
 
+    static inline filesystem::PathView getViewFromRaw(const WCHAR *path, DWORD sizeInBytes)
+    {
+        return {path, sizeInBytes / sizeof(WCHAR)};
+    }
 
-    void updateChangesList()
+    static inline std::uint64_t makeUInt64(DWORD low, DWORD high)
     {
-        changes.clear();
+        return (static_cast<std::uint64_t>(high) << 32) | low;
+    }
 
-        OVERLAPPED overlapInfo;
+    static inline FileState getFileState(const WIN32_FIND_DATAW &findFileData)
+    {
+        return {makeUInt64(findFileData.nFileSizeLow, findFileData.nFileSizeHigh),
+                makeUInt64(findFileData.ftLastWriteTime.dwLowDateTime, findFileData.ftLastWriteTime.dwHighDateTime),
+                (findFileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0};
+    }
 
-        std::memset(&overlapInfo, 0, sizeof(overlapInfo));
-        overlapInfo.hEvent = ioEvent.getHandle();
 
-        if (!ReadDirectoryChangesW(dirHandle.getHandle(),
-                                   winAPIChanges.get(),
-                                   winAPIChangesBufferSize,
-                                   FALSE,
-                                   FILE_NOTIFY_CHANGE_FILE_NAME
-                                   | FILE_NOTIFY_CHANGE_DIR_NAME
-                                   | FILE_NOTIFY_CHANGE_SIZE
-                                   | FILE_NOTIFY_CHANGE_LAST_WRITE,
-                                   NULL,
-                                   &overlapInfo,
-                                   NULL
-                                   ))
+    static std::unique_ptr<SharedSnapshotWriter> createSharedSnapshot(const DirectoryWatcher::Options &options)
+    {
+        if (options.sharedSnapshotName.empty())
         {
-            throw std::system_error(GetLastError(), std::system_category());
+            return nullptr;
         }
 
-        HANDLE handles[2]{ breakEvent.getHandle(), ioEvent.getHandle() };
-        static_assert(2 <= MAXIMUM_WAIT_OBJECTS, "count of wait objects > MAXIMUM_WAIT_OBJECTS");
-        switch (WaitForMultipleObjects(2, handles, FALSE, INFINITE))
+        return std::make_unique<SharedSnapshotWriter>(options.sharedSnapshotName, options.sharedSnapshotCapacity);
+    }
+
+    static std::shared_ptr<WatcherStatistics> createStatistics(const DirectoryWatcher::Options &options)
+    {
+        return options.statistics ? options.statistics : std::make_shared<WatcherStatistics>();
+    }
+
+    void registerAsyncWait()
+    {
+        armWakeup(true);
+
+        std::lock_guard<decltype(asyncWaitMutex)> lock(asyncWaitMutex);
+        if (!RegisterWaitForSingleObject(&asyncWait, ioEvent.getHandle(), &Impl::onAsyncWait, this,
+                                         INFINITE, WT_EXECUTEONLYONCE))
         {
-            case WAIT_FAILED:
-                throw std::system_error(GetLastError(), std::system_category());
-            case WAIT_OBJECT_0:
-                if (!CancelIo(dirHandle.getHandle()))
-                {
-                    throw std::system_error(GetLastError(), std::system_category());
-                }
-                break;
-            case WAIT_OBJECT_0 + 1:
-                handleReadChangesResults(overlapInfo);
-                break;
-            default:
-                throw std::runtime_error("Unexpected result of a system call");
+            asyncWait = NULL;
+            throw std::system_error(GetLastError(), std::system_category());
         }
     }
 
-    void handleReadChangesResults(OVERLAPPED &overlapInfo)
+    static VOID CALLBACK onAsyncWait(PVOID context, BOOLEAN)
     {
-        DWORD bytesTransferred;
+        Impl &self = *static_cast<Impl*>(context);
 
-        if (!GetOverlappedResult(dirHandle.getHandle(), &overlapInfo, &bytesTransferred, TRUE))
+        HANDLE wait;
         {
-            throw std::system_error(GetLastError(), std::system_category());
+            // the callback may be invoked before RegisterWaitForSingleObject returns
+            std::lock_guard<decltype(self.asyncWaitMutex)> lock(self.asyncWaitMutex);
+            wait = self.asyncWait;
+            self.asyncWait = NULL;
         }
+        UnregisterWait(wait);
 
-        if ((bytesTransferred == 0) || (GetLastError() == ERROR_NOTIFY_ENUM_DIR))
+        bool isReady = true;
+        try
         {
-            fullFilesReupdate();
+            isReady = self.tryNextBatch();
+            if (!isReady)
+            {
+                self.registerAsyncWait();
+            }
         }
-        else
+        catch (...)
         {
-            const std::int8_t *buffer = reinterpret_cast<std::int8_t *>(winAPIChanges.get());
-            const FILE_NOTIFY_INFORMATION *notifies = nullptr;
-            std::stack<filesystem::Path> renameOldNames;
-            std::stack<filesystem::Path> renameNewNames;
+            *self.asyncError = std::current_exception();
+            isReady = true;
+        }
 
-            do
-            {
-                notifies = reinterpret_cast<const FILE_NOTIFY_INFORMATION *>(buffer);
+        if (isReady)
+        {
+            // the continuation may start the next awaiting
+            auto continuation = std::move(self.asyncContinuation);
+            continuation();
+        }
+    }
+
+
+    static std::unique_ptr<ThreadPool> createFingerprintPool(const DirectoryWatcher::Options &options)
+    {
+        if (!options.fingerprintContents)
+        {
+            return nullptr;
+        }
+
+        return std::make_unique<ThreadPool>(options.fingerprintThreads);
+    }
+
+
+    static HANDLE createDirHandle(const filesystem::Path &path)
+    {
+        const HANDLE result = CreateFileW(MAKE_EXTENDED_PATH(path).c_str(),
+                                          FILE_LIST_DIRECTORY,
+                                          FILE_SHARE_DELETE | FILE_SHARE_READ | FILE_SHARE_WRITE,
+                                          NULL,
+                                          OPEN_EXISTING,
+                                          FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED,
+                                          NULL
+                                         );
+
+        if (result == INVALID_HANDLE_VALUE)
+        {
+            throw std::system_error(GetLastError(), std::system_category());
+        }
+
+        return result;
+    }
+
+    HANDLE createEvent()
+    {
+        const HANDLE result = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+        if (result == NULL)
+        {
+            throw std::system_error(GetLastError(), std::system_category());
+        }
+
+        return result;
+    }
+
+
+    static filesystem::Path createSearchPath(const filesystem::Path &path)
+    {
+        filesystem::Path result = path / L"*";
+        return std::move(MAKE_EXTENDED_PATH(result));
+    }
+
+
+    /*
+     * Starts full scanning of the directory. Scanning is done by chunks of at most scanChunkSize changes
+     * (see scanStep method): files of the directory are reported as added while enumeration progresses.
+     * It's started by an empty files list only (the initial one or cleared by retarget)
+     */
+    void startScan()
+    {
+        syncWriteTime = getSystemWriteTime();
+        started = true;
+        isScanning = true;
+        hasPendingRename = false;
+        scanEnumerator.reset();
+        fileStates.clear();
+    }
+
+    void scanStep()
+    {
+        timestamps.read = Clock::now();
+
+        if (!scanEnumerator)
+        {
+            scanEnumerator = std::make_unique<DirectoryEnumerator>(searchPath, filter);
+        }
+
+        const bool isPolling = (backend.load() == DirectoryWatcher::Backend::polling);
+        while (changes.size() < scanChunkSize)
+        {
+            const WIN32_FIND_DATAW *findFileData = scanEnumerator->next();
+            if (findFileData == nullptr)
+            {
+                scanEnumerator.reset();
+                isScanning = false;
+                nextPollTime = Clock::now() + pollInterval;
+                break;
+            }
+
+            changes.push(ChangeEntry::ChangeType::add, filesystem::PathView(),
+                         filesystem::PathView(findFileData->cFileName, std::wcslen(findFileData->cFileName)), false);
+            if (isPolling)
+            {
+                fileStates[findFileData->cFileName] = getFileState(*findFileData);
+            }
+            else if (filesIndex || directoryAggregates)
+            {
+                scannedStates[findFileData->cFileName] = getFileState(*findFileData);
+            }
+        }
+
+        timestamps.parsed = Clock::now();
+    }
+
+    /* Reports the tracked files as adds, so a resumed consumer gets the current state without rescanning */
+    void collectSnapshot()
+    {
+        timestamps.read = Clock::now();
+        isSnapshotCollected = true;
+
+        changes.clear();
+        for (std::size_t i = 0; i < files.size(); ++i)
+        {
+            changes.push(ChangeEntry::ChangeType::add, filesystem::PathView(), files[i], false);
+            changes.setFileIndex(i, i);
+        }
+
+        timestamps.parsed = timestamps.updated = Clock::now();
+    }
+
+    /* Calls onFile(const WIN32_FIND_DATAW&) for every file of the directory accepted by the filter */
+    template<typename Callable>
+    void enumerateDirectory(Callable &&onFile)
+    {
+        DirectoryEnumerator enumerator(searchPath, filter);
+        while (const WIN32_FIND_DATAW *findFileData = enumerator.next())
+        {
+            onFile(*findFileData);
+        }
+    }
+
+
+    /*
+     * Makes ioEvent signaled when the next batch can be collected: starts reading of changes if it isn't started yet
+     * If scheduleTimer is true then deadlines of a pending rename and of the next poll signal ioEvent too
+     * (otherwise the caller waits for them by timeout, see getWaitTimeout method)
+     */
+    void armWakeup(bool scheduleTimer)
+    {
+        // the next chunk of scanning is available immediately
+        if (isScanning)
+        {
+            if (!SetEvent(ioEvent.getHandle()))
+            {
+                throw std::system_error(GetLastError(), std::system_category());
+            }
+
+            return;
+        }
+
+        if (eventSource)
+        {
+            armSourceWakeup(scheduleTimer);
+            return;
+        }
+
+        if ((backend.load(std::memory_order_relaxed) == DirectoryWatcher::Backend::notifications) && !isReadPending)
+        {
+            startRead();
+        }
+
+        if (!scheduleTimer)
+        {
+            return;
+        }
+
+        const auto deadline = getWakeupDeadline();
+        if (deadline != Clock::time_point::max())
+        {
+            scheduleWakeup(deadline);
+        }
+    }
+
+    void armSourceWakeup(bool scheduleTimer)
+    {
+        const auto deadline = getWakeupDeadline();
+        if (deadline <= Clock::now())
+        {
+            if (!SetEvent(ioEvent.getHandle()))
+            {
+                throw std::system_error(GetLastError(), std::system_category());
+            }
+        }
+        else if (scheduleTimer && (deadline != Clock::time_point::max()))
+        {
+            scheduleWakeup(deadline);
+        }
+    }
+
+    /* Returns when the next buffer of the event source or the pending rename is due */
+    Clock::time_point getSourceDeadline() const
+    {
+        const auto next = eventSource->getNextTime();
+        return (hasPendingRename && (pendingRenameDeadline < next)) ? pendingRenameDeadline : next;
+    }
+
+    void startRead()
+    {
+        std::memset(&overlapInfo, 0, sizeof(overlapInfo));
+        overlapInfo.hEvent = ioEvent.getHandle();
+
+        if (!ReadDirectoryChangesW(dirHandle.getHandle(),
+                                   readBuffer.get(),
+                                   changesBufferSize,
+                                   FALSE,
+                                   FILE_NOTIFY_CHANGE_FILE_NAME
+                                   | FILE_NOTIFY_CHANGE_DIR_NAME
+                                   | FILE_NOTIFY_CHANGE_SIZE
+                                   | FILE_NOTIFY_CHANGE_LAST_WRITE,
+                                   NULL,
+                                   &overlapInfo,
+                                   NULL
+                                   ))
+        {
+            const auto err = GetLastError();
+            if ((requestedBackend == DirectoryWatcher::Backend::automatic)
+                && ((err == ERROR_INVALID_FUNCTION) || (err == ERROR_NOT_SUPPORTED)))
+            {
+                switchToPolling();
+                return;
+            }
+
+            // network shares don't accept buffers larger than 64 KB
+            if ((err == ERROR_INVALID_PARAMETER) && (changesBufferSize > minChangesBufferSize))
+            {
+                changesBufferSizeLimit = minChangesBufferSize;
+                resizeChangesBuffers(minChangesBufferSize);
+                startRead();
+                return;
+            }
+
+            throw std::system_error(err, std::system_category());
+        }
+
+        isReadPending = true;
+    }
+
+    /* Cancels the pending read and waits for its completion */
+    void cancelRead()
+    {
+        if (!isReadPending)
+        {
+            return;
+        }
+
+        isReadPending = false;
+
+        // fails with ERROR_NOT_FOUND if the read has been completed already
+        CancelIoEx(dirHandle.getHandle(), &overlapInfo);
+
+        DWORD bytesTransferred;
+        GetOverlappedResult(dirHandle.getHandle(), &overlapInfo, &bytesTransferred, TRUE);
+    }
+
+    void scheduleWakeup(Clock::time_point deadline)
+    {
+        cancelWakeup();
+
+        if (!CreateTimerQueueTimer(&wakeupTimer, NULL, &Impl::onWakeupTimer, ioEvent.getHandle(),
+                                   getTimeout(deadline), 0, WT_EXECUTEINTIMERTHREAD | WT_EXECUTEONLYONCE))
+        {
+            wakeupTimer = NULL;
+            throw std::system_error(GetLastError(), std::system_category());
+        }
+    }
+
+    void cancelWakeup()
+    {
+        if (wakeupTimer != NULL)
+        {
+            // waits for the callback completion
+            DeleteTimerQueueTimer(NULL, wakeupTimer, INVALID_HANDLE_VALUE);
+            wakeupTimer = NULL;
+        }
+    }
+
+    static VOID CALLBACK onWakeupTimer(PVOID event, BOOLEAN)
+    {
+        SetEvent(static_cast<HANDLE>(event));
+    }
+
+
+    /*
+     * Collects the next batch of changes into changes list if it's available; never blocks
+     * Returns false if there is no batch yet or the batch consisted of suppressed changes only
+     */
+    bool collectBatch()
+    {
+        changes.clear();
+
+        if (needBreak)
+        {
+            return false;
+        }
+
+        if (isSnapshotStale && (nextPublishTime <= Clock::now()))
+        {
+            publishSnapshot();
+        }
+
+        if (isScanning)
+        {
+            if (!ResetEvent(ioEvent.getHandle()))
+            {
+                throw std::system_error(GetLastError(), std::system_category());
+            }
+
+            if (isReconciling)
+            {
+                reconcileStep();
+            }
+            else
+            {
+                scanStep();
+            }
+        }
+        else if (backend.load(std::memory_order_relaxed) == DirectoryWatcher::Backend::polling)
+        {
+            // only the wakeup timer signals ioEvent while polling; it's rescheduled if the poll isn't due yet
+            if (!ResetEvent(ioEvent.getHandle()))
+            {
+                throw std::system_error(GetLastError(), std::system_category());
+            }
+
+            if (Clock::now() < nextPollTime)
+            {
+                return false;
+            }
+
+            poll();
+        }
+        else if (!collectReadResults())
+        {
+            return false;
+        }
+
+        const auto droppedCount = updateFilesList();
+        updateFileAttributes();     // before suppression, so modify dates of suppressed modifies are updated too
+        updatePathSearchIndex();
+        const auto suppressedCount = updateFingerprints();
+        tagSelfChanges();       // after suppression, so spurious modifies don't consume registrations
+        timestamps.updated = Clock::now();
+
+        // the batch consisted of spurious modifies and duplicated changes only
+        return !(changes.empty() && (droppedCount + suppressedCount != 0));
+    }
+
+    /* Returns false if the pending read isn't completed and there is no expired rename */
+    bool collectReadResults()
+    {
+        if (eventSource)
+        {
+            return collectSourceResults();
+        }
+
+        if (!isReadPending)
+        {
+            return false;
+        }
+
+        DWORD bytesTransferred;
+        if (GetOverlappedResult(dirHandle.getHandle(), &overlapInfo, &bytesTransferred, FALSE))
+        {
+            isReadPending = false;
+            handleReadChangesResults(bytesTransferred, true);
+            return true;
+        }
+
+        auto err = GetLastError();
+        if (err == ERROR_IO_INCOMPLETE)
+        {
+            if (hasPendingRename && (pendingRenameDeadline <= Clock::now()))
+            {
+                handlePendingRenameExpiration();
+                return true;
+            }
+
+            // spurious wakeup by the wakeup timer; the read may be completed right after the check above
+            if (!ResetEvent(ioEvent.getHandle()))
+            {
+                throw std::system_error(GetLastError(), std::system_category());
+            }
+
+            if (GetOverlappedResult(dirHandle.getHandle(), &overlapInfo, &bytesTransferred, FALSE))
+            {
+                isReadPending = false;
+                handleReadChangesResults(bytesTransferred, true);
+                return true;
+            }
+
+            err = GetLastError();
+            if (err == ERROR_IO_INCOMPLETE)
+            {
+                return false;
+            }
+        }
+
+        isReadPending = false;
+        throw std::system_error(err, std::system_category());
+    }
+
+
+    /* Returns false if the event source has no buffer due and there is no expired rename */
+    bool collectSourceResults()
+    {
+        // the event is set again by armWakeup while buffers are due
+        if (!ResetEvent(ioEvent.getHandle()))
+        {
+            throw std::system_error(GetLastError(), std::system_category());
+        }
+
+        std::size_t size;
+        if (eventSource->read(winAPIChanges.get(), changesBufferSize, size))
+        {
+            handleChangesBuffer(size, size == 0);
+            return true;
+        }
+
+        if (hasPendingRename && (pendingRenameDeadline <= Clock::now()))
+        {
+            timestamps.read = Clock::now();
+            flushPendingRename();
+            timestamps.parsed = Clock::now();
+            return true;
+        }
+
+        return false;
+    }
+
+
+    /* The filesystem doesn't support change notifications */
+    void switchToPolling()
+    {
+        backend.store(DirectoryWatcher::Backend::polling);
+        pollInterval = minPollInterval;
+
+        // the files tracked so far have no recorded states, so the first poll doesn't report them as modified
+        nextPollTime = Clock::now();
+    }
+
+    /* Lists the directory if it could have been changed and adapts the poll interval */
+    void poll()
+    {
+        timestamps.read = Clock::now();
+
+        // the write time is requested before listing, so changes made during listing are caught by the next poll
+        const auto writeTime = getDirectoryWriteTime();
+        if ((writeTime != directoryWriteTime) || (timestamps.read - lastListingTime >= maxPollInterval))
+        {
+            directoryWriteTime = writeTime;
+            listDirectory();
+        }
+
+        pollInterval = changes.empty() ? std::min(pollInterval * 2, maxPollInterval)
+                                       : std::max(pollInterval / 2, minPollInterval);
+        nextPollTime = Clock::now() + pollInterval;
+        timestamps.parsed = Clock::now();
+    }
+
+    /* Returns 0 if the write time is unavailable */
+    std::uint64_t getDirectoryWriteTime() const
+    {
+        WIN32_FILE_ATTRIBUTE_DATA directoryInfo;
+
+        if (!GetFileAttributesExW(MAKE_EXTENDED_PATH(path).c_str(), GetFileExInfoStandard, &directoryInfo))
+        {
+            return 0;
+        }
+
+        return makeUInt64(directoryInfo.ftLastWriteTime.dwLowDateTime, directoryInfo.ftLastWriteTime.dwHighDateTime);
+    }
+
+    /* Compares the directory listing with the tracked files list and generates changes */
+    void listDirectory()
+    {
+        std::unordered_map<filesystem::Path, FileState> currentStates;
+        currentStates.reserve(files.size());
+
+        enumerateDirectory([this, &currentStates](const WIN32_FIND_DATAW &findFileData)
+        {
+            filesystem::Path file(findFileData.cFileName);
+            const FileState state = getFileState(findFileData);
+
+            if (files.find(file) == PathSet::npos)
+            {
+                changes.push(ChangeEntry::ChangeType::add, filesystem::PathView(), file, false);
+            }
+            else
+            {
+                const auto previous = fileStates.find(file);
+                if ((previous != fileStates.cend()) && (previous->second != state))
+                {
+                    changes.push(ChangeEntry::ChangeType::modify, filesystem::PathView(), file, false);
+                }
+            }
+
+            currentStates.emplace(std::move(file), state);
+        });
+
+        // renames can't be distinguished by listing, so they are reported as removes and adds
+        for (std::size_t i = 0; i < files.size(); ++i)
+        {
+            const filesystem::Path file = files[i];
+            if (currentStates.find(file) == currentStates.cend())
+            {
+                changes.push(ChangeEntry::ChangeType::remove, file, filesystem::PathView(), false);
+            }
+        }
+
+        fileStates = std::move(currentStates);
+        lastListingTime = Clock::now();
+    }
+
+    /*
+     * Returns INFINITE if there is neither rename waiting for its new name nor scheduled poll nor source buffer
+     * nor skipped publication of the snapshot
+     */
+    DWORD getWaitTimeout() const
+    {
+        if (isScanning)
+        {
+            return 0;
+        }
+
+        const auto deadline = getWakeupDeadline();
+        return (deadline == Clock::time_point::max()) ? INFINITE : getTimeout(deadline);
+    }
+
+    /* Returns Clock::time_point::max() if nothing is due without changes of the directory */
+    Clock::time_point getWakeupDeadline() const
+    {
+        auto deadline = Clock::time_point::max();
+        if (backend.load(std::memory_order_relaxed) == DirectoryWatcher::Backend::polling)
+        {
+            deadline = nextPollTime;
+        }
+        else if (eventSource)
+        {
+            deadline = getSourceDeadline();
+        }
+        else if (hasPendingRename)
+        {
+            deadline = pendingRenameDeadline;
+        }
+
+        return (isSnapshotStale && (nextPublishTime < deadline)) ? nextPublishTime : deadline;
+    }
+
+    static DWORD getTimeout(Clock::time_point deadline)
+    {
+        const auto now = Clock::now();
+        if (deadline <= now)
+        {
+            return 0;
+        }
+
+        return static_cast<DWORD>(std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count() + 1);
+    }
+
+    void handlePendingRenameExpiration()
+    {
+        isReadPending = false;
+
+        if (!CancelIoEx(dirHandle.getHandle(), &overlapInfo) && (GetLastError() != ERROR_NOT_FOUND))
+        {
+            throw std::system_error(GetLastError(), std::system_category());
+        }
+
+        // the read may have been completed before cancellation
+        DWORD bytesTransferred;
+        if (GetOverlappedResult(dirHandle.getHandle(), &overlapInfo, &bytesTransferred, TRUE))
+        {
+            handleReadChangesResults(bytesTransferred, false);
+        }
+        else if (GetLastError() != ERROR_OPERATION_ABORTED)
+        {
+            throw std::system_error(GetLastError(), std::system_category());
+        }
+        else
+        {
+            timestamps.read = Clock::now();
+        }
+
+        flushPendingRename();
+        timestamps.parsed = Clock::now();
+    }
+
+    /*
+     * Must be called right after successful GetOverlappedResult call
+     * If rearm is true then the next read is started before parsing
+     */
+    void handleReadChangesResults(DWORD bytesTransferred, bool rearm)
+    {
+        const bool overflow = (bytesTransferred == 0) || (GetLastError() == ERROR_NOTIFY_ENUM_DIR);
+
+        // the read has filled readBuffer, so the next one can be started into the other buffer
+        winAPIChanges.swap(readBuffer);
+
+        if (!overflow)
+        {
+            syncWriteTime = getSystemWriteTime();
+            adaptChangesBufferSize(bytesTransferred);
+
+            if (rearm)
+            {
+                startRead();
+            }
+        }
+
+        handleChangesBuffer(bytesTransferred, overflow);
+    }
+
+    /* Parses size bytes of winAPIChanges which are read from the system or taken from the event source */
+    void handleChangesBuffer(std::size_t size, bool overflow)
+    {
+        timestamps.read = Clock::now();
+        statistics->addBytesRead(size);
+
+        if (eventRecorder)
+        {
+            eventRecorder->record(winAPIChanges.get(), overflow ? 0 : size);
+        }
+
+        if (overflow)
+        {
+            recoverFromOverflow();
+        }
+        else
+        {
+            const std::int8_t *buffer = reinterpret_cast<std::int8_t *>(winAPIChanges.get());
+            const FILE_NOTIFY_INFORMATION *notifies = nullptr;
+
+            do
+            {
+                notifies = reinterpret_cast<const FILE_NOTIFY_INFORMATION *>(buffer);
+
+                // the new name of a renamed file always follows the old one, so anything else breaks the pair
+                if (notifies->Action != FILE_ACTION_RENAMED_NEW_NAME)
+                {
+                    flushPendingRename();
+                }
 
                 switch (notifies->Action)
                 {
                     case FILE_ACTION_ADDED:
-                        changes.emplace_back(ChangeEntry(ChangeEntry::ChangeType::add, 0,
-                                                         filesystem::Path(),
-                                                         getPathFromRaw(notifies->FileName, notifies->FileNameLength),
-                                                         false));
+                        if (isTracked(notifies->FileName, notifies->FileNameLength, true))
+                        {
+                            changes.push(ChangeEntry::ChangeType::add, filesystem::PathView(),
+                                         getViewFromRaw(notifies->FileName, notifies->FileNameLength), false);
+                        }
                         break;
                     case FILE_ACTION_REMOVED:
-                        changes.emplace_back(ChangeEntry(ChangeEntry::ChangeType::remove, 0,
-                                                         getPathFromRaw(notifies->FileName, notifies->FileNameLength),
-                                                         filesystem::Path(),
-                                                         false));
+                        if (isTracked(notifies->FileName, notifies->FileNameLength, false))
+                        {
+                            changes.push(ChangeEntry::ChangeType::remove,
+                                         getViewFromRaw(notifies->FileName, notifies->FileNameLength),
+                                         filesystem::PathView(), false);
+                        }
                         break;
                     case FILE_ACTION_MODIFIED:
-                        changes.emplace_back(ChangeEntry(ChangeEntry::ChangeType::modify, 0,
-                                                         filesystem::Path(),
-                                                         getPathFromRaw(notifies->FileName, notifies->FileNameLength),
-                                                         false));
+                        if (isTracked(notifies->FileName, notifies->FileNameLength, true))
+                        {
+                            changes.push(ChangeEntry::ChangeType::modify, filesystem::PathView(),
+                                         getViewFromRaw(notifies->FileName, notifies->FileNameLength), false);
+                        }
                         break;
                     case FILE_ACTION_RENAMED_OLD_NAME:
-                        if (renameNewNames.empty())
+                        flushPendingRename();
+                        pendingRenameOldName = getRenameName(notifies->FileName, notifies->FileNameLength, false);
+                        pendingRenameDeadline = Clock::now() + renamePairTimeout;
+                        hasPendingRename = true;
+                        break;
+                    case FILE_ACTION_RENAMED_NEW_NAME:
+                        if (hasPendingRename)
+                        {
+                            hasPendingRename = false;
+                            addRename(std::move(pendingRenameOldName),
+                                      getRenameName(notifies->FileName, notifies->FileNameLength, true));
+                        }
+                        else    // moved in from outside of the tracked directory
+                        {
+                            addRename({false, filesystem::Path()},
+                                      getRenameName(notifies->FileName, notifies->FileNameLength, true));
+                        }
+                        break;
+                }
+
+                buffer += notifies->NextEntryOffset;
+            }
+            while (notifies->NextEntryOffset != 0);
+        }
+
+        timestamps.parsed = Clock::now();
+    }
+
+
+    /* Grows the buffer for the next reopening of the directory handle if the read has filled 3/4 of it at least */
+    void adaptChangesBufferSize(DWORD bytesTransferred)
+    {
+        if ((std::uint64_t(bytesTransferred) * 4 >= std::uint64_t(changesBufferSize) * 3)
+            && (targetChangesBufferSize < changesBufferSizeLimit))
+        {
+            targetChangesBufferSize = std::min(targetChangesBufferSize * 2, changesBufferSizeLimit);
+        }
+    }
+
+    void resizeChangesBuffers(DWORD size)
+    {
+        winAPIChanges = createChangesBuffer(size);
+        readBuffer = createChangesBuffer(size);
+        changesBufferSize = size;
+        targetChangesBufferSize = size;
+    }
+
+    static ChangesBuffer createChangesBuffer(DWORD size)
+    {
+        return std::make_unique<DWORD[]>(size / sizeof(DWORD));
+    }
+
+    /*
+     * Changes made since the last read have been lost, so the directory listing is compared with the tracked
+     * files list: only adds, removes and files written since the last read are reported instead of removing
+     * and adding all files by full rescanning. Before the listing the read is restarted (with a larger buffer
+     * if the handle is reopened), so changes made during the listing aren't lost; the read results are collected
+     * after the last chunk of the listing
+     * A replayed overflow is only counted: listing the live directory would make the replay depend on its
+     * current state
+     */
+    void recoverFromOverflow()
+    {
+        statistics->addOverflowRescan();
+        hasPendingRename = false;   // the new name is lost; the listing reports both names
+
+        if (eventSource)
+        {
+            return;
+        }
+
+        if (targetChangesBufferSize < changesBufferSizeLimit)
+        {
+            targetChangesBufferSize = std::min(targetChangesBufferSize * 2, changesBufferSizeLimit);
+        }
+        if (targetChangesBufferSize > changesBufferSize)
+        {
+            reopenDirHandle();
+        }
+
+        if (!isReadPending)
+        {
+            startRead();
+        }
+
+        startReconcile();
+        reconcileStep();
+    }
+
+    /* Reopens the directory handle with buffers of targetChangesBufferSize; keeps the old one on failure */
+    void reopenDirHandle()
+    {
+        HANDLE newDirHandle;
+        try
+        {
+            newDirHandle = createDirHandle(path);
+        }
+        catch (const std::system_error&)
+        {
+            targetChangesBufferSize = changesBufferSize;
+            return;
+        }
+
+        cancelRead();
+        dirHandle.reset(newDirHandle);
+        resizeChangesBuffers(targetChangesBufferSize);
+    }
+
+    /*
+     * Starts reporting differences between the directory listing and the tracked files list (see
+     * recoverFromOverflow); they are reported by chunks of scanChunkSize as the ones of scanning
+     */
+    void startReconcile()
+    {
+        // write times are rounded up to 2 seconds by FAT
+        constexpr std::uint64_t writeTimeTolerance = 2 * 10000000ULL;
+        reconcileModifiedSince = (syncWriteTime > writeTimeTolerance) ? syncWriteTime - writeTimeTolerance : 0;
+
+        syncWriteTime = getSystemWriteTime();
+
+        isScanning = true;
+        isReconciling = true;
+        scanEnumerator = std::make_unique<DirectoryEnumerator>(searchPath, filter);
+        reconcilePresent.assign(files.size(), false);
+        reconcileRemoved.clear();
+    }
+
+    void reconcileStep()
+    {
+        timestamps.read = Clock::now();
+
+        // positions of the tracked files are kept by the chunks, because they consist of adds and modifies only
+        while (scanEnumerator && (changes.size() < scanChunkSize))
+        {
+            const WIN32_FIND_DATAW *findFileData = scanEnumerator->next();
+            if (findFileData == nullptr)
+            {
+                scanEnumerator.reset();
+
+                // renames can't be distinguished by listing, so they are reported as removes and adds
+                for (std::size_t i = reconcilePresent.size(); i > 0; --i)
+                {
+                    if (!reconcilePresent[i - 1])
+                    {
+                        reconcileRemoved.push_back(files[i - 1]);
+                    }
+                }
+                break;
+            }
+
+            const filesystem::PathView file(findFileData->cFileName, std::wcslen(findFileData->cFileName));
+            const auto state = getFileState(*findFileData);
+
+            const auto position = files.find(file);
+            if (position == PathSet::npos)
+            {
+                changes.push(ChangeEntry::ChangeType::add, filesystem::PathView(), file, false);
+            }
+            else
+            {
+                if (position < reconcilePresent.size())
+                {
+                    reconcilePresent[position] = true;
+                }
+                if (state.writeTime < reconcileModifiedSince)
+                {
+                    continue;
+                }
+
+                changes.push(ChangeEntry::ChangeType::modify, filesystem::PathView(), file, false);
+            }
+
+            if (filesIndex || directoryAggregates)
+            {
+                scannedStates[findFileData->cFileName] = state;
+            }
+        }
+
+        while (!scanEnumerator && !reconcileRemoved.empty() && (changes.size() < scanChunkSize))
+        {
+            changes.push(ChangeEntry::ChangeType::remove, reconcileRemoved.back(), filesystem::PathView(), false);
+            reconcileRemoved.pop_back();
+        }
+
+        if (!scanEnumerator && reconcileRemoved.empty())
+        {
+            reconcilePresent.clear();
+            isReconciling = false;
+            isScanning = false;
+        }
+
+        timestamps.parsed = Clock::now();
+    }
+
+    /* Returns the current system time in units of file write times */
+    static std::uint64_t getSystemWriteTime()
+    {
+        FILETIME now;
+        GetSystemTimeAsFileTime(&now);
+        return makeUInt64(now.dwLowDateTime, now.dwHighDateTime);
+    }
+
+
+    /*
+     * Returns true if file from change notification passes the filter
+     * Parameters:
+     *  existing    -   true if the file must exist now, so its type can be requested from the system;
+     *                  otherwise the file is tracked if it is present in the files list
+     */
+    bool isTracked(const WCHAR *name, DWORD sizeInBytes, bool existing)
+    {
+        const auto decision = filter.check(name, sizeInBytes / sizeof(WCHAR));
+        switch (decision)
+        {
+            case PathFilter::Decision::accepted:
+                return true;
+            case PathFilter::Decision::rejected:
+                return false;
+            default:
+                break;
+        }
+
+        const auto filePath = getPathFromRaw(name, sizeInBytes);
+        if (!existing)
+        {
+            return files.find(filePath) != PathSet::npos;
+        }
+
+        const auto fullPath = path / filePath;
+        const auto attributes = GetFileAttributesW(MAKE_EXTENDED_PATH(fullPath).c_str());
+        const bool isDirectory = (attributes != INVALID_FILE_ATTRIBUTES) && ((attributes & FILE_ATTRIBUTE_DIRECTORY) != 0);
+
+        return isDirectory == (decision == PathFilter::Decision::acceptedIfDirectory);
+    }
+
+    RenameName getRenameName(const WCHAR *name, DWORD sizeInBytes, bool existing)
+    {
+        if (isTracked(name, sizeInBytes, existing))
+        {
+            return {true, getPathFromRaw(name, sizeInBytes)};
+        }
+
+        return {false, filesystem::Path()};
+    }
+
+    /* Turns the old name of a rename which hasn't been paired with a new name into removing */
+    void flushPendingRename()
+    {
+        if (hasPendingRename)
+        {
+            hasPendingRename = false;
+            addRename(std::move(pendingRenameOldName), {false, filesystem::Path()});
+        }
+    }
+
+    /* Renames between tracked and filtered out names turn into adds or removes */
+    void addRename(RenameName &&oldName, RenameName &&newName)
+    {
+        if (oldName.tracked && newName.tracked)
+        {
+            changes.push(ChangeEntry::ChangeType::rename, oldName.path, newName.path, false);
+        }
+        else if (oldName.tracked)
+        {
+            changes.push(ChangeEntry::ChangeType::remove, oldName.path, filesystem::PathView(), false);
+        }
+        else if (newName.tracked)
+        {
+            changes.push(ChangeEntry::ChangeType::add, filesystem::PathView(), newName.path, false);
+        }
+    }
+
+
+    /*
+     * Applies the current batch to the files list. Changes which contradict the list are dropped: after
+     * an overflow the listing and the restarted read may report the same change twice (adds of tracked files,
+     * removes, modifies and renames of unknown ones); renames from unknown names turn into adds and renames
+     * onto tracked names into removes
+     * Returns count of dropped changes
+     */
+    std::size_t updateFilesList()
+    {
+        std::size_t keptCount = 0;
+        for (std::size_t i = 0; i < changes.size(); ++i)
+        {
+            const auto change = changes[i];
+            std::size_t position = PathSet::npos;
+
+            switch (change.getType())
+            {
+                case ChangeEntry::ChangeType::add:
+                    position = files.pushBack(change.getCurrentPath());
+                    break;
+                case ChangeEntry::ChangeType::remove:
+                    position = files.find(change.getOldPath());
+                    if (position != PathSet::npos)
+                    {
+                        files.erase(position);
+                    }
+                    break;
+                case ChangeEntry::ChangeType::rename:
+                    position = files.find(change.getOldPath());
+                    if (position == PathSet::npos)
+                    {
+                        position = files.pushBack(change.getCurrentPath());
+                        if (position != PathSet::npos)
                         {
-                            renameOldNames.emplace(std::move(getPathFromRaw(notifies->FileName, notifies->FileNameLength)));
-                        }
-                        else
-                        {                            
-                            changes.emplace_back(ChangeEntry(ChangeEntry::ChangeType::rename, 0,
-                                                             getPathFromRaw(notifies->FileName, notifies->FileNameLength),
-                                                             std::move(renameNewNames.top()),
-                                                             false));
-                            renameNewNames.pop();
+                            changes.retype(i, ChangeEntry::ChangeType::add);
                         }
+                    }
+                    else if (!files.assign(position, change.getCurrentPath()))
+                    {
+                        files.erase(position);
+                        changes.retype(i, ChangeEntry::ChangeType::remove);
+                    }
+                    break;
+                case ChangeEntry::ChangeType::modify:
+                    position = files.find(change.getCurrentPath());
+                    break;
+            }
+
+            if (position == PathSet::npos)
+            {
+                continue;
+            }
+
+            changes.setFileIndex(i, position);
+            if (keptCount != i)
+            {
+                changes.moveChange(i, keptCount);
+            }
+            ++keptCount;
+        }
+
+        const std::size_t droppedCount = changes.size() - keptCount;
+        changes.truncate(keptCount);
+
+        return droppedCount;
+    }
+
+
+    /*
+     * Updates the files index and the directory aggregates by the current batch. Attributes of added and
+     * modified files are taken from the scanning or polling results if they are known; otherwise they are
+     * requested from the system
+     */
+    void updateFileAttributes()
+    {
+        if (!filesIndex && !directoryAggregates)
+        {
+            return;
+        }
+
+        const bool isPolling = (backend.load(std::memory_order_relaxed) == DirectoryWatcher::Backend::polling);
+        const auto &knownStates = isPolling ? fileStates : scannedStates;
+
+        for (const auto &change : changes)
+        {
+            switch (change.getType())
+            {
+                case ChangeEntry::ChangeType::add:
+                case ChangeEntry::ChangeType::modify:
+                {
+                    const filesystem::Path file = change.getCurrentPath();
+                    FileState state;
 
+                    const auto known = knownStates.find(file);
+                    if (known != knownStates.cend())
+                    {
+                        state = known->second;
+                    }
+                    else if (!requestFileState(file, state))
+                    {
+                        eraseFileAttributes(file);  // the file has gone already; its remove or rename follows
                         break;
-                    case FILE_ACTION_RENAMED_NEW_NAME:
-                        if (renameOldNames.empty())
-                        {
-                            renameNewNames.emplace(std::move(getPathFromRaw(notifies->FileName, notifies->FileNameLength)));
-                        }
-                        else
-                        {
-                            changes.emplace_back(ChangeEntry(ChangeEntry::ChangeType::rename, 0,
-                                                             std::move(renameOldNames.top()),
-                                                             getPathFromRaw(notifies->FileName, notifies->FileNameLength),
-                                                             false));
-                            renameOldNames.pop();
-                        }
+                    }
+
+                    const auto modifyDate = toSystemTime(state.writeTime);
+                    if (filesIndex)
+                    {
+                        filesIndex->set(file, state.size, modifyDate);
+                    }
+                    if (directoryAggregates)
+                    {
+                        directoryAggregates->set(file, state.size, modifyDate, state.isDirectory);
+                    }
+                    break;
+                }
+                case ChangeEntry::ChangeType::remove:
+                    eraseFileAttributes(change.getOldPath());
+                    break;
+                case ChangeEntry::ChangeType::rename:
+                {
+                    const filesystem::Path oldPath = change.getOldPath();
+                    const filesystem::Path currentPath = change.getCurrentPath();
+
+                    // an add or modify of the old name earlier in this batch can't be requested by the old name
+                    // (the file has been renamed already), so the file is requested by the new one
+                    const bool isIndexed = !filesIndex || filesIndex->rename(oldPath, currentPath);
+                    const bool isAggregated = !directoryAggregates || directoryAggregates->rename(oldPath, currentPath);
 
+                    FileState state;
+                    if ((isIndexed && isAggregated) || !requestFileState(currentPath, state))
+                    {
                         break;
+                    }
+
+                    const auto modifyDate = toSystemTime(state.writeTime);
+                    if (!isIndexed)
+                    {
+                        filesIndex->set(currentPath, state.size, modifyDate);
+                    }
+                    if (!isAggregated)
+                    {
+                        directoryAggregates->set(currentPath, state.size, modifyDate, state.isDirectory);
+                    }
+                    break;
                 }
+            }
+        }
 
-                buffer += notifies->NextEntryOffset;
+        scannedStates.clear();
+    }
+
+    /* Updates the paths search index by adds, removes and renames of the current batch */
+    void updatePathSearchIndex()
+    {
+        if (!pathSearchIndex)
+        {
+            return;
+        }
+
+        for (const auto &change : changes)
+        {
+            switch (change.getType())
+            {
+                case ChangeEntry::ChangeType::add:
+                    pathSearchIndex->insert(change.getCurrentPath());
+                    break;
+                case ChangeEntry::ChangeType::remove:
+                    pathSearchIndex->erase(change.getOldPath());
+                    break;
+                case ChangeEntry::ChangeType::rename:
+                    pathSearchIndex->rename(change.getOldPath(), change.getCurrentPath());
+                    break;
+                case ChangeEntry::ChangeType::modify:
+                    break;
             }
-            while (notifies->NextEntryOffset != 0);
         }
     }
 
+    void eraseFileAttributes(const filesystem::Path &file)
+    {
+        if (filesIndex)
+        {
+            filesIndex->erase(file);
+        }
+        if (directoryAggregates)
+        {
+            directoryAggregates->erase(file);
+        }
+    }
+
+    /* Returns false if attributes of the file can't be requested */
+    bool requestFileState(const filesystem::Path &file, FileState &state) const
+    {
+        const auto fullPath = path / file;
+        WIN32_FILE_ATTRIBUTE_DATA fileInfo;
+        if (!GetFileAttributesExW(MAKE_EXTENDED_PATH(fullPath).c_str(), GetFileExInfoStandard, &fileInfo))
+        {
+            return false;
+        }
+
+        state.size = makeUInt64(fileInfo.nFileSizeLow, fileInfo.nFileSizeHigh);
+        state.writeTime = makeUInt64(fileInfo.ftLastWriteTime.dwLowDateTime, fileInfo.ftLastWriteTime.dwHighDateTime);
+        state.isDirectory = (fileInfo.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+        return true;
+    }
+
+    /* Converts FILETIME value (100-nanosecond intervals since 1601-01-01) */
+    static FileIndex::TimePoint toSystemTime(std::uint64_t fileTime)
+    {
+        using FileTimeDuration = std::chrono::duration<std::int64_t, std::ratio<1, 10000000>>;
+        constexpr std::int64_t unixEpoch = 116444736000000000LL;
+
+        return FileIndex::TimePoint(std::chrono::duration_cast<FileIndex::TimePoint::duration>(
+            FileTimeDuration(static_cast<std::int64_t>(fileTime) - unixEpoch)));
+    }
+
 
-    void updateFilesList()
+    /*
+     * Fingerprints contents of added and modified files of the current batch in parallel, updates stored
+     * fingerprints and drops modify changes which haven't changed the contents
+     * Files which can't be fingerprinted (directories, locked files, etc.) are always reported
+     * Returns count of dropped changes
+     */
+    std::size_t updateFingerprints()
     {
-        for (auto &change : changes)
+        if (!fingerprintPool)
+        {
+            return 0;
+        }
+
+        std::vector<std::future<ChangeEntry::Fingerprint>> tasks;
+        for (const auto &change : changes)
+        {
+            if ((change.getType() == ChangeEntry::ChangeType::add) || (change.getType() == ChangeEntry::ChangeType::modify))
+            {
+                tasks.push_back(fingerprintPool->submit([fullPath = path / change.getCurrentPath()]
+                {
+                    return filesystem::getContentFingerprint(fullPath);
+                }));
+            }
+        }
+
+        // stored fingerprints are updated in changes order, so renames and removes are applied consistently
+        auto task = tasks.begin();
+        std::size_t keptCount = 0;
+        for (std::size_t i = 0; i < changes.size(); ++i)
         {
+            const auto change = changes[i];
+            bool isSuppressed = false;
+
             switch (change.getType())
             {
                 case ChangeEntry::ChangeType::add:
-                    change.fileIndex = files.size();
-                    files.emplace_back(change.getCurrentPath());                    
+                    storeFingerprint(change.getCurrentPath(), *task++);
                     break;
                 case ChangeEntry::ChangeType::remove:
-                    change.fileIndex = getFileIndex(change.getOldPath());
-                    files.erase(change.getOldPath());
+                    fingerprints.erase(change.getOldPath());
                     break;
                 case ChangeEntry::ChangeType::rename:
                 {
-                    const auto iter = files.find(change.getOldPath());
-                    if (iter != files.cend())
+                    const auto iter = fingerprints.find(change.getOldPath());
+                    if (iter != fingerprints.end())
                     {
-                        change.fileIndex = std::distance(files.cbegin(), iter);
-                        files.assignElement(iter, change.getCurrentPath());
+                        const auto fingerprint = iter->second;
+                        fingerprints.erase(iter);
+                        fingerprints[change.getCurrentPath()] = fingerprint;
                     }
                     break;
                 }
                 case ChangeEntry::ChangeType::modify:
-                    change.fileIndex = getFileIndex(change.getCurrentPath());
+                {
+                    const filesystem::Path file = change.getCurrentPath();
+                    const auto old = fingerprints.find(file);
+                    const bool hasOld = (old != fingerprints.end());
+                    const ChangeEntry::Fingerprint oldFingerprint = hasOld ? old->second : 0;
+
+                    if (storeFingerprint(file, *task++) && hasOld)
+                    {
+                        const ChangeEntry::Fingerprint newFingerprint = fingerprints[file];
+                        changes.setFingerprints(i, oldFingerprint, newFingerprint);
+                        isSuppressed = (oldFingerprint == newFingerprint);
+                    }
                     break;
+                }
+            }
+
+            if (!isSuppressed)
+            {
+                if (keptCount != i)
+                {
+                    changes.moveChange(i, keptCount);
+                }
+                ++keptCount;
             }
         }
-    }
 
+        const std::size_t suppressedCount = changes.size() - keptCount;
+        changes.truncate(keptCount);
 
-    ChangeEntry::IndexType getFileIndex(const filesystem::Path &path)
+        statistics->addSuppressedModifies(suppressedCount);
+        return suppressedCount;
+    }
+
+    /* Marks changes of the current batch whose old or current path is registered in selfChanges */
+    void tagSelfChanges()
     {
-        const auto iter = files.find(path);
-        if (iter == files.cend())
+        if (!selfChanges || selfChanges->empty())
+        {
+            return;
+        }
+
+        for (std::size_t i = 0; i < changes.size(); ++i)
         {
-            throw std::out_of_range("Nonexistent path");
+            const auto change = changes[i];
+            const auto oldPath = change.getOldPath();
+            const auto currentPath = change.getCurrentPath();
+
+            // both paths are matched, so a rename consumes registrations of its source and its target
+            const bool oldMatched = !oldPath.empty() && selfChanges->match(path / oldPath);
+            const bool currentMatched = !currentPath.empty() && selfChanges->match(path / currentPath);
+            if (oldMatched || currentMatched)
+            {
+                changes.setSelfOriginated(i);
+            }
         }
+    }
 
-        return std::distance(files.cbegin(), iter);
+    /* Returns false if the file hasn't been fingerprinted; its stored fingerprint is forgotten then */
+    bool storeFingerprint(const filesystem::Path &file, std::future<ChangeEntry::Fingerprint> &fingerprint)
+    {
+        try
+        {
+            fingerprints[file] = fingerprint.get();
+            return true;
+        }
+        catch (const std::exception&)
+        {
+            fingerprints.erase(file);
+            return false;
+        }
     }
 
 
     void notify()
     {
-        parent.handler(changes.cbegin(), changes.cend());
+        updateStatistics();
+        publishSnapshot();
+
+        // the handler may keep the batch, so the next changes are collected into another storage
+        DirectoryWatcher::ChangeBatch batch(std::move(changes), batchPool);
+        changes = batchPool->acquire();
+
+        const auto handlerEntry = Clock::now();
+        parent.handler(batch);
+        const auto handlerExit = Clock::now();
+
+        recordLatencies(handlerEntry, handlerExit);
+    }
+
+    /* Publishes the files list at most once per publishInterval; a skipped one is made when it passes */
+    void publishSnapshot()
+    {
+        if (!sharedSnapshot)
+        {
+            return;
+        }
+
+        const auto now = Clock::now();
+        if (now < nextPublishTime)
+        {
+            isSnapshotStale = true;
+            return;
+        }
+
+        sharedSnapshot->publish(path, files, filesIndex.get());
+        nextPublishTime = now + publishInterval;
+        isSnapshotStale = false;
+    }
+
+    void recordLatencies(Clock::time_point handlerEntry, Clock::time_point handlerExit)
+    {
+        parseLatency.record(timestamps.parsed - timestamps.read);
+        updateLatency.record(timestamps.updated - timestamps.parsed);
+        dispatchLatency.record(handlerEntry - timestamps.updated);
+        handlerLatency.record(handlerExit - handlerEntry);
+        totalLatency.record(handlerExit - timestamps.read);
+    }
+
+    /* Records the stages of a batch taken without the handler (see takeBatch) */
+    void recordDeliveryLatencies(Clock::time_point delivery)
+    {
+        parseLatency.record(timestamps.parsed - timestamps.read);
+        updateLatency.record(timestamps.updated - timestamps.parsed);
+        dispatchLatency.record(delivery - timestamps.updated);
+        totalLatency.record(delivery - timestamps.read);
+    }
+
+    void updateStatistics()
+    {
+        // the files of a resumed watcher have been counted already, when they were added
+        if (!isSnapshotCollected)
+        {
+            std::uint64_t eventsCount[4]{ 0, 0, 0, 0 };
+            for (const auto &change : changes)
+            {
+                ++eventsCount[static_cast<std::size_t>(change.getType())];
+            }
+
+            using Type = ChangeEntry::ChangeType;
+            statistics->addEvents(eventsCount[static_cast<std::size_t>(Type::add)],
+                                  eventsCount[static_cast<std::size_t>(Type::remove)],
+                                  eventsCount[static_cast<std::size_t>(Type::rename)],
+                                  eventsCount[static_cast<std::size_t>(Type::modify)]);
+            statistics->addBatch(changes.size());
+        }
+        isSnapshotCollected = false;
+
+        statistics->setFilesSet(files.size(), files.getMemoryUsage());
+        statistics->setChangesMemory(changes.getMemoryUsage() + 2 * std::size_t(changesBufferSize));
     }
 };  // class DirectoryWatcher::Impl
 
 
+constexpr std::chrono::milliseconds DirectoryWatcher::Impl::renamePairTimeout;
+
+
 DirectoryWatcher::DirectoryWatcher(const filesystem::Path &path)
-    : pImpl(std::make_unique<Impl>(*this, path))
+    : DirectoryWatcher(path, Options())
 {
 }
 
 DirectoryWatcher::DirectoryWatcher(filesystem::Path &&path)
-    : pImpl(std::make_unique<Impl>(*this, std::move(path)))
+    : DirectoryWatcher(std::move(path), Options())
+{
+}
+
+DirectoryWatcher::DirectoryWatcher(const filesystem::Path &path, const Options &options)
+    : pImpl(std::make_unique<Impl>(*this, path, options))
+{
+}
+
+DirectoryWatcher::DirectoryWatcher(filesystem::Path &&path, const Options &options)
+    : pImpl(std::make_unique<Impl>(*this, std::move(path), options))
 {
 }
 
@@ -447,11 +2108,119 @@ void DirectoryWatcher::stopWatch()
 }
 
 
+void DirectoryWatcher::retarget(const filesystem::Path &path)
+{
+    pImpl->retarget(filesystem::Path(path));
+}
+
+void DirectoryWatcher::retarget(filesystem::Path &&path)
+{
+    pImpl->retarget(std::move(path));
+}
+
+
 const filesystem::Path& DirectoryWatcher::getPath() const
 {
     return pImpl->getPath();
 }
 
+bool DirectoryWatcher::isTrackingPath() const
+{
+    return pImpl->isTrackingPath();
+}
+
+
+const FileIndex* DirectoryWatcher::getFilesIndex() const
+{
+    return pImpl->getFilesIndex();
+}
+
+const DirectoryAggregates* DirectoryWatcher::getDirectoryAggregates() const
+{
+    return pImpl->getDirectoryAggregates();
+}
+
+const PathSearchIndex* DirectoryWatcher::getPathSearchIndex() const
+{
+    return pImpl->getPathSearchIndex();
+}
+
+
+DirectoryWatcher::LatencyStats DirectoryWatcher::getLatencyStats() const
+{
+    return pImpl->getLatencyStats();
+}
+
+WatcherStatistics::Snapshot DirectoryWatcher::getStatistics() const
+{
+    return pImpl->getStatistics();
+}
+
+DirectoryWatcher::Backend DirectoryWatcher::getBackend() const
+{
+    return pImpl->getBackend();
+}
+
+
+DirectoryWatcher::BatchAwaiter DirectoryWatcher::nextBatch()
+{
+    return BatchAwaiter(*this, nullptr);
+}
+
+DirectoryWatcher::BatchAwaiter DirectoryWatcher::nextBatch(Executor executor)
+{
+    return BatchAwaiter(*this, std::move(executor));
+}
+
+
+DirectoryWatcher::NativeHandle DirectoryWatcher::getReadinessHandle()
+{
+    return pImpl->getReadinessHandle();
+}
+
+bool DirectoryWatcher::processPending(const std::function<void(ChangeIterator, ChangeIterator)> &changeHandler,
+                                      std::size_t maxEvents)
+{
+    return pImpl->processPending(changeHandler, maxEvents);
+}
+
+
+DirectoryWatcher::BatchAwaiter::BatchAwaiter(DirectoryWatcher &watcher, Executor &&executor)
+    : watcher(watcher), executor(std::move(executor))
+{
+}
+
+bool DirectoryWatcher::BatchAwaiter::await_ready()
+{
+    return watcher.pImpl->tryNextBatch();
+}
+
+void DirectoryWatcher::BatchAwaiter::suspend(std::function<void()> &&continuation)
+{
+    if (executor)
+    {
+        watcher.pImpl->awaitNextBatch([executor = executor, continuation = std::move(continuation)]
+                                      {
+                                          executor(continuation);
+                                      },
+                                      error);
+    }
+    else
+    {
+        watcher.pImpl->awaitNextBatch(std::move(continuation), error);
+    }
+}
+
+DirectoryWatcher::ChangeBatch DirectoryWatcher::BatchAwaiter::await_resume()
+{
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+
+    return watcher.pImpl->takeBatch();
+}
+
 #else   //#ifdef _WIN32
 
 #error "Macro _WIN32 isn't defined. Check target OS (required Windows) for this build"
@@ -0,0 +1,334 @@
+#ifdef _WIN32
+
+#include "../event_recording.h"
+#include "win_extend_path_limit.h"
+#include <system_error>         // std::system_error
+#include <stdexcept>            // std::runtime_error, std::length_error
+#include <limits>               // std::numeric_limits
+#include <algorithm>            // std::min
+#include <cstring>              // std::memcpy
+#include <cstddef>              // offsetof
+#include <Windows.h>            // WinAPI
+
+
+namespace
+{
+    constexpr std::uint32_t recordingMagic = 0x52455744;    // "DWER"
+    constexpr std::uint32_t formatVersion = 1;
+
+    struct FileHeader
+    {
+        std::uint32_t magic;
+        std::uint32_t version;
+    };
+
+    struct RecordHeader
+    {
+        std::uint64_t time;         // microseconds since the recording start
+        std::uint32_t size;
+        std::uint32_t reserved;
+    };
+
+    constexpr std::size_t recordAlignment = 8;
+
+    static_assert(sizeof(FileHeader) % recordAlignment == 0, "records must stay aligned");
+    static_assert(sizeof(RecordHeader) % recordAlignment == 0, "records must stay aligned");
+
+
+    constexpr std::size_t alignUp(std::size_t value)
+    {
+        return (value + recordAlignment - 1) / recordAlignment * recordAlignment;
+    }
+
+
+    class HandleGuard
+    {
+    public:
+        HandleGuard(HANDLE handle) : handle(handle) {}
+        ~HandleGuard() { CloseHandle(handle); }
+
+    private:
+        const HANDLE handle;
+
+        HandleGuard(const HandleGuard&) = delete;
+        HandleGuard& operator=(const HandleGuard&) = delete;
+    };
+
+
+    void writeAll(HANDLE file, const void *data, std::size_t size)
+    {
+        DWORD written;
+        if (!WriteFile(file, data, static_cast<DWORD>(size), &written, NULL))
+        {
+            throw std::system_error(GetLastError(), std::system_category());
+        }
+        if (written != size)
+        {
+            throw std::system_error(ERROR_WRITE_FAULT, std::system_category());
+        }
+    }
+}
+
+
+class ChangeEventRecorder::Impl
+{
+public:
+    explicit Impl(const filesystem::Path &file)
+        : file(CreateFileW(MAKE_EXTENDED_PATH(file).c_str(),
+                           GENERIC_WRITE,
+                           FILE_SHARE_READ,
+                           nullptr,
+                           CREATE_ALWAYS,
+                           FILE_FLAG_SEQUENTIAL_SCAN,
+                           nullptr)),
+          start(ChangeEventSource::Clock::now())
+    {
+        if (this->file == INVALID_HANDLE_VALUE)
+        {
+            throw std::system_error(GetLastError(), std::system_category());
+        }
+
+        try
+        {
+            const FileHeader header{recordingMagic, formatVersion};
+            writeAll(this->file, &header, sizeof(header));
+        }
+        catch (...)
+        {
+            CloseHandle(this->file);
+            throw;
+        }
+    }
+
+    ~Impl()
+    {
+        CloseHandle(file);
+    }
+
+    void record(const void *buffer, std::size_t size)
+    {
+        if (size > std::numeric_limits<std::uint32_t>::max())
+        {
+            throw std::length_error("The buffer is too large to be recorded");
+        }
+
+        const auto elapsed = ChangeEventSource::Clock::now() - start;
+        const RecordHeader header{
+            static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count()),
+            static_cast<std::uint32_t>(size),
+            0};
+
+        // the record is written by a single call, so the file holds whole records only
+        scratch.assign(sizeof(header) + alignUp(size), 0);
+        std::memcpy(scratch.data(), &header, sizeof(header));
+        if (size != 0)
+        {
+            std::memcpy(scratch.data() + sizeof(header), buffer, size);
+        }
+
+        writeAll(file, scratch.data(), scratch.size());
+        ++recordsCount;
+    }
+
+    std::size_t getRecordsCount() const
+    {
+        return recordsCount;
+    }
+
+private:
+    const HANDLE file;
+    const ChangeEventSource::Clock::time_point start;
+    std::vector<std::uint8_t> scratch;      // reused storage of the record being written
+    std::size_t recordsCount = 0;
+};
+
+
+ChangeEventRecorder::ChangeEventRecorder(const filesystem::Path &file)
+    : pImpl(std::make_unique<Impl>(file))
+{
+}
+
+ChangeEventRecorder::~ChangeEventRecorder() = default;
+
+void ChangeEventRecorder::record(const void *buffer, std::size_t size)
+{
+    pImpl->record(buffer, size);
+}
+
+std::size_t ChangeEventRecorder::getRecordsCount() const
+{
+    return pImpl->getRecordsCount();
+}
+
+
+ChangeEventReplayer::ChangeEventReplayer(const filesystem::Path &file, Pace pace)
+    : pace(pace), position(0)
+{
+    const HANDLE handle = CreateFileW(MAKE_EXTENDED_PATH(file).c_str(),
+                                      GENERIC_READ,
+                                      FILE_SHARE_READ | FILE_SHARE_WRITE,
+                                      nullptr,
+                                      OPEN_EXISTING,
+                                      FILE_FLAG_SEQUENTIAL_SCAN,
+                                      nullptr);
+    if (handle == INVALID_HANDLE_VALUE)
+    {
+        throw std::system_error(GetLastError(), std::system_category());
+    }
+    const HandleGuard handleGuard(handle);
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(handle, &fileSize))
+    {
+        throw std::system_error(GetLastError(), std::system_category());
+    }
+    if (static_cast<std::uint64_t>(fileSize.QuadPart) > std::numeric_limits<std::size_t>::max())
+    {
+        throw std::runtime_error("The recording is too large");
+    }
+
+    data.resize(static_cast<std::size_t>(fileSize.QuadPart));
+    for (std::size_t offset = 0; offset < data.size();)
+    {
+        const auto chunk = static_cast<DWORD>(std::min<std::size_t>(data.size() - offset, 1 << 30));
+
+        DWORD bytesRead;
+        if (!ReadFile(handle, data.data() + offset, chunk, &bytesRead, NULL))
+        {
+            throw std::system_error(GetLastError(), std::system_category());
+        }
+        if (bytesRead == 0)     // the file has been truncated meanwhile
+        {
+            data.resize(offset);
+            break;
+        }
+
+        offset += bytesRead;
+    }
+
+    FileHeader fileHeader;
+    if (data.size() < sizeof(fileHeader))
+    {
+        throw std::runtime_error("The file isn't a recording of change events");
+    }
+    std::memcpy(&fileHeader, data.data(), sizeof(fileHeader));
+    if ((fileHeader.magic != recordingMagic) || (fileHeader.version != formatVersion))
+    {
+        throw std::runtime_error("The file isn't a recording of change events");
+    }
+
+    // a trailing partial record is dropped: the recording process may have been killed while writing it
+    std::size_t offset = sizeof(fileHeader);
+    while (data.size() - offset >= sizeof(RecordHeader))
+    {
+        RecordHeader header;
+        std::memcpy(&header, data.data() + offset, sizeof(header));
+        offset += sizeof(header);
+
+        if (data.size() - offset < alignUp(header.size))
+        {
+            break;
+        }
+        if (!isValidBuffer(data.data() + offset, header.size))
+        {
+            throw std::runtime_error("The recording of change events is corrupted");
+        }
+
+        records.push_back({header.time, offset, header.size});
+        offset += alignUp(header.size);
+    }
+}
+
+ChangeEventReplayer::Clock::time_point ChangeEventReplayer::getNextTime() const
+{
+    const std::size_t next = position.load(std::memory_order_relaxed);
+    if (next == records.size())
+    {
+        return Clock::time_point::max();
+    }
+
+    if ((next == 0) || (pace == Pace::unlimited))
+    {
+        return Clock::time_point::min();
+    }
+
+    const auto interval = std::chrono::microseconds(records[next].time - records.front().time);
+    return start + std::chrono::duration_cast<Clock::duration>(interval);
+}
+
+bool ChangeEventReplayer::read(void *destination, std::size_t capacity, std::size_t &size)
+{
+    const std::size_t next = position.load(std::memory_order_relaxed);
+    if ((next == records.size()) || (getNextTime() > Clock::now()))
+    {
+        return false;
+    }
+
+    const Record &record = records[next];
+    if (record.size > capacity)
+    {
+        throw std::length_error("The recorded buffer exceeds the capacity");
+    }
+
+    if (next == 0)
+    {
+        start = Clock::now();
+    }
+
+    std::memcpy(destination, data.data() + record.offset, record.size);
+    size = record.size;
+    position.store(next + 1, std::memory_order_release);
+
+    return true;
+}
+
+std::size_t ChangeEventReplayer::size() const
+{
+    return records.size();
+}
+
+bool ChangeEventReplayer::isExhausted() const
+{
+    return position.load(std::memory_order_acquire) == records.size();
+}
+
+
+bool ChangeEventReplayer::isValidBuffer(const std::uint8_t *buffer, std::size_t size)
+{
+    constexpr std::size_t nameOffset = offsetof(FILE_NOTIFY_INFORMATION, FileName);
+
+    std::size_t offset = 0;
+    while (offset < size)
+    {
+        if (size - offset < nameOffset)
+        {
+            return false;
+        }
+
+        FILE_NOTIFY_INFORMATION notify;
+        std::memcpy(&notify, buffer + offset, nameOffset);
+        if ((notify.FileNameLength % sizeof(WCHAR) != 0) || (size - offset - nameOffset < notify.FileNameLength))
+        {
+            return false;
+        }
+
+        if (notify.NextEntryOffset == 0)
+        {
+            return true;
+        }
+        if ((notify.NextEntryOffset % alignof(DWORD) != 0) || (notify.NextEntryOffset < nameOffset))
+        {
+            return false;
+        }
+
+        offset += notify.NextEntryOffset;
+    }
+
+    return size == 0;   // otherwise the last record points out of the buffer
+}
+
+#else   // #ifdef _WIN32
+
+#error "Macro _WIN32 isn't defined. Check target OS (required Windows) for this build"
+
+#endif  // #ifdef _WIN32
@@ -4,8 +4,91 @@
 #include "win_extend_path_limit.h"
 #include <system_error>         // std::system_error
 #include <ctime>                // std::time_t
+#include <cstring>              // std::memcpy
+#include <cstddef>              // std::size_t
+#include <algorithm>            // std::min
 #include <Windows.h>            // WinAPI
 
+
+namespace
+{
+    constexpr std::uint64_t sampledFileSize = 4 * 1024 * 1024;  // larger files are fingerprinted by chunks
+    constexpr std::uint64_t edgeChunkSize = 1024 * 1024;
+    constexpr std::uint64_t middleChunkSize = 64 * 1024;
+    constexpr std::uint64_t middleChunksCount = 32;
+
+    constexpr std::uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+    constexpr std::uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+    constexpr std::uint64_t prime3 = 0x165667B19E3779F9ULL;
+    constexpr std::size_t lanesCount = 4;
+    constexpr std::size_t stripeSize = lanesCount * sizeof(std::uint64_t);
+
+
+    class HandleGuard
+    {
+    public:
+        HandleGuard(HANDLE handle) : handle(handle) {}
+        ~HandleGuard() { CloseHandle(handle); }
+
+    private:
+        HANDLE handle;
+    };
+
+
+    inline std::uint64_t rotateLeft(std::uint64_t value, unsigned bits)
+    {
+        return (value << bits) | (value >> (64 - bits));
+    }
+
+    inline std::uint64_t mixLane(std::uint64_t lane, std::uint64_t input)
+    {
+        return rotateLeft(lane + input * prime2, 31) * prime1;
+    }
+
+    inline void mixStripe(std::uint64_t (&lanes)[lanesCount], const unsigned char *stripe)
+    {
+        // lanes are independent, so the loop is unrolled and vectorized by compilers
+        for (std::size_t i = 0; i < lanesCount; ++i)
+        {
+            std::uint64_t input;
+            std::memcpy(&input, stripe + i * sizeof(input), sizeof(input));
+            lanes[i] = mixLane(lanes[i], input);
+        }
+    }
+
+    /* Multi-lane hash of bytes; chunks are chained through seed */
+    std::uint64_t hashBytes(const unsigned char *data, std::size_t size, std::uint64_t seed)
+    {
+        std::uint64_t lanes[lanesCount] = { seed + prime1 + prime2, seed + prime2, seed, seed - prime1 };
+
+        const std::size_t stripesEnd = size - size % stripeSize;
+        for (std::size_t offset = 0; offset < stripesEnd; offset += stripeSize)
+        {
+            mixStripe(lanes, data + offset);
+        }
+
+        if (stripesEnd != size)
+        {
+            unsigned char lastStripe[stripeSize] = {};
+            std::memcpy(lastStripe, data + stripesEnd, size - stripesEnd);
+            mixStripe(lanes, lastStripe);
+        }
+
+        std::uint64_t result = rotateLeft(lanes[0], 1) + rotateLeft(lanes[1], 7)
+                               + rotateLeft(lanes[2], 12) + rotateLeft(lanes[3], 18);
+        result ^= static_cast<std::uint64_t>(size) * prime3;
+
+        result ^= result >> 33;
+        result *= prime2;
+        result ^= result >> 29;
+        result *= prime3;
+        result ^= result >> 32;
+
+        return result;
+    }
+}
+
+
 namespace filesystem
 {
     bool isExists(const Path &path)
@@ -80,6 +163,82 @@ namespace filesystem
     }
 
 
+    std::uint64_t getContentFingerprint(const Path &path)
+    {
+        const HANDLE file = CreateFileW(MAKE_EXTENDED_PATH(path).c_str(),
+                                        GENERIC_READ,
+                                        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                        nullptr,
+                                        OPEN_EXISTING,
+                                        FILE_FLAG_SEQUENTIAL_SCAN,
+                                        nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            throw std::system_error(GetLastError(), std::system_category());
+        }
+        const HandleGuard fileGuard(file);
+
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size))
+        {
+            throw std::system_error(GetLastError(), std::system_category());
+        }
+
+        const auto fileSize = static_cast<std::uint64_t>(size.QuadPart);
+        std::uint64_t result = hashBytes(nullptr, 0, fileSize);
+        if (fileSize == 0)      // empty files can't be mapped
+        {
+            return result;
+        }
+
+        const HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping == nullptr)
+        {
+            throw std::system_error(GetLastError(), std::system_category());
+        }
+        const HandleGuard mappingGuard(mapping);
+
+        const auto hashChunk = [&result, mapping](std::uint64_t offset, std::uint64_t length)
+        {
+            const void *view = MapViewOfFile(mapping, FILE_MAP_READ,
+                                             static_cast<DWORD>(offset >> 32),
+                                             static_cast<DWORD>(offset & 0xFFFFFFFFULL),
+                                             static_cast<SIZE_T>(length));
+            if (view == nullptr)
+            {
+                throw std::system_error(GetLastError(), std::system_category());
+            }
+
+            result = hashBytes(static_cast<const unsigned char*>(view), static_cast<std::size_t>(length), result);
+            UnmapViewOfFile(view);
+        };
+
+        if (fileSize <= sampledFileSize)
+        {
+            hashChunk(0, fileSize);
+            return result;
+        }
+
+        // views must start at multiples of the allocation granularity
+        SYSTEM_INFO systemInfo;
+        GetSystemInfo(&systemInfo);
+        const std::uint64_t granularity = systemInfo.dwAllocationGranularity;
+
+        const std::uint64_t tailOffset = (fileSize - edgeChunkSize) / granularity * granularity;
+        const std::uint64_t step = (tailOffset - edgeChunkSize) / (middleChunksCount + 1);
+
+        hashChunk(0, edgeChunkSize);
+        for (std::uint64_t i = 1; i <= middleChunksCount; ++i)
+        {
+            const std::uint64_t offset = (edgeChunkSize + step * i) / granularity * granularity;
+            hashChunk(offset, std::min(middleChunkSize, tailOffset - offset));
+        }
+        hashChunk(tailOffset, fileSize - tailOffset);
+
+        return result;
+    }
+
+
     void rename(const Path &oldPath, const Path &newPath)
     {
         if (!MoveFileW(MAKE_EXTENDED_PATH(oldPath).c_str(), MAKE_EXTENDED_PATH(newPath).c_str()))
@@ -87,6 +246,32 @@ namespace filesystem
             throw std::system_error(GetLastError(), std::system_category());
         }
     }
+
+    void move(const Path &oldPath, const Path &newPath)
+    {
+        if (!MoveFileExW(MAKE_EXTENDED_PATH(oldPath).c_str(), MAKE_EXTENDED_PATH(newPath).c_str(),
+                         MOVEFILE_COPY_ALLOWED))
+        {
+            throw std::system_error(GetLastError(), std::system_category());
+        }
+    }
+
+    void remove(const Path &path)
+    {
+        const auto attributes = GetFileAttributesW(MAKE_EXTENDED_PATH(path).c_str());
+        if (attributes == INVALID_FILE_ATTRIBUTES)
+        {
+            throw std::system_error(GetLastError(), std::system_category());
+        }
+
+        const BOOL result = ((attributes & FILE_ATTRIBUTE_DIRECTORY) != 0)
+                            ? RemoveDirectoryW(MAKE_EXTENDED_PATH(path).c_str())
+                            : DeleteFileW(MAKE_EXTENDED_PATH(path).c_str());
+        if (!result)
+        {
+            throw std::system_error(GetLastError(), std::system_category());
+        }
+    }
 }
 
 #else   // #ifdef _WIN32
@@ -35,12 +35,41 @@ namespace filesystem
     }
 
 
+    Path::Path(Path &&src) noexcept
+        : path(std::move(src.path)), hash(src.hash), hashCached(src.hashCached)
+    {
+        src.hashCached = false;
+    }
+
+    Path& Path::operator=(Path &&right) noexcept
+    {
+        path = std::move(right.path);
+        hash = right.hash;
+        hashCached = right.hashCached;
+        right.hashCached = false;
+
+        return *this;
+    }
+
+
     const Path::string_type& Path::getPathString() const
     {
         return path;
     }
 
 
+    std::size_t Path::getHash() const
+    {
+        if (!hashCached)
+        {
+            hash = std::hash<string_type>()(path);
+            hashCached = true;
+        }
+
+        return hash;
+    }
+
+
     Path Path::getRelativePath() const
     {
         const auto pos = path.find(driveDelimiter);
@@ -67,6 +96,8 @@ namespace filesystem
 
     Path& Path::operator/=(const Path &right)
     {
+        hashCached = false;
+
         if (path.empty())
         {
             path = right.path;
@@ -96,9 +127,52 @@ namespace filesystem
     }
 
 
+    PathView::PathView()
+        : pathData(nullptr), length(0)
+    {
+    }
+
+    PathView::PathView(const char_type *pathData, std::size_t length)
+        : pathData(pathData), length(length)
+    {
+    }
+
+    PathView::PathView(const Path &path)
+        : pathData(path.getPathString().data()), length(path.getPathString().length())
+    {
+    }
+
+
+    const PathView::char_type* PathView::data() const
+    {
+        return pathData;
+    }
+
+    std::size_t PathView::size() const
+    {
+        return length;
+    }
+
+    bool PathView::empty() const
+    {
+        return length == 0;
+    }
+
+
+    PathView::operator Path() const
+    {
+        return Path(pathData, pathData + length);
+    }
+
+
     bool operator==(const Path &left, const Path &right)
     {
-        return left.getPathString() == right.getPathString();
+        if (left.hashCached && right.hashCached && (left.hash != right.hash))
+        {
+            return false;
+        }
+
+        return left.path == right.path;
     }
 
     bool operator!=(const Path &left, const Path &right)
@@ -0,0 +1,374 @@
+#ifdef _WIN32
+
+#include "../shared_snapshot.h"
+#include <atomic>               // sequence counters
+#include <system_error>         // std::system_error
+#include <algorithm>            // std::min
+#include <thread>               // std::this_thread::yield
+#include <new>                  // placement new
+#include <cstring>              // std::memcpy
+#include <utility>              // std::move
+#include <Windows.h>            // WinAPI
+
+
+namespace
+{
+    constexpr std::uint32_t regionMagic = 0x53444457;   // "WDDS"
+    constexpr std::uint32_t layoutVersion = 2;
+    constexpr std::size_t alignment = 64;
+
+    static_assert(sizeof(std::atomic<std::uint64_t>) == sizeof(std::uint64_t),
+                  "atomic counters must be plain words to be shared between processes");
+
+
+    struct RegionHeader
+    {
+        std::uint32_t magic;
+        std::uint32_t layout;
+        std::uint64_t bufferCapacity;
+        std::atomic<std::uint64_t> epoch;           // count of publications; the current buffer is epoch % 2
+        std::atomic<std::uint64_t> sequences[2];    // of the buffers; odd while the buffer is being written
+    };
+
+    /* A buffer is the header, the directory characters and the files as (FileHeader, characters) records */
+    struct BufferHeader
+    {
+        std::uint64_t version;
+        std::int64_t publishTime;       // nanoseconds since the system clock epoch
+        std::uint64_t usedBytes;        // including this header
+        std::uint32_t filesCount;
+        std::uint32_t directoryLength;
+        std::uint32_t complete;
+        std::uint32_t reserved;
+    };
+
+    struct FileHeader
+    {
+        std::uint64_t size;
+        std::int64_t modifyDate;        // nanoseconds since the system clock epoch
+        std::uint32_t length;           // of the name in characters
+        std::uint32_t hasAttributes;
+    };
+
+    using CharType = filesystem::Path::char_type;
+
+
+    constexpr std::size_t alignUp(std::size_t value)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    constexpr std::size_t headerSize = alignUp(sizeof(RegionHeader));
+
+    inline std::size_t getRegionSize(std::size_t bufferCapacity)
+    {
+        return headerSize + 2 * alignUp(bufferCapacity);
+    }
+
+    inline std::system_error makeLayoutError()
+    {
+        return std::system_error(std::make_error_code(std::errc::invalid_argument),
+                                 "Shared snapshot region has unknown layout");
+    }
+}
+
+
+class SharedSnapshotRegion
+{
+public:
+    SharedSnapshotRegion(HANDLE mapping, void *view)
+        : mapping(mapping), view(static_cast<unsigned char*>(view))
+    {
+    }
+
+    ~SharedSnapshotRegion()
+    {
+        UnmapViewOfFile(view);
+        CloseHandle(mapping);
+    }
+
+    RegionHeader& getHeader() const
+    {
+        return *reinterpret_cast<RegionHeader*>(view);
+    }
+
+    unsigned char* getBuffer(std::size_t index) const
+    {
+        return view + headerSize + index * alignUp(static_cast<std::size_t>(getHeader().bufferCapacity));
+    }
+
+private:
+    const HANDLE mapping;
+    unsigned char *const view;
+
+
+    SharedSnapshotRegion(const SharedSnapshotRegion&) = delete;
+    SharedSnapshotRegion& operator=(const SharedSnapshotRegion&) = delete;
+};
+
+
+SharedSnapshotWriter::SharedSnapshotWriter(const filesystem::Path::string_type &name, std::size_t capacity)
+{
+    if (capacity < sizeof(BufferHeader))
+    {
+        throw std::system_error(std::make_error_code(std::errc::invalid_argument), "Too small shared snapshot");
+    }
+
+    // the region is backed by the paging file, so it lives while any process keeps it opened
+    const std::uint64_t regionSize = getRegionSize(capacity);
+    const HANDLE mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+                                              static_cast<DWORD>(regionSize >> 32), static_cast<DWORD>(regionSize),
+                                              name.c_str());
+    if (mapping == NULL)
+    {
+        throw std::system_error(GetLastError(), std::system_category());
+    }
+    const bool existed = (GetLastError() == ERROR_ALREADY_EXISTS);
+
+    void *const view = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+    if (view == NULL)
+    {
+        const auto error = GetLastError();
+        CloseHandle(mapping);
+        throw std::system_error(error, std::system_category());
+    }
+
+    region = std::make_unique<SharedSnapshotRegion>(mapping, view);
+
+    auto &header = region->getHeader();
+    if (existed)
+    {
+        // the previous writer has gone while readers kept the region; publications are continued
+        if ((header.magic != regionMagic) || (header.layout != layoutVersion) || (header.bufferCapacity != capacity))
+        {
+            throw makeLayoutError();
+        }
+
+        // the previous writer may have died while writing a buffer; its odd sequence would stall readers forever.
+        // The buffer isn't current (the epoch hasn't been switched to it), so it's just marked as written
+        for (auto &sequence : header.sequences)
+        {
+            const std::uint64_t value = sequence.load(std::memory_order_relaxed);
+            sequence.store((value + 1) & ~std::uint64_t(1), std::memory_order_release);
+        }
+
+        return;
+    }
+
+    new (&header) RegionHeader();
+    header.layout = layoutVersion;
+    header.bufferCapacity = capacity;
+    header.epoch.store(0, std::memory_order_relaxed);
+    header.sequences[0].store(0, std::memory_order_relaxed);
+    header.sequences[1].store(0, std::memory_order_relaxed);
+
+    // readers check the magic first, so it's written last
+    std::atomic_thread_fence(std::memory_order_release);
+    header.magic = regionMagic;
+}
+
+SharedSnapshotWriter::~SharedSnapshotWriter() = default;
+
+
+bool SharedSnapshotWriter::publish(const filesystem::Path &directory, const PathSet &files,
+                                   const FileIndex *attributes)
+{
+    auto &header = region->getHeader();
+    const std::size_t capacity = static_cast<std::size_t>(header.bufferCapacity);
+
+    // the writer is single, so the epoch is changed by this thread only
+    const std::uint64_t epoch = header.epoch.load(std::memory_order_relaxed);
+    const std::size_t index = (epoch + 1) % 2;
+    unsigned char *const buffer = region->getBuffer(index);
+
+    auto &sequence = header.sequences[index];
+    const std::uint64_t sequenceValue = sequence.load(std::memory_order_relaxed);
+    sequence.store(sequenceValue + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    BufferHeader bufferHeader{};
+    bufferHeader.version = epoch + 1;
+    bufferHeader.publishTime = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    bufferHeader.complete = 1;
+
+    std::size_t used = sizeof(BufferHeader);
+
+    const auto &directoryString = directory.getPathString();
+    const std::size_t directoryBytes = directoryString.length() * sizeof(CharType);
+    if (used + directoryBytes <= capacity)
+    {
+        std::memcpy(buffer + used, directoryString.data(), directoryBytes);
+        bufferHeader.directoryLength = static_cast<std::uint32_t>(directoryString.length());
+        used += directoryBytes;
+    }
+    else
+    {
+        bufferHeader.complete = 0;
+    }
+
+    for (std::size_t i = 0; (i < files.size()) && (bufferHeader.complete != 0); ++i)
+    {
+        const auto file = files[i];
+
+        FileHeader fileHeader{};
+        fileHeader.length = static_cast<std::uint32_t>(file.size());
+        const std::size_t fileBytes = sizeof(fileHeader) + fileHeader.length * sizeof(CharType);
+        if (used + fileBytes > capacity)
+        {
+            bufferHeader.complete = 0;
+            break;
+        }
+
+        FileIndex::TimePoint modifyDate;
+        if ((attributes != nullptr) && attributes->getAttributes(file, fileHeader.size, modifyDate))
+        {
+            fileHeader.modifyDate = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                modifyDate.time_since_epoch()).count();
+            fileHeader.hasAttributes = 1;
+        }
+
+        std::memcpy(buffer + used, &fileHeader, sizeof(fileHeader));
+        std::memcpy(buffer + used + sizeof(fileHeader), file.data(), fileHeader.length * sizeof(CharType));
+        used += fileBytes;
+        ++bufferHeader.filesCount;
+    }
+
+    bufferHeader.usedBytes = used;
+    std::memcpy(buffer, &bufferHeader, sizeof(bufferHeader));
+
+    sequence.store(sequenceValue + 2, std::memory_order_release);
+    header.epoch.store(epoch + 1, std::memory_order_release);
+
+    return bufferHeader.complete != 0;
+}
+
+
+SharedSnapshotReader::SharedSnapshotReader(const filesystem::Path::string_type &name)
+{
+    const HANDLE mapping = OpenFileMappingW(FILE_MAP_READ, FALSE, name.c_str());
+    if (mapping == NULL)
+    {
+        throw std::system_error(GetLastError(), std::system_category());
+    }
+
+    void *const view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (view == NULL)
+    {
+        const auto error = GetLastError();
+        CloseHandle(mapping);
+        throw std::system_error(error, std::system_category());
+    }
+
+    region = std::make_unique<SharedSnapshotRegion>(mapping, view);
+
+    const auto &header = region->getHeader();
+    if (header.magic != regionMagic)
+    {
+        throw makeLayoutError();
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if ((header.layout != layoutVersion) || (header.bufferCapacity < sizeof(BufferHeader)))
+    {
+        throw makeLayoutError();
+    }
+}
+
+SharedSnapshotReader::~SharedSnapshotReader() = default;
+
+
+std::uint64_t SharedSnapshotReader::getVersion() const
+{
+    return region->getHeader().epoch.load(std::memory_order_acquire);
+}
+
+SharedSnapshotReader::Snapshot SharedSnapshotReader::read() const
+{
+    const auto &header = region->getHeader();
+    const std::size_t capacity = static_cast<std::size_t>(header.bufferCapacity);
+
+    std::vector<unsigned char> copy;
+    BufferHeader bufferHeader;
+
+    for (;;)
+    {
+        const std::uint64_t epoch = header.epoch.load(std::memory_order_acquire);
+        if (epoch == 0)
+        {
+            return {};
+        }
+
+        const std::size_t index = epoch % 2;
+        const std::uint64_t sequenceValue = header.sequences[index].load(std::memory_order_acquire);
+        if ((sequenceValue % 2) != 0)   // the writer has published twice since the epoch was loaded
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        const unsigned char *const buffer = region->getBuffer(index);
+        std::memcpy(&bufferHeader, buffer, sizeof(bufferHeader));
+        const std::size_t used = static_cast<std::size_t>(std::min<std::uint64_t>(bufferHeader.usedBytes, capacity));
+        copy.assign(buffer, buffer + used);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (header.sequences[index].load(std::memory_order_relaxed) == sequenceValue)
+        {
+            break;
+        }
+    }
+
+    Snapshot result;
+    result.version = bufferHeader.version;
+    result.publishTime = std::chrono::system_clock::time_point(std::chrono::duration_cast<
+        std::chrono::system_clock::duration>(std::chrono::nanoseconds(bufferHeader.publishTime)));
+    result.complete = (bufferHeader.complete != 0);
+
+    // the copy is consistent, but lengths are still checked against its size
+    std::size_t offset = sizeof(BufferHeader);
+    const std::size_t directoryBytes = bufferHeader.directoryLength * sizeof(CharType);
+    if (offset + directoryBytes > copy.size())
+    {
+        throw makeLayoutError();
+    }
+
+    const auto *directoryChars = reinterpret_cast<const CharType*>(copy.data() + offset);
+    result.directory = filesystem::Path(directoryChars, directoryChars + bufferHeader.directoryLength);
+    offset += directoryBytes;
+
+    result.files.reserve(bufferHeader.filesCount);
+    for (std::uint32_t i = 0; i < bufferHeader.filesCount; ++i)
+    {
+        FileHeader fileHeader;
+        if (offset + sizeof(fileHeader) > copy.size())
+        {
+            throw makeLayoutError();
+        }
+        std::memcpy(&fileHeader, copy.data() + offset, sizeof(fileHeader));
+        offset += sizeof(fileHeader);
+
+        if (offset + fileHeader.length * sizeof(CharType) > copy.size())
+        {
+            throw makeLayoutError();
+        }
+
+        const auto *fileChars = reinterpret_cast<const CharType*>(copy.data() + offset);
+
+        File file;
+        file.path = filesystem::Path(fileChars, fileChars + fileHeader.length);
+        file.hasAttributes = (fileHeader.hasAttributes != 0);
+        file.size = fileHeader.size;
+        file.modifyDate = std::chrono::system_clock::time_point(std::chrono::duration_cast<
+            std::chrono::system_clock::duration>(std::chrono::nanoseconds(fileHeader.modifyDate)));
+        result.files.push_back(std::move(file));
+        offset += fileHeader.length * sizeof(CharType);
+    }
+
+    return result;
+}
+
+#else   // #ifdef _WIN32
+
+#error "Macro _WIN32 isn't defined. Check target OS (required Windows) for this build"
+
+#endif  // #ifdef _WIN32
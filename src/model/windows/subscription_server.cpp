@@ -0,0 +1,704 @@
+#ifdef _WIN32
+
+#include "../subscription_server.h"
+#include "../path_set.h"
+#include <thread>               // I/O thread
+#include <mutex>
+#include <list>                 // subscribers
+#include <deque>                // queued messages
+#include <vector>               // messages, wait handles
+#include <system_error>         // std::system_error
+#include <utility>              // std::move
+#include <cstring>              // std::memcpy
+#include <Windows.h>            // WinAPI
+
+
+constexpr std::size_t SubscriptionServer::defaultMaxQueuedBytes;
+constexpr std::size_t SubscriptionServer::maxSubscribers;
+
+
+class SubscriptionServer::Impl
+{
+public:
+    Impl(const filesystem::Path::string_type &pipeName, std::size_t maxQueuedBytes)
+        : pipeName(pipeName), maxQueuedBytes(maxQueuedBytes),
+          stopEvent(createEvent(FALSE)), wakeEvent(createEvent(FALSE)), connectEvent(createEvent(TRUE)),
+          listeningPipe(createPipe())
+    {
+        listen();
+        ioThread = std::thread(&Impl::ioRoutine, this);
+    }
+
+    ~Impl()
+    {
+        SetEvent(stopEvent.getHandle());
+        if (ioThread.joinable())
+        {
+            ioThread.join();
+        }
+    }
+
+
+    std::size_t getSubscribersCount() const
+    {
+        std::lock_guard<decltype(mutex)> lock(mutex);
+        return subscribers.size();
+    }
+
+
+    /* The tracked files are reported by the batches of the new scan, so subscribers get an empty snapshot first */
+    void reset(const filesystem::Path &newDirectory)
+    {
+        {
+            std::lock_guard<decltype(mutex)> lock(mutex);
+
+            directory = newDirectory;
+            files.clear();
+            ++sequence;
+            for (auto &subscriber : subscribers)
+            {
+                requestResync(*subscriber);
+            }
+        }
+
+        SetEvent(wakeEvent.getHandle());
+    }
+
+    void publish(const DirectoryWatcher::ChangeBatch &batch)
+    {
+        {
+            std::lock_guard<decltype(mutex)> lock(mutex);
+
+            updateFiles(batch);
+            ++sequence;
+
+            // subscribers without prefix share the same message
+            std::shared_ptr<const Message> unfiltered;
+            for (auto &subscriber : subscribers)
+            {
+                if (!subscriber->isRegistered || subscriber->needsResync)
+                {
+                    continue;
+                }
+
+                std::shared_ptr<const Message> message;
+                if (subscriber->prefix.empty())
+                {
+                    if (!unfiltered)
+                    {
+                        unfiltered = encodeBatch(batch, string_type());
+                    }
+                    message = unfiltered;
+                }
+                else
+                {
+                    message = encodeBatch(batch, subscriber->prefix);
+                }
+
+                if (message)
+                {
+                    enqueue(*subscriber, std::move(message));
+                }
+            }
+        }
+
+        SetEvent(wakeEvent.getHandle());
+    }
+
+private:
+    using string_type = filesystem::Path::string_type;
+    using char_type = filesystem::Path::char_type;
+    using Message = std::vector<unsigned char>;
+
+    static constexpr DWORD pipeBufferSize = 64 * 1024;
+    static constexpr std::size_t maxPrefixLength = 4096;
+
+
+    class RAIIHandle
+    {
+    public:
+        RAIIHandle(HANDLE handle) : handle(handle) {}
+        ~RAIIHandle() { CloseHandle(handle); }
+
+        HANDLE getHandle() const { return handle; }
+        void reset(HANDLE newHandle) { CloseHandle(handle); handle = newHandle; }
+        void swap(RAIIHandle &other) { std::swap(handle, other.handle); }
+
+    private:
+        HANDLE handle;
+    };
+
+    struct Subscriber
+    {
+        Subscriber() : pipe(NULL), event(createEvent(TRUE))
+        {
+            overlapped = {};
+            overlapped.hEvent = event.getHandle();
+        }
+
+        RAIIHandle pipe;
+        RAIIHandle event;
+        OVERLAPPED overlapped;      // of the pending read of the registration or of the pending write
+        bool isPending = false;
+
+        bool isRegistered = false;
+        string_type prefix;
+        std::vector<char_type> registration;
+
+        // guarded by the mutex
+        std::deque<std::shared_ptr<const Message>> queue;   // the front one is being written if isWriting
+        std::size_t queuedBytes = 0;       // of the queued batches; the snapshot isn't counted
+        bool isSnapshotQueued = false;      // the front message is a snapshot
+        bool isWriting = false;
+        bool needsResync = false;
+    };
+
+    using Subscribers = std::list<std::unique_ptr<Subscriber>>;
+
+
+    const string_type pipeName;
+    const std::size_t maxQueuedBytes;
+    RAIIHandle stopEvent, wakeEvent, connectEvent;
+    RAIIHandle listeningPipe;
+    OVERLAPPED connectOverlapped;
+    bool isListening = false;
+
+    mutable std::mutex mutex;
+    Subscribers subscribers;
+    filesystem::Path directory;
+    PathSet files;                  // mirror of the tracked files for snapshots
+    std::uint64_t sequence = 0;
+
+    std::thread ioThread;
+
+
+    static HANDLE createEvent(BOOL manualReset)
+    {
+        const HANDLE result = CreateEvent(NULL, manualReset, FALSE, NULL);
+        if (result == NULL)
+        {
+            throw std::system_error(GetLastError(), std::system_category());
+        }
+
+        return result;
+    }
+
+    HANDLE createPipe() const
+    {
+        const HANDLE result = CreateNamedPipeW(pipeName.c_str(), PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED,
+                                               PIPE_TYPE_MESSAGE | PIPE_READMODE_MESSAGE | PIPE_WAIT |
+                                               PIPE_REJECT_REMOTE_CLIENTS,
+                                               PIPE_UNLIMITED_INSTANCES, pipeBufferSize, pipeBufferSize, 0, NULL);
+        if (result == INVALID_HANDLE_VALUE)
+        {
+            throw std::system_error(GetLastError(), std::system_category());
+        }
+
+        return result;
+    }
+
+
+    /*
+     * Pipe I/O
+     */
+
+    void listen()
+    {
+        connectOverlapped = {};
+        connectOverlapped.hEvent = connectEvent.getHandle();
+        ResetEvent(connectEvent.getHandle());
+
+        if (ConnectNamedPipe(listeningPipe.getHandle(), &connectOverlapped))
+        {
+            SetEvent(connectEvent.getHandle());
+        }
+        else
+        {
+            const auto error = GetLastError();
+            if (error == ERROR_PIPE_CONNECTED)      // the client has connected between creation and the call
+            {
+                SetEvent(connectEvent.getHandle());
+            }
+            else if (error != ERROR_IO_PENDING)
+            {
+                throw std::system_error(error, std::system_category());
+            }
+        }
+
+        isListening = true;
+    }
+
+    void ioRoutine()
+    {
+        std::vector<HANDLE> handles;
+        std::vector<Subscriber*> waited;
+
+        for (;;)
+        {
+            handles.assign({stopEvent.getHandle(), wakeEvent.getHandle()});
+            if (isListening)
+            {
+                handles.push_back(connectEvent.getHandle());
+            }
+
+            waited.clear();
+            for (auto &subscriber : subscribers)
+            {
+                if (subscriber->isPending)
+                {
+                    handles.push_back(subscriber->event.getHandle());
+                    waited.push_back(subscriber.get());
+                }
+            }
+
+            const DWORD result = WaitForMultipleObjects(static_cast<DWORD>(handles.size()), handles.data(),
+                                                        FALSE, INFINITE);
+            if ((result == WAIT_OBJECT_0) || (result == WAIT_FAILED))
+            {
+                break;
+            }
+
+            // the lowest signaled handle is reported only, so all of them are checked
+            try
+            {
+                if (isListening && (WaitForSingleObject(connectEvent.getHandle(), 0) == WAIT_OBJECT_0))
+                {
+                    accept();
+                }
+
+                for (Subscriber *subscriber : waited)
+                {
+                    if (WaitForSingleObject(subscriber->event.getHandle(), 0) == WAIT_OBJECT_0)
+                    {
+                        complete(*subscriber);
+                    }
+                }
+
+                startWrites();
+            }
+            catch (const std::exception&)   // the server keeps serving the connected subscribers
+            {
+            }
+        }
+
+        shutdown();
+    }
+
+    void accept()
+    {
+        isListening = false;
+
+        DWORD transferred;
+        if (!GetOverlappedResult(listeningPipe.getHandle(), &connectOverlapped, &transferred, FALSE))
+        {
+            DisconnectNamedPipe(listeningPipe.getHandle());
+            listen();
+            return;
+        }
+
+        try
+        {
+            // the connected instance is handed to the subscriber; a new one is listening
+            auto subscriber = std::make_unique<Subscriber>();
+            subscriber->pipe.reset(createPipe());
+            subscriber->pipe.swap(listeningPipe);
+
+            subscriber->registration.resize(maxPrefixLength + 1);
+            if (startRead(*subscriber))
+            {
+                std::lock_guard<decltype(mutex)> lock(mutex);
+                subscribers.push_back(std::move(subscriber));
+            }
+        }
+        catch (...)
+        {
+            // the client is dropped if the handover has failed
+            DisconnectNamedPipe(listeningPipe.getHandle());
+            listen();
+            throw;
+        }
+
+        if (subscribers.size() < maxSubscribers)
+        {
+            listen();
+        }
+    }
+
+    bool startRead(Subscriber &subscriber)
+    {
+        ResetEvent(subscriber.event.getHandle());
+        const DWORD bytes = static_cast<DWORD>(subscriber.registration.size() * sizeof(char_type));
+        if (!ReadFile(subscriber.pipe.getHandle(), subscriber.registration.data(), bytes, NULL, &subscriber.overlapped) &&
+            (GetLastError() != ERROR_IO_PENDING))
+        {
+            return false;
+        }
+
+        subscriber.isPending = true;
+        return true;
+    }
+
+    void complete(Subscriber &subscriber)
+    {
+        subscriber.isPending = false;
+
+        DWORD transferred = 0;
+        const bool succeeded = GetOverlappedResult(subscriber.pipe.getHandle(), &subscriber.overlapped,
+                                                   &transferred, FALSE);
+
+        std::lock_guard<decltype(mutex)> lock(mutex);
+
+        if (!succeeded)     // the subscriber has disconnected or sent too long prefix
+        {
+            remove(subscriber);
+            return;
+        }
+
+        if (!subscriber.isRegistered)
+        {
+            const auto length = transferred / sizeof(char_type);
+            subscriber.prefix.assign(subscriber.registration.data(), length);
+            subscriber.registration = std::vector<char_type>();
+            subscriber.isRegistered = true;
+            subscriber.needsResync = true;
+            return;
+        }
+
+        if (subscriber.isSnapshotQueued)
+        {
+            subscriber.isSnapshotQueued = false;
+        }
+        else
+        {
+            subscriber.queuedBytes -= subscriber.queue.front()->size();
+        }
+        subscriber.queue.pop_front();
+        subscriber.isWriting = false;
+    }
+
+    void startWrites()
+    {
+        std::lock_guard<decltype(mutex)> lock(mutex);
+
+        for (auto iter = subscribers.begin(); iter != subscribers.end(); )
+        {
+            Subscriber &subscriber = **iter;
+            ++iter;
+
+            if (!subscriber.isRegistered || subscriber.isWriting)
+            {
+                continue;
+            }
+
+            if (subscriber.needsResync)
+            {
+                subscriber.queue.clear();
+                subscriber.queuedBytes = 0;
+                subscriber.needsResync = false;
+
+                // the snapshot doesn't consume the budget of batches, otherwise a listing larger than
+                // maxQueuedBytes would cause a resync on every next batch
+                subscriber.queue.push_back(encodeSnapshot(subscriber.prefix));
+                subscriber.isSnapshotQueued = true;
+            }
+
+            if (subscriber.queue.empty())
+            {
+                continue;
+            }
+
+            const auto &message = *subscriber.queue.front();
+            ResetEvent(subscriber.event.getHandle());
+            if (!WriteFile(subscriber.pipe.getHandle(), message.data(), static_cast<DWORD>(message.size()),
+                           NULL, &subscriber.overlapped) &&
+                (GetLastError() != ERROR_IO_PENDING))
+            {
+                remove(subscriber);
+                continue;
+            }
+
+            subscriber.isWriting = true;
+            subscriber.isPending = true;
+        }
+    }
+
+    /* Must be called under the lock; the subscriber mustn't have pending I/O */
+    void remove(Subscriber &subscriber)
+    {
+        for (auto iter = subscribers.begin(); iter != subscribers.end(); ++iter)
+        {
+            if (iter->get() == &subscriber)
+            {
+                DisconnectNamedPipe(subscriber.pipe.getHandle());
+                subscribers.erase(iter);
+                break;
+            }
+        }
+
+        if (!isListening && (subscribers.size() < maxSubscribers))
+        {
+            listen();
+        }
+    }
+
+    void shutdown()
+    {
+        if (isListening)
+        {
+            CancelIoEx(listeningPipe.getHandle(), &connectOverlapped);
+            DWORD transferred;
+            GetOverlappedResult(listeningPipe.getHandle(), &connectOverlapped, &transferred, TRUE);
+        }
+
+        std::lock_guard<decltype(mutex)> lock(mutex);
+
+        // the buffers of pending operations must live until the operations complete
+        for (auto &subscriber : subscribers)
+        {
+            if (subscriber->isPending)
+            {
+                CancelIoEx(subscriber->pipe.getHandle(), &subscriber->overlapped);
+                DWORD transferred;
+                GetOverlappedResult(subscriber->pipe.getHandle(), &subscriber->overlapped, &transferred, TRUE);
+            }
+        }
+
+        subscribers.clear();
+    }
+
+
+    /*
+     * Messages
+     */
+
+    /* Must be called under the lock */
+    void enqueue(Subscriber &subscriber, std::shared_ptr<const Message> &&message)
+    {
+        // a batch larger than the limit is accepted by an empty queue, so it can't cause resyncs endlessly
+        if ((subscriber.queuedBytes != 0) && (subscriber.queuedBytes + message->size() > maxQueuedBytes))
+        {
+            requestResync(subscriber);
+            return;
+        }
+
+        subscriber.queuedBytes += message->size();
+        subscriber.queue.push_back(std::move(message));
+    }
+
+    /* Drops the queued messages except the one being written; must be called under the lock */
+    static void requestResync(Subscriber &subscriber)
+    {
+        if (!subscriber.isRegistered)
+        {
+            return;
+        }
+
+        const std::size_t keptCount = subscriber.isWriting ? 1 : 0;
+        while (subscriber.queue.size() > keptCount)
+        {
+            if ((subscriber.queue.size() == 1) && subscriber.isSnapshotQueued)
+            {
+                subscriber.isSnapshotQueued = false;
+            }
+            else
+            {
+                subscriber.queuedBytes -= subscriber.queue.back()->size();
+            }
+            subscriber.queue.pop_back();
+        }
+
+        subscriber.needsResync = true;
+    }
+
+    void updateFiles(const DirectoryWatcher::ChangeBatch &batch)
+    {
+        for (const auto &change : batch)
+        {
+            switch (change.getType())
+            {
+                case DirectoryWatcher::ChangeEntry::ChangeType::add:
+                    files.pushBack(change.getCurrentPath());
+                    break;
+                case DirectoryWatcher::ChangeEntry::ChangeType::remove:
+                {
+                    const auto position = files.find(change.getOldPath());
+                    if (position != PathSet::npos)
+                    {
+                        files.erase(position);
+                    }
+                    break;
+                }
+                case DirectoryWatcher::ChangeEntry::ChangeType::rename:
+                {
+                    const auto position = files.find(change.getOldPath());
+                    if (position != PathSet::npos)
+                    {
+                        files.assign(position, change.getCurrentPath());
+                    }
+                    break;
+                }
+                case DirectoryWatcher::ChangeEntry::ChangeType::modify:
+                    break;
+            }
+        }
+    }
+
+    static bool hasPrefix(filesystem::PathView path, const string_type &prefix)
+    {
+        return (path.size() >= prefix.length()) &&
+               (filesystem::PathCharTraits::compare(path.data(), prefix.data(), prefix.length()) == 0);
+    }
+
+    static void appendEntry(Message &message, DirectoryWatcher::ChangeEntry::ChangeType type,
+                            filesystem::PathView oldPath, filesystem::PathView currentPath)
+    {
+        EntryHeader header{};
+        header.type = static_cast<std::uint8_t>(type);
+        header.oldPathLength = static_cast<std::uint16_t>(oldPath.size());
+        header.currentPathLength = static_cast<std::uint16_t>(currentPath.size());
+
+        const auto offset = message.size();
+        message.resize(offset + sizeof(header) + (oldPath.size() + currentPath.size()) * sizeof(char_type));
+
+        unsigned char *data = message.data() + offset;
+        std::memcpy(data, &header, sizeof(header));
+        data += sizeof(header);
+        std::memcpy(data, oldPath.data(), oldPath.size() * sizeof(char_type));
+        data += oldPath.size() * sizeof(char_type);
+        std::memcpy(data, currentPath.data(), currentPath.size() * sizeof(char_type));
+    }
+
+    static void setHeader(Message &message, MessageType type, std::uint32_t count, std::uint64_t sequence)
+    {
+        const MessageHeader header{type, count, sequence};
+        std::memcpy(message.data(), &header, sizeof(header));
+    }
+
+    /* Returns nullptr if no entries match the prefix; must be called under the lock */
+    std::shared_ptr<const Message> encodeBatch(const DirectoryWatcher::ChangeBatch &batch,
+                                               const string_type &prefix) const
+    {
+        using ChangeType = DirectoryWatcher::ChangeEntry::ChangeType;
+
+        auto result = std::make_shared<Message>(sizeof(MessageHeader));
+        std::uint32_t count = 0;
+
+        for (const auto &change : batch)
+        {
+            const auto oldPath = change.getOldPath();
+            const auto currentPath = change.getCurrentPath();
+
+            if (change.getType() == ChangeType::rename)
+            {
+                // a rename across the prefix boundary is seen as a remove or an add by the subscriber
+                const bool oldMatches = hasPrefix(oldPath, prefix);
+                const bool currentMatches = hasPrefix(currentPath, prefix);
+                if (oldMatches && currentMatches)
+                {
+                    appendEntry(*result, ChangeType::rename, oldPath, currentPath);
+                }
+                else if (oldMatches)
+                {
+                    appendEntry(*result, ChangeType::remove, oldPath, filesystem::PathView());
+                }
+                else if (currentMatches)
+                {
+                    appendEntry(*result, ChangeType::add, filesystem::PathView(), currentPath);
+                }
+                else
+                {
+                    continue;
+                }
+            }
+            else if (hasPrefix((change.getType() == ChangeType::remove) ? oldPath : currentPath, prefix))
+            {
+                appendEntry(*result, change.getType(), oldPath, currentPath);
+            }
+            else
+            {
+                continue;
+            }
+
+            ++count;
+        }
+
+        if (count == 0)
+        {
+            return nullptr;
+        }
+
+        setHeader(*result, MessageType::batch, count, sequence);
+        return result;
+    }
+
+    /* Must be called under the lock */
+    std::shared_ptr<const Message> encodeSnapshot(const string_type &prefix) const
+    {
+        const auto &directoryString = directory.getPathString();
+        const auto directoryLength = static_cast<std::uint32_t>(directoryString.length());
+
+        auto result = std::make_shared<Message>(sizeof(MessageHeader) + sizeof(directoryLength) +
+                                                directoryLength * sizeof(char_type));
+        std::memcpy(result->data() + sizeof(MessageHeader), &directoryLength, sizeof(directoryLength));
+        std::memcpy(result->data() + sizeof(MessageHeader) + sizeof(directoryLength), directoryString.data(),
+                    directoryLength * sizeof(char_type));
+
+        std::uint32_t count = 0;
+        for (std::size_t i = 0; i < files.size(); ++i)
+        {
+            const auto file = files[i];
+            if (hasPrefix(file, prefix))
+            {
+                appendEntry(*result, DirectoryWatcher::ChangeEntry::ChangeType::add, filesystem::PathView(), file);
+                ++count;
+            }
+        }
+
+        setHeader(*result, MessageType::snapshot, count, sequence);
+        return result;
+    }
+};
+
+
+constexpr DWORD SubscriptionServer::Impl::pipeBufferSize;
+constexpr std::size_t SubscriptionServer::Impl::maxPrefixLength;
+
+
+SubscriptionServer::SubscriptionServer(const filesystem::Path::string_type &pipeName, std::size_t maxQueuedBytes)
+    : pImpl(std::make_unique<Impl>(pipeName, maxQueuedBytes))
+{
+}
+
+SubscriptionServer::~SubscriptionServer()
+{
+    // the built-in thread of the worker calls the overriders, so it's finished before pImpl is destroyed
+    shutdown();
+}
+
+
+std::size_t SubscriptionServer::getSubscribersCount() const
+{
+    return pImpl->getSubscribersCount();
+}
+
+
+void SubscriptionServer::onStart()
+{
+    pImpl->reset(getPath());
+}
+
+void SubscriptionServer::onStop(std::exception_ptr exception)
+{
+    (void)exception;    // subscribers keep the last state; the next run() resets it
+}
+
+void SubscriptionServer::onBatch(DirectoryWatcher::ChangeBatch &&batch)
+{
+    pImpl->publish(batch);
+}
+
+#else   // #ifdef _WIN32
+
+#error "Macro _WIN32 isn't defined. Check target OS (required Windows) for this build"
+
+#endif  // #ifdef _WIN32
@@ -0,0 +1,648 @@
+#ifdef _WIN32
+
+#include "../model/directory_watcher.h"
+#include "../model/file_operations.h"
+#include "../model/latency_histogram.h"
+#include "../model/watcher_statistics.h"
+#include "../model/path.h"
+#include "../model/windows/win_extend_path_limit.h"
+#include <iostream>             // std::cout, std::cerr
+#include <iomanip>              // std::setprecision
+#include <string>               // std::wstring, std::stoul
+#include <vector>               // threads, files of a worker
+#include <array>                // shards
+#include <deque>                // issue times of expected events
+#include <unordered_map>        // expected events
+#include <thread>               // workers, watching thread
+#include <mutex>                // std::mutex, std::lock_guard
+#include <condition_variable>   // readiness of the watcher
+#include <atomic>               // counters
+#include <random>               // operations mix
+#include <chrono>               // pacing, latencies
+#include <stdexcept>            // std::invalid_argument
+#include <utility>              // std::forward, std::move
+#include <system_error>         // std::system_error
+#include <exception>            // std::exception, std::exception_ptr
+#include <cstdint>              // std::uint64_t
+#include <cstddef>              // std::size_t
+#include <Windows.h>            // WinAPI
+#include <shellapi.h>           // CommandLineToArgvW
+
+
+/*
+ * dirwatch-loadgen drives a mix of file operations at a target rate from several threads in a fresh subdirectory
+ * of the scratch directory, while a DirectoryWatcher tracks the subdirectory. Every operation registers the change
+ * which it must produce; the handler matches delivered changes with them, so the report tells how many changes
+ * have been delivered (completeness), how many rescans system buffer overflows have caused and the latencies
+ * from the operation start till the handler call
+ *
+ * Usage: dirwatch-loadgen <scratch directory> [--threads N] [--rate N] [--duration S] [--mix C:R:D:M] [--drain MS]
+ *  --threads   -   count of threads performing operations (4 by default)
+ *  --rate      -   operations per second of all threads; 0 means as fast as possible (1000 by default)
+ *  --duration  -   seconds of the load (10 by default)
+ *  --mix       -   weights of creates, renames, deletes and modifies (4:2:3:1 by default)
+ *  --drain     -   milliseconds of awaiting of the changes which are still expected after the load (2000 by default)
+ */
+
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+    using ChangeType = DirectoryWatcher::ChangeEntry::ChangeType;
+
+    constexpr std::size_t changeTypesCount = 4;
+    constexpr std::size_t shardsCount = 16;
+
+
+    struct Settings
+    {
+        filesystem::Path scratchDirectory;
+        std::size_t threads = 4;
+        std::size_t rate = 1000;
+        std::chrono::seconds duration{10};
+        std::array<double, changeTypesCount> mix{{4, 2, 3, 1}};     // indexed as Operation
+        std::chrono::milliseconds drain{2000};
+    };
+
+    enum Operation{ create, rename, remove, modify };
+
+
+    /* Changes which operations have produced but the watcher hasn't delivered yet */
+    class ExpectedChanges
+    {
+    public:
+        /* Call before the operation, so the change can't be delivered before it's expected */
+        void expect(ChangeType type, const filesystem::Path &path, Clock::time_point issued)
+        {
+            Shard &shard = getShard(path);
+            std::lock_guard<decltype(shard.mutex)> lock(shard.mutex);
+            shard.pending[static_cast<std::size_t>(type)][path].push_back(issued);
+            ++expectedCount;
+        }
+
+        /* Withdraws the last expectation of the path after a failed operation */
+        void cancel(ChangeType type, const filesystem::Path &path)
+        {
+            Shard &shard = getShard(path);
+            std::lock_guard<decltype(shard.mutex)> lock(shard.mutex);
+
+            auto &pending = shard.pending[static_cast<std::size_t>(type)];
+            const auto times = pending.find(path);
+            if (times != pending.end())
+            {
+                times->second.pop_back();
+                if (times->second.empty())
+                {
+                    pending.erase(times);
+                }
+                --expectedCount;
+            }
+        }
+
+        /* Returns false if the change isn't expected (duplicates, changes reported by rescans, etc.) */
+        bool match(ChangeType type, const filesystem::Path &path, Clock::time_point delivered)
+        {
+            Clock::time_point issued;
+            {
+                Shard &shard = getShard(path);
+                std::lock_guard<decltype(shard.mutex)> lock(shard.mutex);
+
+                auto &pending = shard.pending[static_cast<std::size_t>(type)];
+                const auto times = pending.find(path);
+                if (times == pending.end())
+                {
+                    return false;
+                }
+
+                issued = times->second.front();
+                times->second.pop_front();
+                if (times->second.empty())
+                {
+                    pending.erase(times);
+                }
+            }
+
+            latency.record(delivered - issued);
+            ++matchedCount;
+            return true;
+        }
+
+        std::uint64_t getExpectedCount() const
+        {
+            return expectedCount.load();
+        }
+
+        std::uint64_t getMatchedCount() const
+        {
+            return matchedCount.load();
+        }
+
+        LatencyHistogram::Summary getLatency() const
+        {
+            return latency.summarize();
+        }
+
+    private:
+        using Pending = std::unordered_map<filesystem::Path, std::deque<Clock::time_point>>;
+
+        struct Shard
+        {
+            std::mutex mutex;
+            std::array<Pending, changeTypesCount> pending;     // by ChangeType
+        };
+
+        std::array<Shard, shardsCount> shards;
+        std::atomic<std::uint64_t> expectedCount{0}, matchedCount{0};
+        LatencyHistogram latency;
+
+
+        Shard& getShard(const filesystem::Path &path)
+        {
+            return shards[std::hash<filesystem::Path>()(path) % shardsCount];
+        }
+    };
+
+
+    struct OperationCounters
+    {
+        std::array<std::atomic<std::uint64_t>, changeTypesCount> done{};      // by Operation
+        std::atomic<std::uint64_t> failed{0};
+    };
+
+
+    void throwLastError()
+    {
+        throw std::system_error(GetLastError(), std::system_category());
+    }
+
+    void createFile(const filesystem::Path &path)
+    {
+        const HANDLE file = CreateFileW(MAKE_EXTENDED_PATH(path).c_str(), GENERIC_WRITE, 0, nullptr,
+                                        CREATE_NEW, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            throwLastError();
+        }
+        CloseHandle(file);
+    }
+
+    void appendToFile(const filesystem::Path &path)
+    {
+        const HANDLE file = CreateFileW(MAKE_EXTENDED_PATH(path).c_str(), FILE_APPEND_DATA, 0, nullptr,
+                                        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            throwLastError();
+        }
+
+        static const char data[] = "dirwatch-loadgen\n";
+        DWORD written;
+        const BOOL result = WriteFile(file, data, sizeof(data) - 1, &written, nullptr);
+        const DWORD error = GetLastError();
+        CloseHandle(file);
+
+        if (!result)
+        {
+            throw std::system_error(error, std::system_category());
+        }
+    }
+
+    void deleteFile(const filesystem::Path &path)
+    {
+        if (!DeleteFileW(MAKE_EXTENDED_PATH(path).c_str()))
+        {
+            throwLastError();
+        }
+    }
+
+
+    /* Performs operations of one thread on its own files */
+    class Worker
+    {
+    public:
+        Worker(std::size_t id, const filesystem::Path &directory, const Settings &settings,
+               ExpectedChanges &expected, OperationCounters &counters)
+            : id(id), directory(directory), expected(expected), counters(counters),
+              random(static_cast<std::mt19937::result_type>(id + 1)),
+              chooseOperation(settings.mix.cbegin(), settings.mix.cend())
+        {
+        }
+
+        /* Deletes the remaining files of the worker; failures are ignored */
+        void removeFiles()
+        {
+            for (const auto &file : files)
+            {
+                const auto path = directory / file;
+                DeleteFileW(MAKE_EXTENDED_PATH(path).c_str());
+            }
+            files.clear();
+        }
+
+        /* Performs operations until deadline; interval == 0 means no pacing */
+        void run(Clock::time_point start, Clock::time_point deadline, Clock::duration interval)
+        {
+            auto next = start;
+            while (Clock::now() < deadline)
+            {
+                if (interval != Clock::duration::zero())
+                {
+                    // a lagging worker catches up without sleeping, so the achieved rate shows the lag
+                    std::this_thread::sleep_until(next);
+                    next += interval;
+                }
+
+                perform(static_cast<Operation>(chooseOperation(random)));
+            }
+        }
+
+    private:
+        const std::size_t id;
+        const filesystem::Path &directory;
+        ExpectedChanges &expected;
+        OperationCounters &counters;
+        std::mt19937 random;
+        std::discrete_distribution<int> chooseOperation;
+        std::vector<filesystem::Path> files;    // existing files of the worker (relative to directory)
+        std::uint64_t nextName = 0;
+
+
+        filesystem::Path makeName()
+        {
+            return filesystem::Path((L"lg" + std::to_wstring(id) + L"_" + std::to_wstring(nextName++)).c_str());
+        }
+
+        void perform(Operation operation)
+        {
+            if (files.empty())
+            {
+                operation = Operation::create;
+            }
+
+            const std::size_t index = (operation == Operation::create) ? 0
+                                    : std::uniform_int_distribution<std::size_t>(0, files.size() - 1)(random);
+
+            ChangeType type = ChangeType::add;
+            filesystem::Path expectedPath;
+
+            switch (operation)
+            {
+                case Operation::create:
+                    expectedPath = makeName();
+                    break;
+                case Operation::rename:
+                    type = ChangeType::rename;
+                    expectedPath = makeName();
+                    break;
+                case Operation::remove:
+                    type = ChangeType::remove;
+                    expectedPath = files[index];
+                    break;
+                case Operation::modify:
+                    type = ChangeType::modify;
+                    expectedPath = files[index];
+                    break;
+            }
+
+            expected.expect(type, expectedPath, Clock::now());
+            try
+            {
+                switch (operation)
+                {
+                    case Operation::create:
+                        createFile(directory / expectedPath);
+                        files.push_back(std::move(expectedPath));
+                        break;
+                    case Operation::rename:
+                        filesystem::rename(directory / files[index], directory / expectedPath);
+                        files[index] = std::move(expectedPath);
+                        break;
+                    case Operation::remove:
+                        deleteFile(directory / expectedPath);
+                        files[index] = std::move(files.back());
+                        files.pop_back();
+                        break;
+                    case Operation::modify:
+                        appendToFile(directory / expectedPath);
+                        break;
+                }
+            }
+            catch (const std::system_error&)
+            {
+                expected.cancel(type, expectedPath);
+                ++counters.failed;
+                return;
+            }
+
+            ++counters.done[operation];
+        }
+    };
+
+
+    Settings parseSettings(const std::vector<std::wstring> &argv)
+    {
+        const std::size_t argc = argv.size();
+        if (argc < 2)
+        {
+            throw std::invalid_argument("The scratch directory isn't specified");
+        }
+
+        Settings result;
+        result.scratchDirectory = filesystem::Path(argv[1].c_str());
+
+        for (std::size_t i = 2; i < argc; i += 2)
+        {
+            const std::wstring option = argv[i];
+            if (i + 1 == argc)
+            {
+                throw std::invalid_argument("An option value is missing");
+            }
+            const std::wstring value = argv[i + 1];
+
+            if (option == L"--threads")
+            {
+                result.threads = std::stoul(value);
+                if (result.threads == 0)
+                {
+                    throw std::invalid_argument("At least one thread is required");
+                }
+            }
+            else if (option == L"--rate")
+            {
+                result.rate = std::stoul(value);
+            }
+            else if (option == L"--duration")
+            {
+                result.duration = std::chrono::seconds(std::stoul(value));
+            }
+            else if (option == L"--drain")
+            {
+                result.drain = std::chrono::milliseconds(std::stoul(value));
+            }
+            else if (option == L"--mix")
+            {
+                std::size_t position = 0;
+                for (std::size_t operation = 0; operation < changeTypesCount; ++operation)
+                {
+                    std::size_t parsed;
+                    result.mix[operation] = std::stoul(value.substr(position), &parsed);
+                    position += parsed + 1;     // skips ':'
+                }
+
+                if ((result.mix[0] == 0) && (result.mix[1] == 0) && (result.mix[2] == 0) && (result.mix[3] == 0))
+                {
+                    throw std::invalid_argument("All weights of the mix are zero");
+                }
+            }
+            else
+            {
+                throw std::invalid_argument("Unknown option");
+            }
+        }
+
+        return result;
+    }
+
+    void printUsage()
+    {
+        std::cerr << "Usage: dirwatch-loadgen <scratch directory> [--threads N] [--rate N] [--duration S]"
+                     " [--mix C:R:D:M] [--drain MS]" << std::endl;
+    }
+
+    /* Runs startWatch in a thread; stops and joins it on destruction, so failures of the load don't leave it */
+    class WatchingThread
+    {
+    public:
+        template<typename Function>
+        WatchingThread(DirectoryWatcher &watcher, Function &&function)
+            : watcher(watcher), thread(std::forward<Function>(function))
+        {
+        }
+
+        ~WatchingThread()
+        {
+            try
+            {
+                stop();
+            }
+            catch (...)
+            {
+            }
+        }
+
+        void stop()
+        {
+            if (thread.joinable())
+            {
+                watcher.stopWatch();
+                thread.join();
+            }
+        }
+
+    private:
+        DirectoryWatcher &watcher;
+        std::thread thread;
+    };
+
+
+    double toMicroseconds(LatencyHistogram::Duration duration)
+    {
+        return std::chrono::duration<double, std::micro>(duration).count();
+    }
+
+
+    int run(const Settings &settings)
+    {
+        const filesystem::Path directory = settings.scratchDirectory /
+            filesystem::Path((L"dirwatch-loadgen-" + std::to_wstring(GetCurrentProcessId())).c_str());
+        if (!CreateDirectoryW(MAKE_EXTENDED_PATH(directory).c_str(), nullptr))
+        {
+            throwLastError();
+        }
+
+        ExpectedChanges expected;
+        OperationCounters counters;
+        std::atomic<std::uint64_t> unexpectedCount{0};
+
+        const filesystem::Path readyMarker(L"ready.marker");
+        std::mutex readyMutex;
+        std::condition_variable readyCondition;
+        bool isReady = false;
+        std::exception_ptr watchingError;
+
+        DirectoryWatcher::Options options;
+        options.statistics = std::make_shared<WatcherStatistics>();
+        DirectoryWatcher watcher(directory, options);
+
+        const auto setReady = [&]()
+        {
+            std::lock_guard<decltype(readyMutex)> lock(readyMutex);
+            isReady = true;
+            readyCondition.notify_one();
+        };
+
+        WatchingThread watchingThread(watcher, [&]()
+        {
+            try
+            {
+                watcher.startWatch([&](DirectoryWatcher::ChangeBatch &&batch)
+                {
+                    const auto delivered = Clock::now();
+                    for (const auto change : batch)
+                    {
+                        const auto type = change.getType();
+                        const filesystem::Path path = (type == ChangeType::remove) ? change.getOldPath()
+                                                                                    : change.getCurrentPath();
+
+                        if (path == readyMarker)
+                        {
+                            setReady();
+                        }
+                        else if (!expected.match(type, path, delivered))
+                        {
+                            ++unexpectedCount;
+                        }
+                    }
+                });
+            }
+            catch (...)
+            {
+                watchingError = std::current_exception();
+                setReady();
+            }
+        });
+
+        // changes made before the first read of the watcher aren't reported, so the marker is touched until it's seen
+        createFile(directory / readyMarker);
+        {
+            std::unique_lock<decltype(readyMutex)> lock(readyMutex);
+            while (!readyCondition.wait_for(lock, std::chrono::milliseconds(100), [&isReady]() { return isReady; }))
+            {
+                lock.unlock();
+                appendToFile(directory / readyMarker);
+                lock.lock();
+            }
+        }
+        if (watchingError)
+        {
+            std::rethrow_exception(watchingError);
+        }
+        deleteFile(directory / readyMarker);
+
+        std::vector<Worker> workers;
+        workers.reserve(settings.threads);
+        for (std::size_t id = 0; id < settings.threads; ++id)
+        {
+            workers.emplace_back(id, directory, settings, expected, counters);
+        }
+
+        const auto interval = (settings.rate == 0)
+            ? Clock::duration::zero()
+            : std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(
+                  static_cast<double>(settings.threads) / settings.rate));
+
+        const auto statisticsBefore = options.statistics->snapshot();
+        const auto start = Clock::now();
+        const auto deadline = start + settings.duration;
+
+        std::vector<std::thread> threads;
+        for (auto &worker : workers)
+        {
+            threads.emplace_back([&worker, start, deadline, interval]() { worker.run(start, deadline, interval); });
+        }
+        for (auto &thread : threads)
+        {
+            thread.join();
+        }
+        const auto loadTime = Clock::now() - start;
+
+        const auto drainDeadline = Clock::now() + settings.drain;
+        while ((expected.getMatchedCount() != expected.getExpectedCount()) && (Clock::now() < drainDeadline))
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+
+        watchingThread.stop();
+        if (watchingError)
+        {
+            std::rethrow_exception(watchingError);
+        }
+
+        const auto statistics = options.statistics->snapshot();
+        const auto latency = expected.getLatency();
+
+        std::uint64_t operationsCount = 0;
+        for (const auto &done : counters.done)
+        {
+            operationsCount += done;
+        }
+
+        const double seconds = std::chrono::duration<double>(loadTime).count();
+        const std::uint64_t expectedCount = expected.getExpectedCount();
+        const std::uint64_t matchedCount = expected.getMatchedCount();
+
+        std::cout << std::fixed << std::setprecision(1)
+                  << "operations:         " << operationsCount
+                  << " (creates " << counters.done[Operation::create]
+                  << ", renames " << counters.done[Operation::rename]
+                  << ", deletes " << counters.done[Operation::remove]
+                  << ", modifies " << counters.done[Operation::modify]
+                  << "), failed " << counters.failed << '\n'
+                  << "achieved rate:      " << ((seconds > 0) ? operationsCount / seconds : 0.0) << " ops/s\n"
+                  << "completeness:       " << matchedCount << " of " << expectedCount << " changes ("
+                  << ((expectedCount != 0) ? 100.0 * matchedCount / expectedCount : 100.0) << "%)\n"
+                  << "unexpected changes: " << unexpectedCount << '\n'
+                  << "overflow rescans:   " << (statistics.overflowRescans - statisticsBefore.overflowRescans) << '\n'
+                  << "batches:            " << (statistics.batches - statisticsBefore.batches) << '\n'
+                  << "latency, us:        p50 " << toMicroseconds(latency.p50)
+                  << ", p99 " << toMicroseconds(latency.p99)
+                  << ", p99.9 " << toMicroseconds(latency.p999)
+                  << ", max " << toMicroseconds(latency.max) << std::endl;
+
+        // the files are left if the cleanup fails, so the scratch directory may need manual cleaning then
+        for (auto &worker : workers)
+        {
+            worker.removeFiles();
+        }
+        RemoveDirectoryW(MAKE_EXTENDED_PATH(directory).c_str());
+
+        return (matchedCount == expectedCount) ? 0 : 2;
+    }
+}
+
+
+int main()
+{
+    int argc = 0;
+    wchar_t **const rawArgv = CommandLineToArgvW(GetCommandLineW(), &argc);
+    if (rawArgv == nullptr)
+    {
+        std::cerr << "Command line can't be parsed" << std::endl;
+        return 1;
+    }
+
+    const std::vector<std::wstring> argv(rawArgv, rawArgv + argc);
+    LocalFree(rawArgv);
+
+    try
+    {
+        return run(parseSettings(argv));
+    }
+    catch (const std::invalid_argument &exception)
+    {
+        std::cerr << exception.what() << std::endl;
+        printUsage();
+    }
+    catch (const std::exception &exception)
+    {
+        std::cerr << exception.what() << std::endl;
+    }
+
+    return 1;
+}
+
+#else   // #ifdef _WIN32
+
+#error "Macro _WIN32 isn't defined. Check target OS (required Windows) for this build"
+
+#endif  // #ifdef _WIN32
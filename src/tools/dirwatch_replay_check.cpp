@@ -0,0 +1,316 @@
+#ifdef _WIN32
+
+#include "../model/directory_watcher.h"
+#include "../model/event_recording.h"
+#include "../model/file_operations.h"
+#include "../model/path.h"
+#include "../model/windows/win_extend_path_limit.h"
+#include <iostream>             // std::cout, std::cerr
+#include <string>               // std::wstring, std::to_wstring
+#include <vector>               // notifications buffer, mirror of the files list
+#include <memory>               // std::make_shared
+#include <thread>               // watchdog
+#include <mutex>                // std::mutex, std::unique_lock
+#include <condition_variable>   // watchdog wakeup
+#include <chrono>               // watchdog timeout
+#include <algorithm>            // std::sort
+#include <system_error>         // std::system_error
+#include <exception>            // std::exception
+#include <cstring>              // std::memcpy
+#include <cstddef>              // std::size_t, offsetof
+#include <Windows.h>            // WinAPI
+
+
+/*
+ * dirwatch-replay-check replays a recording of change buffers which reproduces the race of overflow recovery:
+ * the listing after an overflow and the restarted read report the same changes, so a DirectoryWatcher receives
+ * removes and modifies of unknown files, adds of tracked files and renames from unknown names
+ * The handler applies every batch to a mirror of the files list by file indices (as the GUI does) and checks
+ * that indices and paths agree; the final mirror must hold the expected files
+ *
+ * Usage: dirwatch-replay-check
+ * Exit code is 0 if the check has passed
+ */
+
+
+namespace
+{
+    using ChangeType = DirectoryWatcher::ChangeEntry::ChangeType;
+
+    constexpr std::chrono::seconds checkTimeout{10};
+
+
+    void throwLastError()
+    {
+        throw std::system_error(GetLastError(), std::system_category());
+    }
+
+    void createFile(const filesystem::Path &path)
+    {
+        const HANDLE file = CreateFileW(MAKE_EXTENDED_PATH(path).c_str(), GENERIC_WRITE, 0, nullptr,
+                                        CREATE_NEW, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            throwLastError();
+        }
+        CloseHandle(file);
+    }
+
+
+    std::wstring toWString(const filesystem::Path &path)
+    {
+        const auto &string = path.getPathString();
+        return std::wstring(string.data(), string.size());
+    }
+
+
+    /* Chain of FILE_NOTIFY_INFORMATION records as ReadDirectoryChangesW fills it */
+    class NotificationsBuffer
+    {
+    public:
+        NotificationsBuffer& add(DWORD action, const std::wstring &name)
+        {
+            constexpr std::size_t nameOffset = offsetof(FILE_NOTIFY_INFORMATION, FileName);
+
+            const std::size_t offset = data.size();     // in DWORDs
+            const DWORD nameBytes = static_cast<DWORD>(name.size() * sizeof(WCHAR));
+            data.resize(offset + (nameOffset + nameBytes + sizeof(DWORD) - 1) / sizeof(DWORD), 0);
+
+            if (offset != 0)
+            {
+                data[lastOffset] = static_cast<DWORD>((offset - lastOffset) * sizeof(DWORD));
+            }
+            lastOffset = offset;
+
+            data[offset + 1] = action;
+            data[offset + 2] = nameBytes;
+            std::memcpy(reinterpret_cast<char*>(data.data() + offset) + nameOffset, name.data(), nameBytes);
+
+            return *this;
+        }
+
+        const void* getData() const
+        {
+            return data.data();
+        }
+
+        std::size_t getSize() const
+        {
+            return data.size() * sizeof(DWORD);
+        }
+
+    private:
+        std::vector<DWORD> data;
+        std::size_t lastOffset = 0;
+    };
+
+
+    /* Applies changes to the mirror of the files list and collects disagreements */
+    class MirrorChecker
+    {
+    public:
+        void apply(const DirectoryWatcher::ChangeEntry &change)
+        {
+            const auto index = static_cast<std::size_t>(change.getFileIndex());
+            const filesystem::Path oldPath = change.getOldPath();
+            const filesystem::Path currentPath = change.getCurrentPath();
+
+            switch (change.getType())
+            {
+                case ChangeType::add:
+                    if (index != files.size())
+                    {
+                        fail(L"add of " + toWString(currentPath) + L" has index past the end");
+                        return;
+                    }
+                    files.push_back(currentPath);
+                    break;
+                case ChangeType::remove:
+                    if (check(index, oldPath, L"remove"))
+                    {
+                        files.erase(files.begin() + index);
+                    }
+                    break;
+                case ChangeType::rename:
+                    if (check(index, oldPath, L"rename"))
+                    {
+                        files[index] = currentPath;
+                    }
+                    break;
+                case ChangeType::modify:
+                    check(index, currentPath, L"modify");
+                    break;
+            }
+        }
+
+        void expect(std::vector<std::wstring> expected)
+        {
+            std::vector<std::wstring> actual;
+            for (const auto &file : files)
+            {
+                actual.push_back(toWString(file));
+            }
+
+            std::sort(actual.begin(), actual.end());
+            std::sort(expected.begin(), expected.end());
+            if (actual != expected)
+            {
+                fail(L"the tracked files differ from the expected ones");
+            }
+        }
+
+        void fail(const std::wstring &message)
+        {
+            std::wcerr << L"FAILED: " << message << std::endl;
+            ++failuresCount;
+        }
+
+        std::size_t getFailuresCount() const
+        {
+            return failuresCount;
+        }
+
+    private:
+        std::vector<filesystem::Path> files;
+        std::size_t failuresCount = 0;
+
+        bool check(std::size_t index, const filesystem::Path &path, const std::wstring &type)
+        {
+            if ((index >= files.size()) || !(files[index] == path))
+            {
+                fail(type + L" of " + toWString(path) + L" doesn't match the file index");
+                return false;
+            }
+
+            return true;
+        }
+    };
+
+
+    int run(const filesystem::Path &scratchDirectory)
+    {
+        const std::wstring name = L"dirwatch-replay-check-" + std::to_wstring(GetCurrentProcessId());
+        const filesystem::Path directory = scratchDirectory / filesystem::Path(name.c_str());
+        const filesystem::Path recording = scratchDirectory / filesystem::Path((name + L".dwer").c_str());
+
+        if (!CreateDirectoryW(MAKE_EXTENDED_PATH(directory).c_str(), nullptr))
+        {
+            throwLastError();
+        }
+        createFile(directory / filesystem::Path(L"a"));
+        createFile(directory / filesystem::Path(L"b"));
+
+        {
+            ChangeEventRecorder recorder(recording);
+
+            // the listing after an overflow has reported b as removed and c as added
+            NotificationsBuffer listed;
+            listed.add(FILE_ACTION_REMOVED, L"b").add(FILE_ACTION_ADDED, L"c");
+            recorder.record(listed.getData(), listed.getSize());
+
+            // the restarted read reports the same changes again, then changes of names the listing has missed
+            recorder.record(listed.getData(), listed.getSize());
+
+            NotificationsBuffer late;
+            late.add(FILE_ACTION_RENAMED_OLD_NAME, L"x").add(FILE_ACTION_RENAMED_NEW_NAME, L"y")
+                .add(FILE_ACTION_MODIFIED, L"b").add(FILE_ACTION_ADDED, L"a");
+            recorder.record(late.getData(), late.getSize());
+        }
+
+        const auto replayer = std::make_shared<ChangeEventReplayer>(recording, ChangeEventReplayer::Pace::unlimited);
+
+        DirectoryWatcher::Options options;
+        options.eventSource = replayer;
+        DirectoryWatcher watcher(directory, options);
+
+        std::mutex mutex;
+        std::condition_variable finished;
+        bool isFinished = false, isTimedOut = false;
+        std::thread watchdog([&]
+        {
+            std::unique_lock<decltype(mutex)> lock(mutex);
+            if (!finished.wait_for(lock, checkTimeout, [&]{ return isFinished; }))
+            {
+                isTimedOut = true;
+                watcher.stopWatch();
+            }
+        });
+
+        MirrorChecker checker;
+        try
+        {
+            watcher.startWatch([&](DirectoryWatcher::ChangeIterator begin, DirectoryWatcher::ChangeIterator end)
+            {
+                for (; begin != end; ++begin)
+                {
+                    checker.apply(*begin);
+                }
+
+                if (replayer->isExhausted())
+                {
+                    watcher.stopWatch();
+                }
+            });
+        }
+        catch (const std::exception &exception)
+        {
+            checker.fail(L"the watcher has failed: " + std::wstring(exception.what(), exception.what() +
+                                                                    std::strlen(exception.what())));
+        }
+
+        {
+            std::lock_guard<decltype(mutex)> lock(mutex);
+            isFinished = true;
+        }
+        finished.notify_one();
+        watchdog.join();
+
+        if (isTimedOut)
+        {
+            checker.fail(L"the recording hasn't been replayed in time");
+        }
+        checker.expect({L"a", L"c", L"y"});
+
+        // the files are left if the cleanup fails, so the scratch directory may need manual cleaning then
+        filesystem::remove(directory / filesystem::Path(L"a"));
+        filesystem::remove(directory / filesystem::Path(L"b"));
+        filesystem::remove(directory);
+        filesystem::remove(recording);
+
+        if (checker.getFailuresCount() != 0)
+        {
+            return 2;
+        }
+
+        std::cout << "OK" << std::endl;
+        return 0;
+    }
+}
+
+
+int main()
+{
+    try
+    {
+        WCHAR tempPath[MAX_PATH + 1];
+        const DWORD length = GetTempPathW(MAX_PATH + 1, tempPath);
+        if ((length == 0) || (length > MAX_PATH))
+        {
+            throwLastError();
+        }
+
+        return run(filesystem::Path(tempPath));
+    }
+    catch (const std::exception &exception)
+    {
+        std::cerr << exception.what() << std::endl;
+    }
+
+    return 1;
+}
+
+#else   // #ifdef _WIN32
+
+#error "Macro _WIN32 isn't defined. Check target OS (required Windows) for this build"
+
+#endif  // #ifdef _WIN32
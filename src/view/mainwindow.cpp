@@ -30,7 +30,8 @@ namespace
 
     void changeFilename(QTableWidget *filesTable, ChangeIter changeIter, const filesystem::Path &)
     {
-        QString fileName = QString::fromWCharArray(changeIter->getCurrentPath().getPathString().c_str());
+        const auto currentPath = changeIter->getCurrentPath();
+        QString fileName = QString::fromWCharArray(currentPath.data(), static_cast<int>(currentPath.size()));
 
         QSignalBlocker blocker(filesTable);
         filesTable->item(changeIter->getFileIndex(), MainWindow::fileNameColumn)->setData(Qt::UserRole, fileName);
@@ -102,7 +103,8 @@ MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),    
     ui(new Ui::MainWindow),
     controller(new MainWindowController(*this)),
-    worker(new QtDirectoryWatcherWorker())
+    worker(new QtDirectoryWatcherWorker()),
+    fileOperations(1, worker->getSelfChanges())
 {
     ui->setupUi(this);
 
@@ -3,8 +3,10 @@
 
 #include "../model/qt_directory_watcher_worker.h"
 #include "../model/directory_watcher.h"
+#include "../model/file_operations_executor.h"
 #include <QMainWindow>
 #include <QObject>
+#include <QString>
 #include <exception>        // std::exception_ptr
 
 namespace Ui {
@@ -19,12 +21,24 @@ class MainWindowController : public QObject
     Q_OBJECT
 
 public slots:
+    /* Renames the file in background; the edited name is reverted if renaming fails */
     void renameFile(int row, int column);
     void changeTrackedPath();
     void exit();
 
+signals:
+    /* Emitted by a thread of MainWindow::fileOperations; error is empty if the file has been renamed */
+    void renameFinished(QString dir, QString from, QString to, QString error);
+
+private slots:
+    void onRenameFinished(QString dir, QString from, QString to, QString error);
+
 private:
     friend class MainWindow;
+
+    /* Item data role of file names which are being renamed */
+    static constexpr int renamePendingRole = Qt::UserRole + 1;
+
     MainWindowController(MainWindow &parent);
 
     MainWindow *parent;
@@ -56,6 +70,7 @@ private:
     Ui::MainWindow *ui;
     MainWindowController *const controller;
     QtDirectoryWatcherWorker *const worker;    
+    FileOperationsExecutor fileOperations;      // single thread, so renames are made in editing order
 };
 
 #endif // MAINWINDOW_H